@@ -5,7 +5,26 @@ include $(CLEAR_VARS)
 LOCAL_MODULE    := TeapotNativeActivity
 LOCAL_SRC_FILES := TeapotNativeActivity.cpp \
  TeapotRenderer.cpp \
- SkyboxRenderer.cpp
+ SkyboxRenderer.cpp \
+ CubemapTexture.cpp \
+ ResourceRegistry.cpp \
+ TexturePool.cpp \
+ WorkerPool.cpp \
+ CubemapConverter.cpp \
+ Benchmark.cpp \
+ ImageCache.cpp \
+ UploadRing.cpp \
+ Mesh.cpp \
+ GLStateCache.cpp \
+ UniformBlocks.cpp \
+ RenderQueue.cpp \
+ CommandQueue.cpp \
+ FramePackets.cpp \
+ DynamicRing.cpp \
+ SceneTarget.cpp \
+ ResolutionController.cpp \
+ PostProcess.cpp \
+ ShaderVariants.cpp
 
 LOCAL_C_INCLUDES :=
 
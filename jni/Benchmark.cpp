@@ -0,0 +1,140 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// Benchmark.cpp
+// Frame time measurement over a list of rendering scenarios
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+
+#include "Benchmark.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+Benchmark::Benchmark()
+    : current_(0),
+      frame_(0),
+      last_time_(0.0),
+      setup_time_(0.0),
+      running_(false) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+Benchmark::~Benchmark() {}
+
+int32_t Benchmark::AddScenario(const char* name,
+                               const std::function<void()>& setup,
+                               const std::function<void()>& prepare) {
+  BENCHMARK_SCENARIO scenario = { name, prepare, setup, -1 };
+  scenarios_.push_back(scenario);
+  return static_cast<int32_t>(scenarios_.size()) - 1;
+}
+
+void Benchmark::SetBaseline(const int32_t scenario, const int32_t baseline) {
+  scenarios_[scenario].baseline = baseline;
+}
+
+void Benchmark::AddCounter(const char* name,
+                           const std::function<int32_t()>& counter) {
+  BENCHMARK_COUNTER entry = { name, counter, 0.0 };
+  counters_.push_back(entry);
+}
+
+void Benchmark::Clear() {
+  scenarios_.clear();
+  done_ = nullptr;
+  counters_.clear();
+  running_ = false;
+}
+
+void Benchmark::Start() {
+  if (scenarios_.empty()) return;
+
+  LOGI("Benchmark started, %d scenarios", static_cast<int32_t>(scenarios_.size()));
+  current_ = 0;
+  frame_ = 0;
+  frame_times_.clear();
+  averages_.clear();
+  for (size_t i = 0; i < counters_.size(); ++i) counters_[i].total = 0.0;
+  running_ = true;
+}
+
+void Benchmark::Update(const double time) {
+  if (!running_) return;
+
+  if (frame_ == 0) {
+    const BENCHMARK_SCENARIO& scenario = scenarios_[current_];
+    if (scenario.prepare) scenario.prepare();
+    const double start = ndk_helper::PerfMonitor::GetCurrentTime();
+    scenario.setup();
+    setup_time_ = ndk_helper::PerfMonitor::GetCurrentTime() - start;
+    // The setup time is not a frame
+    last_time_ = ndk_helper::PerfMonitor::GetCurrentTime();
+    frame_++;
+    return;
+  }
+
+  const double frame_time = time - last_time_;
+  last_time_ = time;
+  if (frame_++ > BENCHMARK_WARMUP_FRAMES) {
+    frame_times_.push_back(frame_time);
+    for (size_t i = 0; i < counters_.size(); ++i)
+      counters_[i].total += counters_[i].sample();
+  }
+  if (frame_ <= BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES) return;
+
+  Report();
+  frame_ = 0;
+  frame_times_.clear();
+  for (size_t i = 0; i < counters_.size(); ++i) counters_[i].total = 0.0;
+  if (++current_ == static_cast<int32_t>(scenarios_.size())) {
+    LOGI("Benchmark finished");
+    running_ = false;
+    if (done_) done_();
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Setup time, average, median and 95th percentile frame times in ms
+//--------------------------------------------------------------------------------
+void Benchmark::Report() {
+  std::vector<double> times = frame_times_;
+  std::sort(times.begin(), times.end());
+
+  double total = 0.0;
+  for (size_t i = 0; i < times.size(); ++i) total += times[i];
+  const double average = total / times.size();
+  averages_.push_back(average);
+  LOGI("Benchmark %s: setup %.1f ms, avg %.2f ms, median %.2f ms, 95th %.2f ms",
+       scenarios_[current_].name.c_str(), setup_time_ * 1000.0,
+       average * 1000.0,
+       times[times.size() / 2] * 1000.0, times[times.size() * 95 / 100] * 1000.0);
+
+  for (size_t i = 0; i < counters_.size(); ++i)
+    LOGI("Benchmark %s: %.0f %s/frame", scenarios_[current_].name.c_str(),
+         counters_[i].total / times.size(), counters_[i].name.c_str());
+  const int32_t baseline = scenarios_[current_].baseline;
+  if (baseline >= 0 && baseline < static_cast<int32_t>(averages_.size()))
+    LOGI("Benchmark %s: saves %.2f ms/frame against %s",
+         scenarios_[current_].name.c_str(),
+         (averages_[baseline] - average) * 1000.0,
+         scenarios_[baseline].name.c_str());
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// Benchmark.h
+// Frame time measurement over a list of rendering scenarios
+//--------------------------------------------------------------------------------
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Frames skipped after a scenario is set up, e.g. while its textures stream in
+const int32_t BENCHMARK_WARMUP_FRAMES = 30;
+const int32_t BENCHMARK_FRAMES = 200;
+
+struct BENCHMARK_SCENARIO {
+  std::string name;
+  // Untimed, may be empty
+  std::function<void()> prepare;
+  std::function<void()> setup;
+  // Scenario the frame time saving is reported against, -1 for none
+  int32_t baseline;
+};
+
+struct BENCHMARK_COUNTER {
+  std::string name;
+  std::function<int32_t()> sample;
+  double total;
+};
+
+/******************************************************************
+ * Runs the scenarios one after another.
+ * Update() is called once per frame before drawing. It calls the prepare and
+ * setup of the next scenario, skips the warm-up frames and then records the
+ * time between frames. The time spent in setup is reported as well, e.g. for
+ * load time comparisons. Results are written to the log, the done callback is called after
+ * the last scenario so that the owner can restore its settings.
+ *
+ * Optional counters, e.g. triangles drawn, are sampled every timed frame and
+ * their averages reported. A scenario with a baseline also reports the average
+ * frame time it saves over the baseline scenario.
+ *
+ * Swap interval 0 is expected, otherwise all scenarios report the vsync
+ * interval.
+ */
+class Benchmark {
+  std::vector<BENCHMARK_SCENARIO> scenarios_;
+  std::function<void()> done_;
+  std::vector<double> frame_times_;
+  // Average frame time per finished scenario
+  std::vector<double> averages_;
+  std::vector<BENCHMARK_COUNTER> counters_;
+  int32_t current_;
+  int32_t frame_;
+  double last_time_;
+  double setup_time_;
+  bool running_;
+
+  void Report();
+
+ public:
+  Benchmark();
+  virtual ~Benchmark();
+
+  // Returns the index of the scenario
+  int32_t AddScenario(const char* name, const std::function<void()>& setup,
+                      const std::function<void()>& prepare = nullptr);
+  void SetBaseline(const int32_t scenario, const int32_t baseline);
+  void AddCounter(const char* name, const std::function<int32_t()>& counter);
+  void SetDoneCallback(const std::function<void()>& done) { done_ = done; }
+  void Clear();
+
+  void Start();
+  void Update(const double time);
+  bool IsRunning() const { return running_; }
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// CommandQueue.cpp
+// Lock-free queue of commands from the UI and input threads
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "CommandQueue.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+CommandQueue::CommandQueue() : head_(0), tail_(0) {
+  for (int32_t i = 0; i < COMMAND_QUEUE_SIZE; ++i)
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+CommandQueue::~CommandQueue() {}
+
+bool CommandQueue::Push(const COMMAND& command) {
+  uint32_t position = head_.load(std::memory_order_relaxed);
+  for (;;) {
+    SLOT& slot = slots_[position & (COMMAND_QUEUE_SIZE - 1)];
+    const uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    const int32_t difference =
+        static_cast<int32_t>(sequence) - static_cast<int32_t>(position);
+    if (difference == 0) {
+      // Free slot, claim it
+      if (head_.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+        slot.command = command;
+        slot.sequence.store(position + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (difference < 0) {
+      // Not freed by the consumer yet
+      LOGI("Command queue full, dropping command %d", command.type);
+      return false;
+    } else {
+      // Claimed by another producer
+      position = head_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool CommandQueue::Pop(COMMAND* command) {
+  SLOT& slot = slots_[tail_ & (COMMAND_QUEUE_SIZE - 1)];
+  const uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+  if (sequence != tail_ + 1) return false;
+
+  *command = slot.command;
+  slot.sequence.store(tail_ + COMMAND_QUEUE_SIZE, std::memory_order_release);
+  ++tail_;
+  return true;
+}
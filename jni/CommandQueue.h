@@ -0,0 +1,74 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// CommandQueue.h
+// Lock-free queue of commands from the UI and input threads
+//--------------------------------------------------------------------------------
+#ifndef _COMMANDQUEUE_H
+#define _COMMANDQUEUE_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <atomic>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Power of two, commands pushed into a full queue are dropped
+const int32_t COMMAND_QUEUE_SIZE = 256;
+
+// type is defined by the consumer
+struct COMMAND {
+  int32_t type;
+  int32_t value;
+  float args[4];
+};
+
+/******************************************************************
+ * Bounded ring with a sequence number per slot. Producers claim a slot with a
+ * compare and swap on the head and publish it through its sequence number,
+ * the single consumer frees it the same way. Neither side ever blocks.
+ *
+ * Thread safety: Push() from any thread, Pop() from one thread.
+ */
+class CommandQueue {
+  struct SLOT {
+    std::atomic<uint32_t> sequence;
+    COMMAND command;
+  };
+  SLOT slots_[COMMAND_QUEUE_SIZE];
+  std::atomic<uint32_t> head_;
+  // Consumer only
+  uint32_t tail_;
+
+  CommandQueue(CommandQueue const&);
+  void operator=(CommandQueue const&);
+
+ public:
+  CommandQueue();
+  virtual ~CommandQueue();
+
+  // False when the queue is full
+  bool Push(const COMMAND& command);
+  // False when the queue is empty
+  bool Pop(COMMAND* command);
+};
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// CubemapConverter.cpp
+// Single image environment maps to cubemap mip chains
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+
+#include "CubemapConverter.h"
+#include "WorkerPool.h"
+#include "ImageCache.h"
+
+//--------------------------------------------------------------------------------
+// Vertical cross cells in face order +X -X +Y -Y +Z -Z
+//--------------------------------------------------------------------------------
+struct CROSS_CELL {
+  int32_t column;
+  int32_t row;
+  bool rotated;
+};
+
+static const CROSS_CELL CROSS_CELLS[] = {
+    {2, 1, false}, {0, 1, false}, {1, 0, false},
+    {1, 2, false}, {1, 1, false}, {1, 3, true},
+};
+
+void CubemapConverter::SliceCross(const uint8_t* pixels, const int32_t width,
+                                  const int32_t face,
+                                  std::vector<uint8_t>* out) {
+  const int32_t size = width / 3;
+  const CROSS_CELL& cell = CROSS_CELLS[face];
+  out->resize(size * size * 4);
+  for (int32_t y = 0; y < size; ++y) {
+    const int32_t src_y = cell.row * size + (cell.rotated ? size - 1 - y : y);
+    const uint8_t* src = pixels + (src_y * width + cell.column * size) * 4;
+    uint8_t* dst = &(*out)[y * size * 4];
+    if (!cell.rotated) {
+      memcpy(dst, src, size * 4);
+      continue;
+    }
+    for (int32_t x = 0; x < size; ++x)
+      memcpy(dst + x * 4, src + (size - 1 - x) * 4, 4);
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Bilinear lookup with the GL cubemap face orientation
+//--------------------------------------------------------------------------------
+void CubemapConverter::SampleEquirect(const uint8_t* pixels,
+                                      const int32_t width,
+                                      const int32_t height,
+                                      const int32_t face,
+                                      const int32_t face_size,
+                                      std::vector<uint8_t>* out) {
+  out->resize(face_size * face_size * 4);
+  for (int32_t y = 0; y < face_size; ++y) {
+    for (int32_t x = 0; x < face_size; ++x) {
+      const float sc = (x + 0.5f) / face_size * 2.f - 1.f;
+      const float tc = (y + 0.5f) / face_size * 2.f - 1.f;
+      float dir[3];
+      switch (face) {
+        case 0: dir[0] = 1.f; dir[1] = -tc; dir[2] = -sc; break;
+        case 1: dir[0] = -1.f; dir[1] = -tc; dir[2] = sc; break;
+        case 2: dir[0] = sc; dir[1] = 1.f; dir[2] = tc; break;
+        case 3: dir[0] = sc; dir[1] = -1.f; dir[2] = -tc; break;
+        case 4: dir[0] = sc; dir[1] = -tc; dir[2] = 1.f; break;
+        default: dir[0] = -sc; dir[1] = -tc; dir[2] = -1.f; break;
+      }
+      const float length =
+          sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+
+      // +Z in the center, u grows toward +X
+      const float u = 0.5f + atan2f(dir[0], dir[2]) / (2.f * M_PI);
+      const float v = acosf(dir[1] / length) / M_PI;
+      const float fx = u * width - 0.5f;
+      const float fy = std::min(std::max(v * height - 0.5f, 0.f),
+                                static_cast<float>(height - 1));
+      const int32_t x0 = static_cast<int32_t>(floorf(fx));
+      const int32_t y0 = static_cast<int32_t>(fy);
+      const float wx = fx - x0;
+      const float wy = fy - y0;
+      // Wrap around horizontally
+      const int32_t xa = (x0 % width + width) % width;
+      const int32_t xb = (xa + 1) % width;
+      const int32_t y1 = std::min(y0 + 1, height - 1);
+
+      uint8_t* dst = &(*out)[(y * face_size + x) * 4];
+      for (int32_t c = 0; c < 4; ++c) {
+        const float top = pixels[(y0 * width + xa) * 4 + c] * (1.f - wx) +
+                          pixels[(y0 * width + xb) * 4 + c] * wx;
+        const float bottom = pixels[(y1 * width + xa) * 4 + c] * (1.f - wx) +
+                             pixels[(y1 * width + xb) * 4 + c] * wx;
+        dst[c] = static_cast<uint8_t>(top * (1.f - wy) + bottom * wy + 0.5f);
+      }
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Kaiser window
+//--------------------------------------------------------------------------------
+static float BesselI0(const float x) {
+  float sum = 1.f;
+  float term = 1.f;
+  for (int32_t k = 1; k < 16; ++k) {
+    term *= (x / (2.f * k)) * (x / (2.f * k));
+    sum += term;
+  }
+  return sum;
+}
+
+static float Kaiser(const float x, const float alpha) {
+  if (fabsf(x) > 1.f) return 0.f;
+  return BesselI0(alpha * sqrtf(1.f - x * x)) / BesselI0(alpha);
+}
+
+static float Sinc(const float x) {
+  if (fabsf(x) < 1e-5f) return 1.f;
+  return sinf(M_PI * x) / (M_PI * x);
+}
+
+//--------------------------------------------------------------------------------
+// Halve a size x size RGBA8 image
+//--------------------------------------------------------------------------------
+void CubemapConverter::Downsample(const std::vector<uint8_t>& src,
+                                  const int32_t size, const MIP_FILTER filter,
+                                  std::vector<uint8_t>* dst) {
+  const int32_t half = std::max(size / 2, 1);
+  dst->resize(half * half * 4);
+  if (size == 1) {
+    *dst = src;
+    return;
+  }
+
+  if (filter == MIP_FILTER_BOX) {
+    for (int32_t y = 0; y < half; ++y) {
+      for (int32_t x = 0; x < half; ++x) {
+        const uint8_t* p0 = &src[((y * 2) * size + x * 2) * 4];
+        const uint8_t* p1 = p0 + size * 4;
+        for (int32_t c = 0; c < 4; ++c)
+          (*dst)[(y * half + x) * 4 + c] =
+              (p0[c] + p0[c + 4] + p1[c] + p1[c + 4] + 2) >> 2;
+      }
+    }
+    return;
+  }
+
+  // Separable 8 tap kernel, taps are 0.5 - 3.5 texels off the destination
+  // texel center
+  const int32_t TAPS = 8;
+  float kernel[TAPS];
+  float sum = 0.f;
+  for (int32_t i = 0; i < TAPS; ++i) {
+    const float d = i - TAPS / 2 + 0.5f;
+    kernel[i] = Sinc(d / 2.f) * Kaiser(d / (TAPS / 2), 4.f);
+    sum += kernel[i];
+  }
+  for (int32_t i = 0; i < TAPS; ++i) kernel[i] /= sum;
+
+  // Horizontal pass into half x size
+  std::vector<float> temp(half * size * 4);
+  for (int32_t y = 0; y < size; ++y) {
+    for (int32_t x = 0; x < half; ++x) {
+      for (int32_t c = 0; c < 4; ++c) {
+        float value = 0.f;
+        for (int32_t i = 0; i < TAPS; ++i) {
+          const int32_t sx =
+              std::min(std::max(x * 2 - TAPS / 2 + 1 + i, 0), size - 1);
+          value += src[(y * size + sx) * 4 + c] * kernel[i];
+        }
+        temp[(y * half + x) * 4 + c] = value;
+      }
+    }
+  }
+
+  // Vertical pass
+  for (int32_t y = 0; y < half; ++y) {
+    for (int32_t x = 0; x < half; ++x) {
+      for (int32_t c = 0; c < 4; ++c) {
+        float value = 0.f;
+        for (int32_t i = 0; i < TAPS; ++i) {
+          const int32_t sy =
+              std::min(std::max(y * 2 - TAPS / 2 + 1 + i, 0), size - 1);
+          value += temp[(sy * half + x) * 4 + c] * kernel[i];
+        }
+        (*dst)[(y * half + x) * 4 + c] = static_cast<uint8_t>(
+            std::min(std::max(value + 0.5f, 0.f), 255.f));
+      }
+    }
+  }
+}
+
+bool CubemapConverter::Convert(const char* file_name, const int32_t size,
+                               const MIP_FILTER filter, CUBEMAP_CHAIN* chain) {
+  // Single decode on the calling thread
+  CACHED_IMAGE image;
+  if (!ImageCache::GetInstance()->Load(file_name, &image)) return false;
+  const uint8_t* pixels = image.pixels;
+  const int32_t width = image.width;
+  const int32_t height = image.height;
+
+  const bool cross = width * 4 == height * 3;
+  const bool equirect = width == height * 2;
+  int32_t source_size = size * 2;
+  if (cross) {
+    // Only power of two steps down to the cubemap size
+    source_size = width / 3;
+    int32_t s = source_size;
+    while (s > size && s % 2 == 0) s /= 2;
+    if (s != size) {
+      LOGI("Unsupported cross face size %d of %s", source_size, file_name);
+      ImageCache::GetInstance()->Release(&image);
+      return false;
+    }
+  } else if (!equirect) {
+    LOGI("Unsupported layout %dx%d of %s", width, height, file_name);
+    ImageCache::GetInstance()->Release(&image);
+    return false;
+  }
+
+  // One face per task
+  WorkerBatch batch;
+  for (int32_t face = 0; face < 6; ++face) {
+    batch.Submit([&, face]() {
+      std::vector<uint8_t> level;
+      if (cross)
+        SliceCross(pixels, width, face, &level);
+      else
+        SampleEquirect(pixels, width, height, face, source_size, &level);
+
+      int32_t level_size = source_size;
+      std::vector<std::vector<uint8_t> >& levels = chain->faces[face];
+      levels.clear();
+      while (true) {
+        if (level_size <= size) levels.push_back(level);
+        if (level_size == 1) break;
+        std::vector<uint8_t> next;
+        Downsample(level, level_size, filter, &next);
+        level.swap(next);
+        level_size /= 2;
+      }
+    });
+  }
+  batch.Wait();
+  ImageCache::GetInstance()->Release(&image);
+  return true;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// CubemapConverter.h
+// Single image environment maps to cubemap mip chains
+//--------------------------------------------------------------------------------
+#ifndef _CUBEMAPCONVERTER_H
+#define _CUBEMAPCONVERTER_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <vector>
+
+#include "NDKHelper.h"
+
+enum MIP_FILTER {
+  // 2x2 average
+  MIP_FILTER_BOX,
+  // Kaiser windowed sinc, sharper with less aliasing
+  MIP_FILTER_KAISER,
+};
+
+/******************************************************************
+ * RGBA8 faces of a cubemap mip chain, faces[face][level]
+ */
+struct CUBEMAP_CHAIN {
+  std::vector<std::vector<uint8_t> > faces[6];
+
+  const uint8_t* GetFace(const int32_t level, const int32_t face) const {
+    return &faces[face][level][0];
+  }
+  bool IsEmpty() const { return faces[0].empty(); }
+  void Clear() {
+    for (int32_t face = 0; face < 6; ++face) faces[face].clear();
+  }
+};
+
+/******************************************************************
+ * Converts one environment image into the six faces of a cubemap and
+ * builds their mip chain on the worker pool.
+ *
+ * Supported layouts, detected from the aspect ratio:
+ * - Vertical cross (3:4), +Y on top, -X +Z +X in the middle row, then -Y and
+ *   -Z rotated by 180 degrees, as in stpeters_cross.bmp.
+ * - Equirectangular (2:1), +Z in the center, +Y on top.
+ *
+ * Faces are filtered separately with clamped edges, seams are not fixed up.
+ */
+class CubemapConverter {
+  static void SliceCross(const uint8_t* pixels, const int32_t width,
+                         const int32_t face, std::vector<uint8_t>* out);
+  static void SampleEquirect(const uint8_t* pixels, const int32_t width,
+                             const int32_t height, const int32_t face,
+                             const int32_t face_size,
+                             std::vector<uint8_t>* out);
+
+ public:
+  static void Downsample(const std::vector<uint8_t>& src, const int32_t size,
+                         const MIP_FILTER filter, std::vector<uint8_t>* dst);
+
+  /*
+   * Decode file_name and fill chain with levels of size x size down to 1x1.
+   * Blocks until the workers are done, returns false when the file can not be
+   * decoded or its layout is not supported.
+   */
+  static bool Convert(const char* file_name, const int32_t size,
+                      const MIP_FILTER filter, CUBEMAP_CHAIN* chain);
+};
+
+#endif
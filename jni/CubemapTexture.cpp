@@ -0,0 +1,572 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// CubemapTexture.cpp
+// Cubemap texture streamed from coarse to fine mip levels
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+#include <cstring>
+
+#include "CubemapTexture.h"
+#include "GLStateCache.h"
+
+#define BUFFER_OFFSET(i) ((char*)NULL + (i))
+
+// Octahedral lookup injected after the OCTAHEDRAL define, shared by every
+// shader sampling the map. Folds the lower hemisphere over the diamond of the
+// upper one, the same mapping as tools/octahedral_converter.cpp
+static const char OCTAHEDRAL_SHADER_MAPPING[] =
+    "highp vec2 OctahedralUV(highp vec3 dir)\n"
+    "{\n"
+    "  dir /= abs(dir.x) + abs(dir.y) + abs(dir.z);\n"
+    "  highp vec2 p = dir.xz;\n"
+    "  if (dir.y < 0.0)\n"
+    "    p = (1.0 - abs(p.yx)) *\n"
+    "        vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);\n"
+    "  return p * 0.5 + 0.5;\n"
+    "}";
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+CubemapTexture::CubemapTexture()
+    : tex_(0),
+      target_(GL_TEXTURE_CUBE_MAP),
+      first_level_(0),
+      base_level_(CUBEMAP_LEVELS),
+      level_limit_(0),
+      format_(CUBEMAP_FORMAT),
+      trim_limit_(0),
+      evict_frames_(0),
+      next_face_(0),
+      streaming_(false),
+      failed_(false),
+      upload_slot_(-1),
+      upload_level_(0),
+      upload_faces_(0) {
+  image_.pixels = NULL;
+  image_.map = NULL;
+  image_.map_size = 0;
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+CubemapTexture::~CubemapTexture() { Unload(); }
+
+//--------------------------------------------------------------------------------
+// Capability check for the cubemap array residency mode
+//--------------------------------------------------------------------------------
+bool CubemapTexture::IsArraySupported() {
+  GLint major = 0;
+  GLint minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major > 3 || (major == 3 && minor >= 2)) return true;
+
+  ndk_helper::GLContext* context = ndk_helper::GLContext::GetInstance();
+  return context->CheckExtension("GL_EXT_texture_cube_map_array") ||
+         context->CheckExtension("GL_OES_texture_cube_map_array");
+}
+
+const char* CubemapTexture::GetArrayShaderHeader() {
+  GLint major = 0;
+  GLint minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major > 3 || (major == 3 && minor >= 2)) return "#version 320 es\n";
+
+  if (ndk_helper::GLContext::GetInstance()->CheckExtension(
+          "GL_EXT_texture_cube_map_array"))
+    return "#version 310 es\n"
+           "#extension GL_EXT_texture_cube_map_array : require\n";
+  return "#version 310 es\n"
+         "#extension GL_OES_texture_cube_map_array : require\n";
+}
+
+//--------------------------------------------------------------------------------
+// Shaders select the sampler with CUBEMAP_ARRAY or OCTAHEDRAL, the octahedral
+// header also defines OctahedralUV()
+//--------------------------------------------------------------------------------
+const char* CubemapTexture::GetShaderVariant(const ENVMAP_TYPE type) {
+  switch (type) {
+    case ENVMAP_CUBEMAP_ARRAY:
+      return "array";
+    case ENVMAP_OCTAHEDRAL:
+      return "octahedral";
+    default:
+      return "";
+  }
+}
+
+void CubemapTexture::GetShaderParams(
+    const ENVMAP_TYPE type, std::map<std::string, std::string>* params) {
+  if (type == ENVMAP_CUBEMAP_ARRAY)
+    (*params)["#version 300 es"] =
+        std::string(GetArrayShaderHeader()) + "#define CUBEMAP_ARRAY";
+  else if (type == ENVMAP_OCTAHEDRAL)
+    (*params)["#version 300 es"] =
+        std::string("#version 300 es\n#define OCTAHEDRAL\n") +
+        OCTAHEDRAL_SHADER_MAPPING;
+}
+
+//--------------------------------------------------------------------------------
+// Pixels of a layer-face, from the converted chain, the image cache or decoded
+// into dst. NULL when missing or of the wrong size, the storage is fixed.
+// Safe on the worker pool, image is released by the caller.
+//--------------------------------------------------------------------------------
+const uint8_t* CubemapTexture::ReadFace(const int32_t level,
+                                        const int32_t face,
+                                        CACHED_IMAGE* image,
+                                        uint8_t* dst) const {
+  const int32_t layer = face / GetLayerFaces();
+  const int32_t size = GetLevelSize(level);
+
+  if (IsConverted(layer)) {
+    // Built by ConvertLayers()
+    if (chains_[layer].IsEmpty()) return NULL;
+    return chains_[layer].GetFace(level, face % CUBEMAP_FACES);
+  }
+
+  const int32_t BUFFER_SIZE = 256;
+  char file_name_buffer[BUFFER_SIZE];
+  snprintf(file_name_buffer, BUFFER_SIZE, file_names_[layer].c_str(), level,
+           face % CUBEMAP_FACES);
+
+  if (!ImageCache::GetInstance()->Load(file_name_buffer, image, dst,
+                                       dst ? size * size * 4 : 0))
+    return NULL;
+  if (image->width != size || image->height != size) {
+    LOGI("Unexpected size %dx%d of %s", image->width, image->height,
+         file_name_buffer);
+    return NULL;
+  }
+  return image->pixels;
+}
+
+//--------------------------------------------------------------------------------
+// Upload a layer-face to the bound texture, data is an offset into the bound
+// GL_PIXEL_UNPACK_BUFFER if any
+//--------------------------------------------------------------------------------
+void CubemapTexture::UploadFace(const int32_t level, const int32_t face,
+                                const void* data) {
+  const int32_t size = GetLevelSize(level);
+  if (IsArray())
+    glTexSubImage3D(target_, level - first_level_, 0, 0, face, size, size, 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, data);
+  else if (target_ == GL_TEXTURE_2D)
+    glTexSubImage2D(GL_TEXTURE_2D, level - first_level_, 0, 0, size, size,
+                    GL_RGBA, GL_UNSIGNED_BYTE, data);
+  else
+    glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                    level - first_level_, 0, 0, size, size, GL_RGBA,
+                    GL_UNSIGNED_BYTE, data);
+}
+
+//--------------------------------------------------------------------------------
+// Read and upload a layer-face of the chain on the GL thread
+//--------------------------------------------------------------------------------
+bool CubemapTexture::LoadFace(const int32_t level, const int32_t face) {
+  const int32_t size = GetLevelSize(level);
+  ImageCache* cache = ImageCache::GetInstance();
+  const uint8_t* data = ReadFace(level, face, &image_, NULL);
+
+  if (data == NULL) {
+    cache->Release(&image_);
+    if (!IsArray()) return false;
+
+    // Keep the other layers usable
+    LOGI("Filling layer %d with black", face / GetLayerFaces());
+    pixels_.assign(size * size * 4, 0);
+    data = &pixels_[0];
+  }
+
+  UploadFace(level, face, data);
+  // The upload has copied the mapping
+  cache->Release(&image_);
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+// Single image layers are decoded once and their whole chain is built on the
+// worker pool, the chains are kept until all their levels are uploaded
+//--------------------------------------------------------------------------------
+bool CubemapTexture::IsConverted(const int32_t layer) const {
+  return target_ != GL_TEXTURE_2D &&
+         file_names_[layer].find('%') == std::string::npos;
+}
+
+bool CubemapTexture::ConvertLayers() {
+  chains_.clear();
+  for (int32_t layer = 0; layer < GetLayers(); ++layer) {
+    if (!IsConverted(layer)) continue;
+
+    chains_.resize(GetLayers());
+    const double start = ndk_helper::PerfMonitor::GetCurrentTime();
+    if (!CubemapConverter::Convert(file_names_[layer].c_str(), CUBEMAP_SIZE,
+                                   CUBEMAP_MIP_FILTER, &chains_[layer])) {
+      LOGI("Failed to convert %s", file_names_[layer].c_str());
+      if (!IsArray()) return false;
+      continue;
+    }
+    LOGI("Converted %s in %.1f ms", file_names_[layer].c_str(),
+         (ndk_helper::PerfMonitor::GetCurrentTime() - start) * 1000.0);
+  }
+  return true;
+}
+
+int32_t CubemapTexture::GetLevelSize(const int32_t level) const {
+  const int32_t size = CUBEMAP_SIZE >> level;
+  return target_ == GL_TEXTURE_2D ? size * 2 : size;
+}
+
+ENVMAP_TYPE CubemapTexture::GetType() const {
+  if (target_ == GL_TEXTURE_2D) return ENVMAP_OCTAHEDRAL;
+  if (IsArray()) return ENVMAP_CUBEMAP_ARRAY;
+  return ENVMAP_CUBEMAP;
+}
+
+void CubemapTexture::UpdateBaseLevel(const int32_t level) {
+  base_level_ = level;
+  glTexParameteri(target_, GL_TEXTURE_BASE_LEVEL, base_level_ - first_level_);
+}
+
+bool CubemapTexture::Load(const char* file_name) {
+  LOGI("Loading Cubemap Textures %s", file_name);
+  // Workers may still read the previous layers
+  CancelUpload();
+  target_ = GL_TEXTURE_CUBE_MAP;
+  file_names_.assign(1, file_name);
+  file_name_ = file_name;
+  failed_ = false;
+
+  // Upload 1x1 - 16x16 levels right away so that the stage is visible in the
+  // next frame
+  return LoadLevels(std::max(CUBEMAP_INITIAL_LEVEL, level_limit_));
+}
+
+bool CubemapTexture::LoadArray(const std::vector<std::string>& file_names) {
+  CancelUpload();
+  target_ = GL_TEXTURE_CUBE_MAP_ARRAY_EXT;
+  file_names_ = file_names;
+  file_name_.clear();
+  for (size_t i = 0; i < file_names.size(); ++i) {
+    if (i) file_name_ += "|";
+    file_name_ += file_names[i];
+  }
+  LOGI("Loading Cubemap Array %s", file_name_.c_str());
+  failed_ = false;
+
+  return LoadLevels(std::max(CUBEMAP_INITIAL_LEVEL, level_limit_));
+}
+
+bool CubemapTexture::LoadOctahedral(const char* file_name) {
+  LOGI("Loading Octahedral Textures %s", file_name);
+  CancelUpload();
+  target_ = GL_TEXTURE_2D;
+  file_names_.assign(1, file_name);
+  file_name_ = file_name;
+  failed_ = false;
+
+  return LoadLevels(std::max(CUBEMAP_INITIAL_LEVEL, level_limit_));
+}
+
+//--------------------------------------------------------------------------------
+// (Re)allocate storage for levels level_limit_ - CUBEMAP_LEVELS-1 and upload
+// levels upload_level - CUBEMAP_LEVELS-1
+//--------------------------------------------------------------------------------
+bool CubemapTexture::LoadLevels(const int32_t upload_level) {
+  Unload();
+
+  if (!ConvertLayers()) {
+    failed_ = true;
+    return false;
+  }
+
+  // Storage starts at the finest level allowed, texture level 0 is
+  // first_level_ of the chain
+  first_level_ = level_limit_;
+  tex_ = TexturePool::GetInstance()->AcquireCubemap(
+      target_, GetLayers(), CUBEMAP_LEVELS - first_level_,
+      GetLevelSize(first_level_), format_);
+
+  glTexParameteri(target_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(target_, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(target_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(target_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(target_, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  for (int32_t level = CUBEMAP_LEVELS - 1; level >= upload_level; --level) {
+    for (int32_t face = 0; face < GetFaces(); ++face) {
+      if (!LoadFace(level, face)) {
+        LOGI("Failed to load cubemap %s", file_name_.c_str());
+        // A pooled texture may hold another stage, sample nothing instead
+        failed_ = true;
+        Unload();
+        return false;
+      }
+    }
+  }
+  UpdateBaseLevel(upload_level);
+  next_face_ = 0;
+  streaming_ = base_level_ > level_limit_;
+  if (!streaming_) chains_.clear();
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+// Limit residency to level and coarser regardless of the requirements.
+// Finer levels are dropped right away and streamed back in once the limit is
+// lowered again.
+//--------------------------------------------------------------------------------
+void CubemapTexture::SetLevelLimit(const int32_t level) {
+  trim_limit_ = std::min(std::max(level, 0), CUBEMAP_LEVELS - 1);
+  evict_frames_ = 0;
+  ApplyLevelLimit(GetRequiredLevel());
+}
+
+//--------------------------------------------------------------------------------
+// Level requirements of the users
+//--------------------------------------------------------------------------------
+void CubemapTexture::RequireLevel(const void* user, const int32_t level,
+                                  const bool optional) {
+  LEVEL_REQUEST request = { std::min(std::max(level, 0), CUBEMAP_LEVELS - 1),
+                            optional };
+  level_requests_[user] = request;
+}
+
+void CubemapTexture::ReleaseLevel(const void* user) {
+  level_requests_.erase(user);
+}
+
+//--------------------------------------------------------------------------------
+// Finest level required, full chain without users
+//--------------------------------------------------------------------------------
+int32_t CubemapTexture::GetRequiredLevel() const {
+  // Optional users give way to the trim floor
+  const bool trimmed = trim_limit_ > 0;
+  int32_t level = CUBEMAP_LEVELS;
+  std::map<const void*, LEVEL_REQUEST>::const_iterator it =
+      level_requests_.begin();
+  for (; it != level_requests_.end(); ++it) {
+    if (trimmed && it->second.optional) continue;
+    level = std::min(level, it->second.level);
+  }
+  if (level == CUBEMAP_LEVELS) level = 0;
+  return std::max(level, trim_limit_);
+}
+
+void CubemapTexture::UpdateResidency() {
+  const int32_t level = GetRequiredLevel();
+  if (level == level_limit_) {
+    evict_frames_ = 0;
+    return;
+  }
+
+  // Streaming finer levels, or stopping the stream short of them, costs
+  // nothing. Dropping resident levels reallocates, wait for the slider to
+  // settle.
+  if (level < level_limit_ || base_level_ >= level ||
+      ++evict_frames_ >= CUBEMAP_EVICT_DELAY) {
+    LOGI("Cubemap %s level requirement %d -> %d", file_name_.c_str(),
+         level_limit_, level);
+    evict_frames_ = 0;
+    ApplyLevelLimit(level);
+  }
+}
+
+void CubemapTexture::ApplyLevelLimit(const int32_t level) {
+  level_limit_ = std::min(std::max(level, 0), CUBEMAP_LEVELS - 1);
+  if (!tex_ || failed_) return;
+
+  if (base_level_ < level_limit_ || level_limit_ < first_level_) {
+    // Immutable storage can not grow or shrink, reallocate and stream the
+    // finer levels again
+    LOGI("Reallocating cubemap %s from level %d", file_name_.c_str(),
+         level_limit_);
+    LoadLevels(std::max(CUBEMAP_INITIAL_LEVEL, level_limit_));
+  } else {
+    streaming_ = base_level_ > level_limit_;
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Refine by one batch of faces per call.
+// Faces for the budget are decoded on the worker pool into an upload ring slot
+// and uploaded from it by the first call after they are done, then the next
+// batch is started. Without a free slot, faces are read and uploaded on the
+// GL thread until the budget is used up.
+// At least one face is uploaded per batch so that the chain always completes.
+// Returns true when a new level became resident.
+//--------------------------------------------------------------------------------
+bool CubemapTexture::Stream(const int32_t budget) {
+  if (!streaming_ && upload_slot_ < 0) return false;
+
+  GLStateCache::GetInstance()->BindTexture(target_, tex_);
+
+  bool updated = false;
+  if (upload_slot_ >= 0) {
+    // Keep rendering with the resident levels until the workers are done
+    if (!upload_batch_.IsDone()) return false;
+    updated = FinishUpload();
+  }
+  if (streaming_ && !BeginUpload(budget)) updated |= StreamDirect(budget);
+  return updated;
+}
+
+bool CubemapTexture::BeginUpload(const int32_t budget) {
+  const int32_t level = base_level_ - 1;
+  const int32_t size = GetLevelSize(level);
+  const int32_t bytes = size * size * 4;
+  if (bytes > UPLOAD_SLOT_SIZE) return false;
+
+  uint8_t* data = NULL;
+  const int32_t slot = UploadRing::GetInstance()->Map(&data);
+  if (slot < 0) return false;
+
+  upload_slot_ = slot;
+  upload_level_ = level;
+  upload_faces_ =
+      std::max(1, std::min(std::min(budget, UPLOAD_SLOT_SIZE) / bytes,
+                           GetFaces() - next_face_));
+  upload_results_.assign(upload_faces_, 0);
+
+  for (int32_t i = 0; i < upload_faces_; ++i) {
+    const int32_t face = next_face_ + i;
+    uint8_t* dst = data + i * bytes;
+    upload_batch_.Submit([this, level, face, dst, bytes, i]() {
+      CACHED_IMAGE image;
+      const uint8_t* pixels = ReadFace(level, face, &image, dst);
+      if (pixels != NULL) {
+        // Chains and cache hits are not decoded in place
+        if (pixels != dst) memcpy(dst, pixels, bytes);
+        upload_results_[i] = 1;
+      } else if (IsArray()) {
+        LOGI("Filling layer %d with black", face / GetLayerFaces());
+        memset(dst, 0, bytes);
+        upload_results_[i] = 1;
+      }
+      ImageCache::GetInstance()->Release(&image);
+    });
+  }
+  return true;
+}
+
+bool CubemapTexture::FinishUpload() {
+  UploadRing* ring = UploadRing::GetInstance();
+  const int32_t slot = upload_slot_;
+  upload_slot_ = -1;
+
+  // Lost contents are decoded again by the next batch
+  if (!ring->Unmap(slot)) return false;
+
+  const int32_t size = GetLevelSize(upload_level_);
+  const int32_t bytes = size * size * 4;
+  bool failed = false;
+  for (int32_t i = 0; i < upload_faces_; ++i) {
+    if (!upload_results_[i]) {
+      failed = true;
+      break;
+    }
+    UploadFace(upload_level_, next_face_ + i, BUFFER_OFFSET(i * bytes));
+  }
+  ring->Fence(slot);
+
+  if (failed) {
+    FailStreaming(upload_level_);
+    return false;
+  }
+
+  return AdvanceFaces(upload_level_, upload_faces_);
+}
+
+//--------------------------------------------------------------------------------
+// Returns true when the faces completed the level
+//--------------------------------------------------------------------------------
+bool CubemapTexture::AdvanceFaces(const int32_t level, const int32_t faces) {
+  next_face_ += faces;
+  if (next_face_ < GetFaces()) return false;
+
+  // Level complete, let the sampler see it
+  UpdateBaseLevel(level);
+  next_face_ = 0;
+  streaming_ = base_level_ > level_limit_;
+  if (!streaming_) chains_.clear();
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+// Upload finer levels on the GL thread until the budget is used up
+//--------------------------------------------------------------------------------
+bool CubemapTexture::StreamDirect(const int32_t budget) {
+  bool updated = false;
+  int32_t bytes = 0;
+  while (bytes < budget && streaming_) {
+    const int32_t level = base_level_ - 1;
+    const int32_t size = GetLevelSize(level);
+    if (!LoadFace(level, next_face_)) {
+      FailStreaming(level);
+      break;
+    }
+    bytes += size * size * 4;
+    if (AdvanceFaces(level, 1)) updated = true;
+  }
+  return updated;
+}
+
+void CubemapTexture::FailStreaming(const int32_t level) {
+  LOGI("Failed to stream cubemap %s level %d", file_name_.c_str(), level);
+  // Keep sampling the resident levels
+  failed_ = true;
+  streaming_ = false;
+  chains_.clear();
+}
+
+void CubemapTexture::CancelUpload() {
+  if (upload_slot_ < 0) return;
+
+  upload_batch_.Wait();
+  UploadRing::GetInstance()->Cancel(upload_slot_);
+  upload_slot_ = -1;
+}
+
+//--------------------------------------------------------------------------------
+// Storage allocated up front for the chain
+//--------------------------------------------------------------------------------
+int32_t CubemapTexture::GetResidentBytes() const {
+  if (!tex_) return 0;
+  return TexturePool::GetCubemapBytes(target_, GetLayers(),
+                                      CUBEMAP_LEVELS - first_level_,
+                                      GetLevelSize(first_level_));
+}
+
+void CubemapTexture::Unload() {
+  CancelUpload();
+  if (tex_) {
+    TexturePool::GetInstance()->ReleaseCubemap(
+        tex_, target_, GetLayers(), CUBEMAP_LEVELS - first_level_,
+        GetLevelSize(first_level_), format_);
+    tex_ = 0;
+  }
+  chains_.clear();
+  base_level_ = CUBEMAP_LEVELS;
+  next_face_ = 0;
+  streaming_ = false;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// CubemapTexture.h
+// Cubemap texture streamed from coarse to fine mip levels
+//--------------------------------------------------------------------------------
+#ifndef _CUBEMAPTEXTURE_H
+#define _CUBEMAPTEXTURE_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <map>
+#include <string>
+#include <vector>
+
+#include "NDKHelper.h"
+#include "TexturePool.h"
+#include "CubemapConverter.h"
+#include "ImageCache.h"
+#include "UploadRing.h"
+#include "WorkerPool.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+const int32_t CUBEMAP_FACES = 6;
+// Mip chain shipped for each stage, 128x128 - 1x1
+const int32_t CUBEMAP_SIZE = 128;
+const int32_t CUBEMAP_LEVELS = 8;
+const GLenum CUBEMAP_FORMAT = GL_RGBA8;
+// The same texels decoded to linear on sampling, before filtering
+const GLenum CUBEMAP_SRGB_FORMAT = GL_SRGB8_ALPHA8;
+
+// Filter for chains built from single image layers
+const MIP_FILTER CUBEMAP_MIP_FILTER = MIP_FILTER_KAISER;
+
+#ifndef GL_TEXTURE_CUBE_MAP_ARRAY_EXT
+#define GL_TEXTURE_CUBE_MAP_ARRAY_EXT 0x9009
+#endif
+enum ENVMAP_TYPE {
+  ENVMAP_CUBEMAP,
+  ENVMAP_CUBEMAP_ARRAY,
+  // GL_TEXTURE_2D, 2x the cubemap size per level
+  ENVMAP_OCTAHEDRAL,
+};
+
+// Levels uploaded synchronously on a stage switch, 16x16 - 1x1
+const int32_t CUBEMAP_INITIAL_LEVEL = 3;
+// Default per-frame upload budget in bytes, one 128x128 RGBA face
+const int32_t CUBEMAP_STREAMING_BUDGET = CUBEMAP_SIZE * CUBEMAP_SIZE * 4;
+// Frames a coarser level requirement has to hold before resident levels are
+// dropped, so that dragging the roughness slider does not reallocate each step
+const int32_t CUBEMAP_EVICT_DELAY = 30;
+
+// Finest level a user samples
+struct LEVEL_REQUEST {
+  int32_t level;
+  // Ignored while trimmed, e.g. the skybox background
+  bool optional;
+};
+
+/******************************************************************
+ * Cubemap texture loaded from a file pattern such as
+ * "cubemaps/stpeters_phong_m%02d_c%02d.bmp" (miplevel, face).
+ *
+ * Storage for the chain is allocated up front with glTexStorage2D from the
+ * pool and filled with glTexSubImage2D.
+ * Load() uploads the coarse levels only and the texture is usable right away
+ * with GL_TEXTURE_BASE_LEVEL clamped to the finest resident level.
+ * Stream() then refines toward mip 0, or toward the level set with
+ * SetLevelLimit(), within a per-call byte budget. Streamed faces are decoded
+ * on the worker pool straight into a slot of the UploadRing and uploaded from
+ * it on a later Stream() call, so the GL thread neither decodes nor copies.
+ * Shaders sampling with an explicit LOD need to subtract GetBaseLevel()
+ * since the LOD is relative to GL_TEXTURE_BASE_LEVEL.
+ *
+ * LoadArray() keeps several file patterns as layers of one
+ * GL_TEXTURE_CUBE_MAP_ARRAY_EXT, all layers stream in together.
+ * Faces missing in a layer are filled with black.
+ *
+ * A file name without a pattern, e.g. "cubemaps/stpeters_cross.bmp", is a
+ * single image converted by CubemapConverter. Its chain is built in memory up
+ * front and then streamed in like the other layers.
+ *
+ * LoadOctahedral() loads the same chain encoded as an octahedral map, e.g.
+ * "cubemaps/stpeters_oct_m%02d.bmp" (miplevel), written by
+ * tools/octahedral_converter.cpp. Each level is a single 2D image of twice the
+ * cubemap face size, sampled with OctahedralUV() in the shaders.
+ *
+ * Users report the finest level they sample with RequireLevel(). Only levels
+ * up to the finest requirement are kept resident, finer levels are streamed
+ * in right away when a requirement drops and evicted after
+ * CUBEMAP_EVICT_DELAY frames of UpdateResidency() when it rises.
+ * SetLevelLimit() puts a floor on top of that under memory pressure.
+ */
+class CubemapTexture {
+  GLuint tex_;
+  GLenum target_;
+  // One pattern per layer
+  std::vector<std::string> file_names_;
+  std::string file_name_;
+  // Decoded or mapped face, its buffer is reused
+  CACHED_IMAGE image_;
+  // Black fill scratch buffer
+  std::vector<uint8_t> pixels_;
+  // Chains of converted layers until they are uploaded
+  std::vector<CUBEMAP_CHAIN> chains_;
+
+  // Chain level stored in texture level 0
+  int32_t first_level_;
+  // Finest level where all faces are resident
+  int32_t base_level_;
+  // Finest level allowed to become resident
+  int32_t level_limit_;
+  // CUBEMAP_FORMAT or CUBEMAP_SRGB_FORMAT
+  GLenum format_;
+  // Floor set by SetLevelLimit()
+  int32_t trim_limit_;
+  std::map<const void*, LEVEL_REQUEST> level_requests_;
+  int32_t evict_frames_;
+  // Next layer-face to upload for base_level_ - 1
+  int32_t next_face_;
+  bool streaming_;
+  bool failed_;
+
+  // Faces being decoded into an upload ring slot, -1 when none
+  WorkerBatch upload_batch_;
+  int32_t upload_slot_;
+  int32_t upload_level_;
+  int32_t upload_faces_;
+  // Per face, written by the workers
+  std::vector<uint8_t> upload_results_;
+
+  const uint8_t* ReadFace(const int32_t level, const int32_t face,
+                          CACHED_IMAGE* image, uint8_t* dst) const;
+  void UploadFace(const int32_t level, const int32_t face, const void* data);
+  bool LoadFace(const int32_t level, const int32_t face);
+  bool BeginUpload(const int32_t budget);
+  bool FinishUpload();
+  bool AdvanceFaces(const int32_t level, const int32_t faces);
+  bool StreamDirect(const int32_t budget);
+  void FailStreaming(const int32_t level);
+  bool LoadLevels(const int32_t upload_level);
+  void ApplyLevelLimit(const int32_t level);
+  bool IsConverted(const int32_t layer) const;
+  bool ConvertLayers();
+  void UpdateBaseLevel(const int32_t level);
+  int32_t GetLayers() const { return static_cast<int32_t>(file_names_.size()); }
+  int32_t GetLayerFaces() const {
+    return target_ == GL_TEXTURE_2D ? 1 : CUBEMAP_FACES;
+  }
+  int32_t GetFaces() const { return GetLayerFaces() * GetLayers(); }
+  int32_t GetLevelSize(const int32_t level) const;
+
+ public:
+  CubemapTexture();
+  virtual ~CubemapTexture();
+
+  static bool IsArraySupported();
+  // #version line for shaders sampling a samplerCubeArray
+  static const char* GetArrayShaderHeader();
+  // Program variant name and CompileShader() replacements sampling the type
+  static const char* GetShaderVariant(const ENVMAP_TYPE type);
+  static void GetShaderParams(const ENVMAP_TYPE type,
+                              std::map<std::string, std::string>* params);
+
+  bool Load(const char* file_name);
+  bool LoadArray(const std::vector<std::string>& file_names);
+  bool LoadOctahedral(const char* file_name);
+  bool Stream(const int32_t budget = CUBEMAP_STREAMING_BUDGET);
+  void Unload();
+  // Drop the faces in flight, e.g. before the texture is destroyed
+  void CancelUpload();
+  void SetLevelLimit(const int32_t level);
+  // Internal format of the storage, takes effect on the next load
+  void SetFormat(const GLenum format) { format_ = format; }
+  GLenum GetFormat() const { return format_; }
+
+  void RequireLevel(const void* user, const int32_t level,
+                    const bool optional = false);
+  void ReleaseLevel(const void* user);
+  int32_t GetRequiredLevel() const;
+  // Apply level requirement changes, called once per frame
+  void UpdateResidency();
+
+  bool IsComplete() const { return base_level_ == 0; }
+  bool IsStreaming() const { return streaming_ || upload_slot_ >= 0; }
+  bool IsArray() const { return target_ == GL_TEXTURE_CUBE_MAP_ARRAY_EXT; }
+  ENVMAP_TYPE GetType() const;
+  GLuint GetTexture() const { return tex_; }
+  GLenum GetTarget() const { return target_; }
+  int32_t GetBaseLevel() const { return base_level_; }
+  int32_t GetResidentBytes() const;
+  const char* GetFileName() const { return file_name_.c_str(); }
+};
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// DynamicRing.cpp
+// Fenced ring buffer for data written every frame
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+
+#include "DynamicRing.h"
+#include "GLStateCache.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+DynamicRing::DynamicRing()
+    : buffer_(0),
+      frame_size_(DYNAMIC_RING_FRAME_SIZE),
+      frame_(0),
+      used_(0),
+      required_(0),
+      mapped_(NULL),
+      mapped_offset_(0),
+      synchronized_(false),
+      stall_time_(0.0),
+      last_stall_time_(0.0),
+      last_used_(0),
+      stalls_(0) {
+  for (int32_t i = 0; i < DYNAMIC_RING_FRAMES; ++i) fences_[i] = 0;
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+DynamicRing::~DynamicRing() {}
+
+//--------------------------------------------------------------------------------
+// Created on first use. Not tracked by the GLStateCache, binding it to
+// GL_COPY_WRITE_BUFFER leaves the vertex arrays and uniform bindings alone.
+//--------------------------------------------------------------------------------
+void DynamicRing::Init(const GLsizeiptr frame_size) {
+  frame_size_ = frame_size;
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+  glBufferData(GL_COPY_WRITE_BUFFER, frame_size_ * DYNAMIC_RING_FRAMES, NULL,
+               GL_STREAM_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  LOGI("Dynamic ring %d KB per frame", static_cast<int32_t>(frame_size_ / 1024));
+}
+
+void DynamicRing::Release() {
+  Flush();
+  for (int32_t i = 0; i < DYNAMIC_RING_FRAMES; ++i) {
+    if (fences_[i]) glDeleteSync(fences_[i]);
+    fences_[i] = 0;
+  }
+  if (buffer_) GLStateCache::GetInstance()->DeleteBuffer(buffer_);
+  buffer_ = 0;
+  used_ = 0;
+}
+
+void DynamicRing::BeginFrame() {
+  Flush();
+  stall_time_ = 0.0;
+  used_ = 0;
+  synchronized_ = false;
+
+  if (required_ > frame_size_) {
+    // Grow to fit the largest frame, the GPU is done with all regions after
+    // the fences have been waited on
+    GLsizeiptr frame_size = frame_size_;
+    while (frame_size < required_) frame_size *= 2;
+    for (int32_t i = 0; i < DYNAMIC_RING_FRAMES; ++i) {
+      if (fences_[i])
+        glClientWaitSync(fences_[i], GL_SYNC_FLUSH_COMMANDS_BIT,
+                         DYNAMIC_RING_FENCE_TIMEOUT);
+    }
+    Release();
+    required_ = 0;
+    Init(frame_size);
+    return;
+  }
+  if (buffer_ == 0) Init(frame_size_);
+
+  frame_ = (frame_ + 1) % DYNAMIC_RING_FRAMES;
+  GLsync& fence = fences_[frame_];
+  if (fence == 0) return;
+
+  // Two frames ago, normally signaled already
+  if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+    const double start = ndk_helper::PerfMonitor::GetCurrentTime();
+    const GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                           DYNAMIC_RING_FENCE_TIMEOUT);
+    stall_time_ = ndk_helper::PerfMonitor::GetCurrentTime() - start;
+    stalls_++;
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+      // The GPU may still read the region, let the driver synchronize
+      LOGI("Dynamic ring fence wait timed out, mapping synchronized");
+      synchronized_ = true;
+    }
+  }
+  glDeleteSync(fence);
+  fence = 0;
+}
+
+//--------------------------------------------------------------------------------
+// Maps the unused rest of the region
+//--------------------------------------------------------------------------------
+bool DynamicRing::Map() {
+  mapped_offset_ = frame_ * frame_size_ + used_;
+  GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                      GL_MAP_FLUSH_EXPLICIT_BIT;
+  if (!synchronized_) access |= GL_MAP_UNSYNCHRONIZED_BIT;
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+  void* p = glMapBufferRange(GL_COPY_WRITE_BUFFER, mapped_offset_,
+                             frame_size_ - used_, access);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  if (p == NULL) {
+    LOGI("Failed to map the dynamic ring");
+    return false;
+  }
+  mapped_ = static_cast<uint8_t*>(p);
+  return true;
+}
+
+bool DynamicRing::Allocate(const GLsizeiptr size, const GLsizeiptr alignment,
+                           DYNAMIC_ALLOCATION* allocation) {
+  if (buffer_ == 0) Init(frame_size_);
+
+  const GLsizeiptr offset = (used_ + alignment - 1) & ~(alignment - 1);
+  if (offset + size > frame_size_) {
+    required_ = std::max(required_, offset + size);
+    return false;
+  }
+  if (mapped_ == NULL && !Map()) return false;
+
+  used_ = offset + size;
+  allocation->buffer = buffer_;
+  allocation->offset = frame_ * frame_size_ + offset;
+  allocation->data = mapped_ + (allocation->offset - mapped_offset_);
+  return true;
+}
+
+void DynamicRing::Flush() {
+  if (mapped_ == NULL) return;
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+  const GLintptr written = frame_ * frame_size_ + used_ - mapped_offset_;
+  if (written > 0)
+    glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, 0, written);
+  if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE)
+    LOGI("Dynamic ring was corrupted");
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  mapped_ = NULL;
+}
+
+void DynamicRing::EndFrame() {
+  Flush();
+  if (buffer_ && used_)
+    fences_[frame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  last_stall_time_ = stall_time_;
+  last_used_ = used_;
+}
+
+void DynamicRing::DumpStatistics() const {
+  LOGI("Dynamic ring fence stalls:%d last frame:%d bytes", stalls_,
+       static_cast<int32_t>(last_used_));
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// DynamicRing.h
+// Fenced ring buffer for data written every frame
+//--------------------------------------------------------------------------------
+#ifndef _DYNAMICRING_H
+#define _DYNAMICRING_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// One frame being written, up to two in flight
+const int32_t DYNAMIC_RING_FRAMES = 3;
+// Per frame, fits the object uniforms of the benchmark stress grid
+const GLsizeiptr DYNAMIC_RING_FRAME_SIZE = 1024 * 1024;
+// Upper bound of a fence wait in ns
+const GLuint64 DYNAMIC_RING_FENCE_TIMEOUT = 100000000;
+
+struct DYNAMIC_ALLOCATION {
+  GLuint buffer;
+  GLintptr offset;
+  // Write only, valid until Flush()
+  uint8_t* data;
+};
+
+/******************************************************************
+ * Rewriting the same buffer every frame makes a tiler either wait for the
+ * frames still reading it or copy it. The ring is one buffer object split
+ * into a region per frame in flight, each fenced when its frame is
+ * submitted. BeginFrame() waits for the fence of the region it reuses, so
+ * the region is mapped with GL_MAP_UNSYNCHRONIZED_BIT and the driver never
+ * synchronizes. Should the wait time out, the region of that frame is mapped
+ * synchronized instead.
+ *
+ * Allocate() hands out aligned ranges of the frame's region for uniform
+ * blocks or vertices, bind them with the returned buffer and offset. Flush()
+ * unmaps before the draws that read them, allocating again maps the rest of
+ * the region. A frame that does not fit fails the allocation, the regions
+ * grow on the next BeginFrame().
+ *
+ * Fence stall time and bytes allocated are latched per frame.
+ *
+ * Thread safety: GL thread only.
+ */
+class DynamicRing {
+  GLuint buffer_;
+  GLsizeiptr frame_size_;
+  GLsync fences_[DYNAMIC_RING_FRAMES];
+  int32_t frame_;
+  // Bytes allocated in the region of the current frame
+  GLsizeiptr used_;
+  // Largest frame that did not fit
+  GLsizeiptr required_;
+  // Mapped part of the region, NULL when unmapped
+  uint8_t* mapped_;
+  GLintptr mapped_offset_;
+  // The fence of the region timed out, the driver synchronizes its mapping
+  bool synchronized_;
+
+  double stall_time_;
+  double last_stall_time_;
+  GLsizeiptr last_used_;
+  int32_t stalls_;
+
+  DynamicRing(DynamicRing const&);
+  void operator=(DynamicRing const&);
+  DynamicRing();
+  virtual ~DynamicRing();
+
+  void Init(const GLsizeiptr frame_size);
+  bool Map();
+
+ public:
+  static DynamicRing* GetInstance() {
+    //Singleton, never destroyed like the texture pool
+    static DynamicRing* instance = new DynamicRing();
+
+    return instance;
+  }
+
+  // Delete the buffer, e.g. before the context is lost
+  void Release();
+
+  // Waits until the GPU is done with the region of the frame
+  void BeginFrame();
+  // alignment is a power of two, false when the frame is full
+  bool Allocate(const GLsizeiptr size, const GLsizeiptr alignment,
+                DYNAMIC_ALLOCATION* allocation);
+  // Makes the allocations visible to GL
+  void Flush();
+  // Fences the region after the last draw of the frame
+  void EndFrame();
+
+  // Of the last complete frame
+  int32_t GetStallMicroseconds() const {
+    return static_cast<int32_t>(last_stall_time_ * 1000000.0);
+  }
+  int32_t GetBytes() const { return static_cast<int32_t>(last_used_); }
+  void DumpStatistics() const;
+};
+
+#endif
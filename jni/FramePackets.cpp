@@ -0,0 +1,80 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// FramePackets.cpp
+// Frame state handed from the simulation thread to the GL thread
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "FramePackets.h"
+
+// Set in shared_ while the packet was not acquired
+static const int32_t FRESH = 0x4;
+static const int32_t INDEX_MASK = 0x3;
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+FramePackets::FramePackets()
+    : shared_(1), back_(0), front_(2), cancelled_(false) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+FramePackets::~FramePackets() {}
+
+void FramePackets::Reset(const FRAME_PACKET& packet) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int32_t i = 0; i < FRAME_PACKET_COUNT; ++i) packets_[i] = packet;
+  shared_.store(shared_.load() & INDEX_MASK);
+  cancelled_ = false;
+}
+
+//--------------------------------------------------------------------------------
+// Simulation thread
+//--------------------------------------------------------------------------------
+void FramePackets::Publish() {
+  back_ = shared_.exchange(back_ | FRESH, std::memory_order_acq_rel) &
+          INDEX_MASK;
+}
+
+bool FramePackets::WaitConsumed() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock,
+             [this]() { return cancelled_ || !(shared_.load() & FRESH); });
+  return !cancelled_;
+}
+
+void FramePackets::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cancelled_ = true;
+  cond_.notify_all();
+}
+
+//--------------------------------------------------------------------------------
+// GL thread
+//--------------------------------------------------------------------------------
+const FRAME_PACKET& FramePackets::Acquire() {
+  if (shared_.load(std::memory_order_acquire) & FRESH) {
+    front_ = shared_.exchange(front_, std::memory_order_acq_rel) & INDEX_MASK;
+    // Under the lock, the simulation thread may be about to wait
+    std::lock_guard<std::mutex> lock(mutex_);
+    cond_.notify_one();
+  }
+  return packets_[front_];
+}
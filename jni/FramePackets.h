@@ -0,0 +1,96 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// FramePackets.h
+// Frame state handed from the simulation thread to the GL thread
+//--------------------------------------------------------------------------------
+#ifndef _FRAMEPACKETS_H
+#define _FRAMEPACKETS_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// One packet for each thread and one in between
+const int32_t FRAME_PACKET_COUNT = 3;
+
+// Everything the GL thread needs from the simulation, read only once published
+struct FRAME_PACKET {
+  double time;
+  // TapCamera matrices
+  ndk_helper::Mat4 camera_transform;
+  ndk_helper::Mat4 camera_rotation;
+  float roughness;
+  int32_t material;
+  int32_t stage;
+  // Incremented for each benchmark request
+  int32_t benchmark_requests;
+};
+
+/******************************************************************
+ * Triple buffer of FRAME_PACKET. The simulation thread writes the back
+ * packet and swaps it with the shared one, the GL thread swaps its front
+ * packet with the shared one when a newer packet was published. The swaps are
+ * atomic exchanges, neither thread waits for the other to hand over a packet.
+ *
+ * The simulation is paced by the GL thread, WaitConsumed() sleeps until the
+ * last published packet was taken so that it runs one frame ahead.
+ *
+ * Thread safety: GetBack(), Publish(), WaitConsumed() from the simulation
+ * thread, Acquire() from the GL thread.
+ */
+class FramePackets {
+  FRAME_PACKET packets_[FRAME_PACKET_COUNT];
+  // Index of the shared packet, FRESH set until it is acquired
+  std::atomic<int32_t> shared_;
+  int32_t back_;
+  int32_t front_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool cancelled_;
+
+  FramePackets(FramePackets const&);
+  void operator=(FramePackets const&);
+
+ public:
+  FramePackets();
+  virtual ~FramePackets();
+
+  // Fills all packets, e.g. with the initial state
+  void Reset(const FRAME_PACKET& packet);
+
+  FRAME_PACKET* GetBack() { return &packets_[back_]; }
+  void Publish();
+  // False when cancelled
+  bool WaitConsumed();
+  // Wakes the simulation thread, WaitConsumed() fails until Reset()
+  void Cancel();
+
+  // Latest published packet, the previous one again when none is newer
+  const FRAME_PACKET& Acquire();
+};
+
+#endif
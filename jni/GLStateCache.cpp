@@ -0,0 +1,235 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// GLStateCache.cpp
+// Shadow copy of the GL binding and fixed function state
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "GLStateCache.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+GLStateCache::GLStateCache()
+    : issued_(0), filtered_(0), last_issued_(0), last_filtered_(0) {
+  Invalidate();
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+GLStateCache::~GLStateCache() {}
+
+void GLStateCache::Invalidate() {
+  program_ = GL_STATE_UNKNOWN;
+  vertex_array_ = GL_STATE_UNKNOWN;
+  array_buffer_ = GL_STATE_UNKNOWN;
+  pixel_unpack_buffer_ = GL_STATE_UNKNOWN;
+  uniform_buffer_ = GL_STATE_UNKNOWN;
+  for (int32_t i = 0; i < GL_STATE_UNIFORM_BINDINGS; ++i)
+    uniform_ranges_[i].buffer = GL_STATE_UNKNOWN;
+  active_texture_ = GL_STATE_UNKNOWN;
+  for (int32_t i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+    for (int32_t j = 0; j < GL_STATE_TEXTURE_TARGETS; ++j)
+      textures_[i][j] = GL_STATE_UNKNOWN;
+  for (int32_t i = 0; i < GL_STATE_CAPABILITIES; ++i)
+    capabilities_[i] = GL_STATE_UNKNOWN;
+  depth_func_ = GL_STATE_UNKNOWN;
+  depth_mask_ = GL_STATE_UNKNOWN;
+  cull_face_ = GL_STATE_UNKNOWN;
+  front_face_ = GL_STATE_UNKNOWN;
+}
+
+//--------------------------------------------------------------------------------
+// Untracked state, a NULL shadow, is always issued
+//--------------------------------------------------------------------------------
+bool GLStateCache::Update(GLuint* shadow, const GLuint value) {
+  if (shadow != NULL) {
+    if (*shadow == value) {
+      filtered_++;
+      return false;
+    }
+    *shadow = value;
+  }
+  issued_++;
+  return true;
+}
+
+GLuint* GLStateCache::GetBufferBinding(const GLenum target) {
+  switch (target) {
+    case GL_ARRAY_BUFFER:
+      return &array_buffer_;
+    case GL_PIXEL_UNPACK_BUFFER:
+      return &pixel_unpack_buffer_;
+    case GL_UNIFORM_BUFFER:
+      return &uniform_buffer_;
+    default:
+      return NULL;
+  }
+}
+
+GLuint* GLStateCache::GetTextureBinding(const GLenum target) {
+  if (active_texture_ >= GL_STATE_TEXTURE_UNITS) return NULL;
+  GLuint* unit = textures_[active_texture_];
+  switch (target) {
+    case GL_TEXTURE_2D:
+      return &unit[GL_STATE_TEXTURE_2D];
+    case GL_TEXTURE_CUBE_MAP:
+      return &unit[GL_STATE_TEXTURE_CUBE_MAP];
+    case GL_TEXTURE_2D_ARRAY:
+      return &unit[GL_STATE_TEXTURE_2D_ARRAY];
+    case GL_TEXTURE_CUBE_MAP_ARRAY_EXT:
+      return &unit[GL_STATE_TEXTURE_CUBE_MAP_ARRAY];
+    default:
+      return NULL;
+  }
+}
+
+GLuint* GLStateCache::GetCapability(const GLenum cap) {
+  switch (cap) {
+    case GL_CULL_FACE:
+      return &capabilities_[GL_STATE_CULL_FACE];
+    case GL_DEPTH_TEST:
+      return &capabilities_[GL_STATE_DEPTH_TEST];
+    case GL_BLEND:
+      return &capabilities_[GL_STATE_BLEND];
+    case GL_SCISSOR_TEST:
+      return &capabilities_[GL_STATE_SCISSOR_TEST];
+    default:
+      return NULL;
+  }
+}
+
+//--------------------------------------------------------------------------------
+// State changes
+//--------------------------------------------------------------------------------
+void GLStateCache::UseProgram(const GLuint program) {
+  if (Update(&program_, program)) glUseProgram(program);
+}
+
+void GLStateCache::BindVertexArray(const GLuint vertex_array) {
+  if (Update(&vertex_array_, vertex_array)) glBindVertexArray(vertex_array);
+}
+
+void GLStateCache::BindBuffer(const GLenum target, const GLuint buffer) {
+  if (Update(GetBufferBinding(target), buffer)) glBindBuffer(target, buffer);
+}
+
+void GLStateCache::BindBufferRange(const GLenum target, const GLuint index,
+                                   const GLuint buffer, const GLintptr offset,
+                                   const GLsizeiptr size) {
+  if (target == GL_UNIFORM_BUFFER && index < GL_STATE_UNIFORM_BINDINGS) {
+    GL_STATE_BUFFER_RANGE& range = uniform_ranges_[index];
+    if (range.buffer == buffer && range.offset == offset &&
+        range.size == size) {
+      filtered_++;
+      return;
+    }
+    range.buffer = buffer;
+    range.offset = offset;
+    range.size = size;
+    // The generic binding point changes as well
+    uniform_buffer_ = buffer;
+  }
+  issued_++;
+  if (size == 0)
+    glBindBufferBase(target, index, buffer);
+  else
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLStateCache::BindBufferBase(const GLenum target, const GLuint index,
+                                  const GLuint buffer) {
+  BindBufferRange(target, index, buffer, 0, 0);
+}
+
+void GLStateCache::ActiveTexture(const GLenum unit) {
+  if (Update(&active_texture_, unit - GL_TEXTURE0)) glActiveTexture(unit);
+}
+
+void GLStateCache::BindTexture(const GLenum target, const GLuint texture) {
+  if (Update(GetTextureBinding(target), texture))
+    glBindTexture(target, texture);
+}
+
+void GLStateCache::Enable(const GLenum cap) {
+  if (Update(GetCapability(cap), GL_TRUE)) glEnable(cap);
+}
+
+void GLStateCache::Disable(const GLenum cap) {
+  if (Update(GetCapability(cap), GL_FALSE)) glDisable(cap);
+}
+
+void GLStateCache::DepthFunc(const GLenum func) {
+  if (Update(&depth_func_, func)) glDepthFunc(func);
+}
+
+void GLStateCache::DepthMask(const GLboolean mask) {
+  if (Update(&depth_mask_, mask)) glDepthMask(mask);
+}
+
+void GLStateCache::CullFace(const GLenum mode) {
+  if (Update(&cull_face_, mode)) glCullFace(mode);
+}
+
+void GLStateCache::FrontFace(const GLenum mode) {
+  if (Update(&front_face_, mode)) glFrontFace(mode);
+}
+
+//--------------------------------------------------------------------------------
+// Deletion, GL reverts the bindings of the object to 0
+//--------------------------------------------------------------------------------
+void GLStateCache::DeleteProgram(const GLuint program) {
+  // A program in use stays until it is replaced, forget it instead
+  if (program_ == program) program_ = GL_STATE_UNKNOWN;
+  glDeleteProgram(program);
+}
+
+void GLStateCache::DeleteVertexArray(const GLuint vertex_array) {
+  if (vertex_array_ == vertex_array) vertex_array_ = 0;
+  glDeleteVertexArrays(1, &vertex_array);
+}
+
+void GLStateCache::DeleteBuffer(const GLuint buffer) {
+  if (array_buffer_ == buffer) array_buffer_ = 0;
+  if (pixel_unpack_buffer_ == buffer) pixel_unpack_buffer_ = 0;
+  if (uniform_buffer_ == buffer) uniform_buffer_ = 0;
+  for (int32_t i = 0; i < GL_STATE_UNIFORM_BINDINGS; ++i)
+    if (uniform_ranges_[i].buffer == buffer)
+      uniform_ranges_[i].buffer = GL_STATE_UNKNOWN;
+  glDeleteBuffers(1, &buffer);
+}
+
+void GLStateCache::DeleteTexture(const GLuint texture) {
+  for (int32_t i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+    for (int32_t j = 0; j < GL_STATE_TEXTURE_TARGETS; ++j)
+      if (textures_[i][j] == texture) textures_[i][j] = 0;
+  glDeleteTextures(1, &texture);
+}
+
+void GLStateCache::EndFrame() {
+  last_issued_ = issued_;
+  last_filtered_ = filtered_;
+  issued_ = 0;
+  filtered_ = 0;
+}
+
+void GLStateCache::DumpStatistics() const {
+  LOGI("GL state calls issued:%d filtered:%d", last_issued_, last_filtered_);
+}
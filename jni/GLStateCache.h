@@ -0,0 +1,154 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// GLStateCache.h
+// Shadow copy of the GL binding and fixed function state
+//--------------------------------------------------------------------------------
+#ifndef _GLSTATECACHE_H
+#define _GLSTATECACHE_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "NDKHelper.h"
+
+#ifndef GL_TEXTURE_CUBE_MAP_ARRAY_EXT
+#define GL_TEXTURE_CUBE_MAP_ARRAY_EXT 0x9009
+#endif
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Texture units tracked, binds to higher units are always issued
+const int32_t GL_STATE_TEXTURE_UNITS = 4;
+// Indexed GL_UNIFORM_BUFFER bindings tracked
+const int32_t GL_STATE_UNIFORM_BINDINGS = 4;
+// Shadow value of state not known since the last Invalidate()
+const GLuint GL_STATE_UNKNOWN = 0xffffffff;
+
+enum GL_STATE_TEXTURE_TARGET {
+  GL_STATE_TEXTURE_2D,
+  GL_STATE_TEXTURE_CUBE_MAP,
+  GL_STATE_TEXTURE_2D_ARRAY,
+  GL_STATE_TEXTURE_CUBE_MAP_ARRAY,
+  GL_STATE_TEXTURE_TARGETS,
+};
+
+enum GL_STATE_CAPABILITY {
+  GL_STATE_CULL_FACE,
+  GL_STATE_DEPTH_TEST,
+  GL_STATE_BLEND,
+  GL_STATE_SCISSOR_TEST,
+  GL_STATE_CAPABILITIES,
+};
+
+// Buffer range of an indexed binding, size 0 for the whole buffer
+struct GL_STATE_BUFFER_RANGE {
+  GLuint buffer;
+  GLintptr offset;
+  GLsizeiptr size;
+};
+
+/******************************************************************
+ * State changes routed through the cache are only passed to GL when they
+ * change the shadow copy, the rest are filtered. Issued and filtered calls
+ * are counted per frame.
+ *
+ * GL unbinds deleted objects, so objects bound through the cache are deleted
+ * through it as well, otherwise a recycled name would be taken for bound.
+ * Invalidate() forgets everything, e.g. on a new context.
+ *
+ * GL_ELEMENT_ARRAY_BUFFER is part of the vertex array object and always
+ * issued. Bind vertex array 0 first when an index buffer is bound for an
+ * upload, so that no VAO picks it up.
+ *
+ * Thread safety: GL thread only.
+ */
+class GLStateCache {
+  GLuint program_;
+  GLuint vertex_array_;
+  GLuint array_buffer_;
+  GLuint pixel_unpack_buffer_;
+  GLuint uniform_buffer_;
+  GL_STATE_BUFFER_RANGE uniform_ranges_[GL_STATE_UNIFORM_BINDINGS];
+  GLuint active_texture_;
+  GLuint textures_[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS];
+  GLuint capabilities_[GL_STATE_CAPABILITIES];
+  GLuint depth_func_;
+  GLuint depth_mask_;
+  GLuint cull_face_;
+  GLuint front_face_;
+
+  int32_t issued_;
+  int32_t filtered_;
+  int32_t last_issued_;
+  int32_t last_filtered_;
+
+  GLStateCache(GLStateCache const&);
+  void operator=(GLStateCache const&);
+  GLStateCache();
+  virtual ~GLStateCache();
+
+  // Updates the shadow value, false when the call can be filtered
+  bool Update(GLuint* shadow, const GLuint value);
+  // Shadow values, NULL for untracked state
+  GLuint* GetBufferBinding(const GLenum target);
+  GLuint* GetTextureBinding(const GLenum target);
+  GLuint* GetCapability(const GLenum cap);
+
+ public:
+  static GLStateCache* GetInstance() {
+    //Singleton, never destroyed like the texture pool
+    static GLStateCache* instance = new GLStateCache();
+
+    return instance;
+  }
+
+  void Invalidate();
+
+  void UseProgram(const GLuint program);
+  void BindVertexArray(const GLuint vertex_array);
+  void BindBuffer(const GLenum target, const GLuint buffer);
+  // GL_UNIFORM_BUFFER, other targets are always issued
+  void BindBufferRange(const GLenum target, const GLuint index,
+                       const GLuint buffer, const GLintptr offset,
+                       const GLsizeiptr size);
+  void BindBufferBase(const GLenum target, const GLuint index,
+                      const GLuint buffer);
+  void ActiveTexture(const GLenum unit);
+  void BindTexture(const GLenum target, const GLuint texture);
+  void Enable(const GLenum cap);
+  void Disable(const GLenum cap);
+  void DepthFunc(const GLenum func);
+  void DepthMask(const GLboolean mask);
+  void CullFace(const GLenum mode);
+  void FrontFace(const GLenum mode);
+
+  void DeleteProgram(const GLuint program);
+  void DeleteVertexArray(const GLuint vertex_array);
+  void DeleteBuffer(const GLuint buffer);
+  void DeleteTexture(const GLuint texture);
+
+  // Latch the counts of the frame, called after the last draw
+  void EndFrame();
+  // Counts of the last complete frame
+  int32_t GetIssuedCalls() const { return last_issued_; }
+  int32_t GetFilteredCalls() const { return last_filtered_; }
+  void DumpStatistics() const;
+};
+
+#endif
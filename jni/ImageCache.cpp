@@ -0,0 +1,252 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ImageCache.cpp
+// Persistent cache of decoded images in the application cache directory
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include "ImageCache.h"
+#include "ResourceRegistry.h"
+#include "WorkerPool.h"
+
+//--------------------------------------------------------------------------------
+// File layout: header, source path, padding to 16 bytes, RGBA8 pixels
+//--------------------------------------------------------------------------------
+const uint32_t IMAGE_CACHE_MAGIC = 0x43495054;  // "TPIC"
+
+struct IMAGE_CACHE_HEADER {
+  uint32_t magic;
+  uint32_t version;
+  int64_t mtime;
+  int64_t size;
+  int32_t width;
+  int32_t height;
+  uint32_t path_length;
+  uint32_t data_offset;
+};
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+ImageCache::ImageCache()
+    : hits_(0), misses_(0), writes_(0), pending_stores_(0) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+ImageCache::~ImageCache() {}
+
+void ImageCache::SetDirectory(const std::string& directory) {
+  directory_ = directory;
+  if (directory_.empty()) return;
+
+  if (mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST) {
+    LOGI("Image cache disabled, can not create %s", directory_.c_str());
+    directory_.clear();
+  }
+}
+
+std::string ImageCache::GetEntryPath(const char* file_name) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.img",
+           static_cast<unsigned long long>(
+               ResourceRegistry::Hash(file_name, strlen(file_name))));
+  return directory_ + name;
+}
+
+//--------------------------------------------------------------------------------
+// Cache hit, pixels point into the mapping
+//--------------------------------------------------------------------------------
+bool ImageCache::Map(const char* file_name, const int64_t mtime,
+                     const int64_t size, CACHED_IMAGE* image) {
+  const std::string path = GetEntryPath(file_name);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      st.st_size >= static_cast<off_t>(sizeof(IMAGE_CACHE_HEADER)))
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid without the descriptor
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  const IMAGE_CACHE_HEADER* header =
+      static_cast<const IMAGE_CACHE_HEADER*>(map);
+  const char* entry_name = static_cast<const char*>(map) + sizeof(*header);
+  const size_t file_size = st.st_size;
+  bool valid = header->magic == IMAGE_CACHE_MAGIC &&
+               header->version == IMAGE_CACHE_VERSION &&
+               header->mtime == mtime && header->size == size &&
+               header->path_length == strlen(file_name) &&
+               sizeof(*header) + header->path_length <= file_size &&
+               memcmp(entry_name, file_name, header->path_length) == 0;
+  valid = valid && header->data_offset +
+                           static_cast<size_t>(header->width) *
+                               header->height * 4 <= file_size;
+  if (!valid) {
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  image->width = header->width;
+  image->height = header->height;
+  image->pixels = static_cast<const uint8_t*>(map) + header->data_offset;
+  image->map = map;
+  image->map_size = st.st_size;
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+// Written on the worker pool, renamed into place once complete
+//--------------------------------------------------------------------------------
+void ImageCache::Store(const char* file_name, const int64_t mtime,
+                       const int64_t size, const CACHED_IMAGE& image) {
+  static std::atomic<int32_t> temp_counter(0);
+
+  IMAGE_CACHE_HEADER header;
+  header.magic = IMAGE_CACHE_MAGIC;
+  header.version = IMAGE_CACHE_VERSION;
+  header.mtime = mtime;
+  header.size = size;
+  header.width = image.width;
+  header.height = image.height;
+  header.path_length = strlen(file_name);
+  header.data_offset = (sizeof(header) + header.path_length + 15) & ~15;
+
+  // Built once and shared with the task, the closure and its std::function
+  // copies only copy the pointer
+  std::shared_ptr<std::vector<uint8_t> > data =
+      std::make_shared<std::vector<uint8_t> >(header.data_offset);
+  memcpy(&(*data)[0], &header, sizeof(header));
+  memcpy(&(*data)[sizeof(header)], file_name, header.path_length);
+  data->insert(data->end(), image.pixels,
+               image.pixels + image.width * image.height * 4);
+
+  const std::string path = GetEntryPath(file_name);
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".tmp%d", temp_counter++);
+  const std::string temp_path = path + suffix;
+  {
+    std::lock_guard<std::mutex> lock(store_mutex_);
+    pending_stores_++;
+  }
+  WorkerPool::GetInstance()->Submit([this, path, temp_path, data]() {
+    FILE* fp = fopen(temp_path.c_str(), "wb");
+    if (fp != NULL) {
+      const bool written =
+          fwrite(&(*data)[0], 1, data->size(), fp) == data->size();
+      if (fclose(fp) == 0 && written &&
+          rename(temp_path.c_str(), path.c_str()) == 0) {
+        writes_++;
+      } else {
+        unlink(temp_path.c_str());
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(store_mutex_);
+    if (--pending_stores_ == 0) store_cond_.notify_all();
+  });
+}
+
+bool ImageCache::Load(const char* file_name, CACHED_IMAGE* image,
+                      uint8_t* dst, const size_t dst_size) {
+  image->pixels = NULL;
+  image->map = NULL;
+  image->map_size = 0;
+
+  int64_t mtime = 0;
+  int64_t size = 0;
+  const bool cached =
+      !directory_.empty() &&
+      ndk_helper::JNIHelper::GetInstance()->GetFileStamp(file_name, &mtime,
+                                                         &size);
+  if (cached && Map(file_name, mtime, size, image)) {
+    hits_++;
+    return true;
+  }
+
+  ndk_helper::JNIHelper* helper = ndk_helper::JNIHelper::GetInstance();
+  if (dst != NULL) {
+    if (!helper->DecodeImage(file_name, dst, dst_size, &image->width,
+                             &image->height))
+      return false;
+    image->pixels = dst;
+  } else {
+    if (!helper->DecodeImage(file_name, &image->buffer, &image->width,
+                             &image->height))
+      return false;
+    image->pixels = &image->buffer[0];
+  }
+
+  if (cached) {
+    misses_++;
+    Store(file_name, mtime, size, *image);
+  }
+  return true;
+}
+
+void ImageCache::Release(CACHED_IMAGE* image) {
+  if (image->map) {
+    munmap(image->map, image->map_size);
+    image->map = NULL;
+    image->map_size = 0;
+  }
+  image->pixels = NULL;
+}
+
+void ImageCache::Clear() {
+  if (directory_.empty()) return;
+
+  // Drain the queued writes so that none is renamed into place afterwards
+  std::unique_lock<std::mutex> lock(store_mutex_);
+  store_cond_.wait(lock, [this]() { return pending_stores_ == 0; });
+
+  DIR* dir = opendir(directory_.c_str());
+  if (dir == NULL) return;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') continue;
+    unlink((directory_ + "/" + entry->d_name).c_str());
+  }
+  closedir(dir);
+}
+
+void ImageCache::ResetStatistics() {
+  hits_ = 0;
+  misses_ = 0;
+  writes_ = 0;
+}
+
+void ImageCache::DumpStatistics() const {
+  LOGI("Image cache hits:%d misses:%d writes:%d", hits_.load(), misses_.load(),
+       writes_.load());
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ImageCache.h
+// Persistent cache of decoded images in the application cache directory
+//--------------------------------------------------------------------------------
+#ifndef _IMAGECACHE_H
+#define _IMAGECACHE_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Bumped whenever the file layout or the decoded format changes
+const uint32_t IMAGE_CACHE_VERSION = 1;
+
+// Decoded RGBA8 image, mapped from the cache or decoded into buffer
+struct CACHED_IMAGE {
+  int32_t width;
+  int32_t height;
+  const uint8_t* pixels;
+
+  void* map;
+  size_t map_size;
+  std::vector<uint8_t> buffer;
+};
+
+/******************************************************************
+ * Decoding through BitmapFactory dominates a cold start. The first Load() of
+ * an image decodes it and writes the raw pixels to
+ * <cache dir>/images/<path hash>.img on the worker pool. Later loads, also in
+ * later launches, mmap that file and hand out the mapping so that it is
+ * uploaded without a copy.
+ *
+ * Entries are keyed by the source path, modification time and size, see
+ * JNIHelper::GetFileStamp(). A stale entry is overwritten by the next decode.
+ *
+ * Thread safety: Load() and Release() may be called from any thread.
+ */
+class ImageCache {
+  std::string directory_;
+  std::atomic<int32_t> hits_;
+  std::atomic<int32_t> misses_;
+  std::atomic<int32_t> writes_;
+
+  // Store() writes still queued or running on the worker pool
+  std::mutex store_mutex_;
+  std::condition_variable store_cond_;
+  int32_t pending_stores_;
+
+  std::string GetEntryPath(const char* file_name) const;
+  bool Map(const char* file_name, const int64_t mtime, const int64_t size,
+           CACHED_IMAGE* image);
+  void Store(const char* file_name, const int64_t mtime, const int64_t size,
+             const CACHED_IMAGE& image);
+
+  ImageCache(ImageCache const&);
+  void operator=(ImageCache const&);
+  ImageCache();
+  virtual ~ImageCache();
+
+ public:
+  static ImageCache* GetInstance() {
+    //Singleton, never destroyed, pending writes may still run on workers
+    static ImageCache* instance = new ImageCache();
+
+    return instance;
+  }
+
+  // Empty disables the cache
+  void SetDirectory(const std::string& directory);
+
+  /*
+   * A miss decodes into dst when given, e.g. a mapped pixel unpack buffer,
+   * otherwise into image->buffer. A hit always points into the mapping.
+   */
+  bool Load(const char* file_name, CACHED_IMAGE* image, uint8_t* dst = NULL,
+            const size_t dst_size = 0);
+  void Release(CACHED_IMAGE* image);
+
+  // Delete all entries, e.g. for a cold start measurement. Waits for pending
+  // writes first so that none lands after it
+  void Clear();
+  void ResetStatistics();
+  void DumpStatistics() const;
+};
+
+#endif
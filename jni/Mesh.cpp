@@ -0,0 +1,259 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// Mesh.cpp
+// Indexed triangle mesh loaded from a binary mesh file
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "Mesh.h"
+#include "GLStateCache.h"
+#include "ResourceRegistry.h"
+
+#define BUFFER_OFFSET(i) ((char*)NULL + (i))
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+Mesh::Mesh()
+    : vbo_(0),
+      ibo_(0),
+      vao_(0),
+      num_vertices_(0),
+      num_indices_(0),
+      index_type_(GL_UNSIGNED_SHORT),
+      stride_(0) {
+  for (int32_t i = 0; i < 3; ++i) {
+    bounds_min_[i] = 0.f;
+    bounds_max_[i] = 0.f;
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+Mesh::~Mesh() { Unload(); }
+
+//--------------------------------------------------------------------------------
+// The offsets come from the file, check them before touching the data
+//--------------------------------------------------------------------------------
+bool Mesh::Validate(const ndk_helper::MAPPED_FILE& file) {
+  if (file.size < sizeof(MESH_HEADER)) return false;
+
+  const MESH_HEADER* header = reinterpret_cast<const MESH_HEADER*>(file.data);
+  if (header->magic != MESH_MAGIC || header->version != MESH_VERSION)
+    return false;
+  if (header->attribute_count == 0 ||
+      header->attribute_count > MESH_MAX_ATTRIBUTES)
+    return false;
+  if (header->lod_count == 0 || header->lod_count > MESH_MAX_LODS)
+    return false;
+  if (header->index_type != MESH_TYPE_UNSIGNED_SHORT &&
+      header->index_type != MESH_TYPE_UNSIGNED_INT)
+    return false;
+
+  const uint64_t attributes_end =
+      sizeof(MESH_HEADER) + header->attribute_count * sizeof(MESH_ATTRIBUTE) +
+      header->lod_count * sizeof(MESH_LOD);
+  const uint64_t index_size =
+      header->index_type == MESH_TYPE_UNSIGNED_SHORT ? 2 : 4;
+  const uint64_t vertex_end =
+      header->vertex_offset +
+      static_cast<uint64_t>(header->vertex_count) * header->stride;
+  const uint64_t index_end =
+      header->index_offset +
+      static_cast<uint64_t>(header->index_count) * index_size;
+  if (header->vertex_offset < attributes_end ||
+      header->index_offset < vertex_end || index_end > file.size)
+    return false;
+
+  // Every attribute has to fit within a vertex
+  const MESH_ATTRIBUTE* attributes =
+      reinterpret_cast<const MESH_ATTRIBUTE*>(file.data + sizeof(MESH_HEADER));
+  for (uint32_t i = 0; i < header->attribute_count; ++i) {
+    uint64_t component_size = 0;
+    if (attributes[i].type == MESH_TYPE_FLOAT ||
+        attributes[i].type == MESH_TYPE_UNSIGNED_INT)
+      component_size = 4;
+    else if (attributes[i].type == MESH_TYPE_UNSIGNED_SHORT)
+      component_size = 2;
+    if (component_size == 0 || attributes[i].components == 0 ||
+        attributes[i].components > 4)
+      return false;
+    if (attributes[i].offset + attributes[i].components * component_size >
+        header->stride)
+      return false;
+  }
+
+  const MESH_LOD* lods = reinterpret_cast<const MESH_LOD*>(
+      attributes + header->attribute_count);
+  for (uint32_t i = 0; i < header->lod_count; ++i) {
+    if (static_cast<uint64_t>(lods[i].first_index) + lods[i].index_count >
+        header->index_count)
+      return false;
+  }
+
+  // An index past the vertices would read outside the buffer on the GPU
+  if (header->index_offset % index_size) return false;
+  const uint8_t* indices = file.data + header->index_offset;
+  for (uint32_t i = 0; i < header->index_count; ++i) {
+    const uint32_t index =
+        index_size == 2 ? reinterpret_cast<const uint16_t*>(indices)[i]
+                        : reinterpret_cast<const uint32_t*>(indices)[i];
+    if (index >= header->vertex_count) return false;
+  }
+  return true;
+}
+
+bool Mesh::Load(const char* file_name) {
+  Unload();
+
+  ndk_helper::JNIHelper* helper = ndk_helper::JNIHelper::GetInstance();
+  ndk_helper::MAPPED_FILE file;
+  if (!helper->MapFile(file_name, &file)) {
+    LOGI("Failed to open mesh %s", file_name);
+    return false;
+  }
+  if (!Validate(file)) {
+    LOGI("Invalid mesh %s", file_name);
+    helper->UnmapFile(&file);
+    return false;
+  }
+
+  const MESH_HEADER* header = reinterpret_cast<const MESH_HEADER*>(file.data);
+  const MESH_ATTRIBUTE* attributes =
+      reinterpret_cast<const MESH_ATTRIBUTE*>(file.data + sizeof(MESH_HEADER));
+  attributes_.assign(attributes, attributes + header->attribute_count);
+  const MESH_LOD* lods =
+      reinterpret_cast<const MESH_LOD*>(attributes + header->attribute_count);
+  lods_.assign(lods, lods + header->lod_count);
+  num_vertices_ = header->vertex_count;
+  num_indices_ = header->index_count;
+  index_type_ = header->index_type;
+  stride_ = header->stride;
+  for (int32_t i = 0; i < 3; ++i) {
+    bounds_min_[i] = header->bounds_min[i];
+    bounds_max_[i] = header->bounds_max[i];
+  }
+
+  // Straight from the mapping into the buffers
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  const std::string path(file_name);
+  vbo_ = registry->AcquireBuffer((path + ":vertices").c_str(), GL_ARRAY_BUFFER,
+                                 file.data + header->vertex_offset,
+                                 num_vertices_ * stride_);
+  ibo_ = registry->AcquireBuffer(
+      (path + ":indices").c_str(), GL_ELEMENT_ARRAY_BUFFER,
+      file.data + header->index_offset,
+      num_indices_ * (index_type_ == GL_UNSIGNED_SHORT ? 2 : 4));
+
+  helper->UnmapFile(&file);
+
+  // Attribute setup is recorded once
+  GLStateCache* state = GLStateCache::GetInstance();
+  glGenVertexArrays(1, &vao_);
+  state->BindVertexArray(vao_);
+  BindAttributes();
+  state->BindVertexArray(0);
+
+  LOGI("Loaded mesh %s, %d vertices %d indices %d LODs", file_name,
+       num_vertices_, num_indices_, GetLodCount());
+  return true;
+}
+
+void Mesh::Unload() {
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  if (vao_) {
+    GLStateCache::GetInstance()->DeleteVertexArray(vao_);
+    vao_ = 0;
+  }
+
+  if (vbo_) {
+    registry->ReleaseBuffer(vbo_);
+    vbo_ = 0;
+  }
+
+  if (ibo_) {
+    registry->ReleaseBuffer(ibo_);
+    ibo_ = 0;
+  }
+  attributes_.clear();
+  lods_.clear();
+}
+
+void Mesh::Bind() const {
+  GLStateCache::GetInstance()->BindVertexArray(vao_);
+}
+
+void Mesh::BindAttributes() const {
+  GLStateCache* state = GLStateCache::GetInstance();
+  state->BindBuffer(GL_ARRAY_BUFFER, vbo_);
+  for (size_t i = 0; i < attributes_.size(); ++i) {
+    const MESH_ATTRIBUTE& attribute = attributes_[i];
+    glVertexAttribPointer(attribute.semantic, attribute.components,
+                          attribute.type, attribute.normalized ? GL_TRUE
+                                                               : GL_FALSE,
+                          stride_, BUFFER_OFFSET(attribute.offset));
+    glEnableVertexAttribArray(attribute.semantic);
+  }
+  state->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+}
+
+void Mesh::GetDrawPacket(const int32_t lod, DRAW_PACKET* packet) const {
+  const int32_t index_size = index_type_ == GL_UNSIGNED_SHORT ? 2 : 4;
+  packet->vertex_array = vao_;
+  packet->mode = GL_TRIANGLES;
+  packet->count = lods_[lod].index_count;
+  packet->index_type = index_type_;
+  packet->first_index = lods_[lod].first_index * index_size;
+  packet->instances = 0;
+}
+
+//--------------------------------------------------------------------------------
+// LOD selection
+//--------------------------------------------------------------------------------
+int32_t Mesh::SelectLod(const float pixels_per_unit,
+                        const int32_t current) const {
+  int32_t lod = 0;
+  for (int32_t i = 1; i < GetLodCount(); ++i) {
+    if (lods_[i].error * pixels_per_unit <= MESH_LOD_ERROR_PIXELS) lod = i;
+  }
+  // Finer right away, the current error is already visible
+  if (lod <= current) return lod;
+
+  const float threshold = MESH_LOD_ERROR_PIXELS * MESH_LOD_HYSTERESIS;
+  int32_t coarser = std::min(current, GetLodCount() - 1);
+  for (int32_t i = coarser + 1; i <= lod; ++i) {
+    if (lods_[i].error * pixels_per_unit <= threshold) coarser = i;
+  }
+  return coarser;
+}
+
+float Mesh::GetBoundingSphere(float* center) const {
+  float radius = 0.f;
+  for (int32_t i = 0; i < 3; ++i) {
+    center[i] = (bounds_min_[i] + bounds_max_[i]) * 0.5f;
+    const float extent = (bounds_max_[i] - bounds_min_[i]) * 0.5f;
+    radius += extent * extent;
+  }
+  return sqrtf(radius);
+}
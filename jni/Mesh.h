@@ -0,0 +1,106 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// Mesh.h
+// Indexed triangle mesh loaded from a binary mesh file
+//--------------------------------------------------------------------------------
+#ifndef _MESH_H
+#define _MESH_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <vector>
+
+#include "NDKHelper.h"
+#include "MeshFormat.h"
+#include "RenderQueue.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Largest LOD error allowed on screen
+const float MESH_LOD_ERROR_PIXELS = 1.f;
+// A coarser LOD has to fit this fraction of the error first, so that a zoom
+// around a threshold does not switch back and forth
+const float MESH_LOD_HYSTERESIS = 0.75f;
+
+/******************************************************************
+ * Mesh written by tools/mesh_converter.cpp, e.g. "Meshes/teapot.mesh".
+ *
+ * Load() maps the file and uploads the interleaved vertices and the indices
+ * straight from the mapping through the ResourceRegistry, so the mesh is
+ * shared by path and never copied on the heap. The attribute descriptor of
+ * the file drives BindAttributes(), attributes are bound to the location of
+ * their MESH_SEMANTIC and recorded in a vertex array object at load time.
+ *
+ * Coarser LODs built by the converter share the vertices and are drawn
+ * through GetDrawPacket(lod). SelectLod() picks one from the projected size of the bounds.
+ */
+class Mesh {
+  GLuint vbo_;
+  GLuint ibo_;
+  // Attributes and index buffer, set up by Load()
+  GLuint vao_;
+  int32_t num_vertices_;
+  int32_t num_indices_;
+  GLenum index_type_;
+  int32_t stride_;
+  std::vector<MESH_ATTRIBUTE> attributes_;
+  std::vector<MESH_LOD> lods_;
+  float bounds_min_[3];
+  float bounds_max_[3];
+
+  static bool Validate(const ndk_helper::MAPPED_FILE& file);
+
+ public:
+  Mesh();
+  virtual ~Mesh();
+
+  bool Load(const char* file_name);
+  void Unload();
+
+  // Bind the vertex array object
+  void Bind() const;
+  // Bind the buffers and point the attributes at them, e.g. into another
+  // vertex array object that adds attributes
+  void BindAttributes() const;
+  // Vertex array and index range of a LOD, the caller sets the rest
+  void GetDrawPacket(const int32_t lod, DRAW_PACKET* packet) const;
+
+  /*
+   * Coarsest LOD whose error stays within MESH_LOD_ERROR_PIXELS, with
+   * hysteresis against the current LOD.
+   * pixels_per_unit is the projected size of one object space unit at the
+   * bounding sphere, see GetBoundingSphere().
+   */
+  int32_t SelectLod(const float pixels_per_unit, const int32_t current) const;
+  int32_t GetLodCount() const { return static_cast<int32_t>(lods_.size()); }
+  int32_t GetTriangleCount(const int32_t lod = 0) const {
+    return lods_.empty() ? 0 : lods_[lod].index_count / 3;
+  }
+  // Center and radius in object space
+  float GetBoundingSphere(float* center) const;
+
+  bool IsLoaded() const { return vbo_ != 0; }
+  int32_t GetVertexCount() const { return num_vertices_; }
+  int32_t GetIndexCount() const { return num_indices_; }
+  const float* GetBoundsMin() const { return bounds_min_; }
+  const float* GetBoundsMax() const { return bounds_max_; }
+};
+
+#endif
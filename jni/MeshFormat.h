@@ -0,0 +1,98 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// MeshFormat.h
+// Binary mesh file layout, shared with tools/mesh_converter.cpp
+//--------------------------------------------------------------------------------
+#ifndef _MESHFORMAT_H
+#define _MESHFORMAT_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <stdint.h>
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// "TPMS"
+const uint32_t MESH_MAGIC = 0x534d5054;
+// Bumped whenever the layout changes, files are regenerated by the converter
+const uint32_t MESH_VERSION = 2;
+// Vertex and index data start on this boundary within the file
+const uint32_t MESH_ALIGNMENT = 16;
+const uint32_t MESH_MAX_ATTRIBUTES = 8;
+const uint32_t MESH_MAX_LODS = 4;
+
+// Vertex attribute locations bound by the programs
+enum MESH_SEMANTIC {
+  MESH_SEMANTIC_POSITION,
+  MESH_SEMANTIC_NORMAL,
+  MESH_SEMANTIC_TEXCOORD,
+};
+
+// GL enums, kept as values so that the host tool needs no GL headers
+const uint32_t MESH_TYPE_FLOAT = 0x1406;
+const uint32_t MESH_TYPE_UNSIGNED_SHORT = 0x1403;
+const uint32_t MESH_TYPE_UNSIGNED_INT = 0x1405;
+
+// Describes one attribute of the interleaved vertex stream
+struct MESH_ATTRIBUTE {
+  uint32_t semantic;
+  uint32_t components;
+  uint32_t type;
+  uint32_t normalized;
+  // Byte offset within a vertex
+  uint32_t offset;
+};
+
+// Range of the index data drawn for one level of detail
+struct MESH_LOD {
+  uint32_t first_index;
+  uint32_t index_count;
+  // Largest deviation from the full mesh in object space units
+  float error;
+};
+
+/******************************************************************
+ * A mesh file is a MESH_HEADER followed by header.attribute_count
+ * MESH_ATTRIBUTEs, header.lod_count MESH_LODs, the interleaved vertices and
+ * the triangle list indices of all LODs, finest first. The LODs share the
+ * vertices.
+ * Everything is little endian and laid out as it is uploaded, so the loader
+ * hands pointers into the mapped file straight to glBufferData().
+ */
+struct MESH_HEADER {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  // MESH_TYPE_UNSIGNED_SHORT or MESH_TYPE_UNSIGNED_INT
+  uint32_t index_type;
+  // Bytes per vertex
+  uint32_t stride;
+  uint32_t attribute_count;
+  uint32_t lod_count;
+  // Axis aligned bounds of the positions
+  float bounds_min[3];
+  float bounds_max[3];
+  // Byte offsets from the start of the file
+  uint32_t vertex_offset;
+  uint32_t index_offset;
+};
+
+#endif
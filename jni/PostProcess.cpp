@@ -0,0 +1,188 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// PostProcess.cpp
+// Full screen pass from the scene target to the default framebuffer
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <map>
+#include <string>
+
+#include "PostProcess.h"
+#include "GLStateCache.h"
+#include "ResourceRegistry.h"
+
+//--------------------------------------------------------------------------------
+// Filmic curve of PostProcess.fsh, for the white point
+//--------------------------------------------------------------------------------
+static float Filmic(const float x) {
+  const float A = 0.15f;
+  const float B = 0.50f;
+  const float C = 0.10f;
+  const float D = 0.20f;
+  const float E = 0.02f;
+  const float F = 0.30f;
+  return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+}
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+PostProcess::PostProcess() : features_(0) {
+  for (int32_t i = 0; i < POST_VARIANTS; ++i) programs_[i].program = 0;
+  SetExposure(POST_EXPOSURE);
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+PostProcess::~PostProcess() { Unload(); }
+
+bool PostProcess::Init() {
+  if (programs_[features_].program) return true;
+  return LoadShaders(features_);
+}
+
+void PostProcess::Unload() {
+  for (int32_t i = 0; i < POST_VARIANTS; ++i) {
+    if (programs_[i].program) {
+      ResourceRegistry::GetInstance()->ReleaseProgram(programs_[i].program);
+      programs_[i].program = 0;
+    }
+  }
+}
+
+void PostProcess::SetExposure(const float exposure) {
+  exposure_ = exposure;
+  // The target saturates at 1, the exposed maximum maps to white
+  white_scale_ = 1.f / Filmic(exposure_);
+}
+
+void PostProcess::Apply(const SceneTarget& target, const bool invalidate) {
+  const int32_t width = target.GetWidth();
+  const int32_t height = target.GetHeight();
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, width, height);
+  if (invalidate) {
+    // Every pixel is written, nothing of the backbuffer needs loading
+    const GLenum attachments[] = { GL_COLOR, GL_DEPTH, GL_STENCIL };
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, 3, attachments);
+  }
+
+  if (programs_[features_].program == 0 && !LoadShaders(features_)) return;
+  const POST_PROGRAM& program = programs_[features_];
+
+  GLStateCache* state = GLStateCache::GetInstance();
+  state->Disable(GL_DEPTH_TEST);
+  state->UseProgram(program.program);
+  state->BindVertexArray(0);
+  state->ActiveTexture(GL_TEXTURE0);
+  state->BindTexture(GL_TEXTURE_2D, target.GetTexture());
+  glUniform4f(program.scene_scale,
+              static_cast<float>(target.GetViewportWidth()) / width,
+              static_cast<float>(target.GetViewportHeight()) / height,
+              (target.GetViewportWidth() - 0.5f) / width,
+              (target.GetViewportHeight() - 0.5f) / height);
+  if (features_ & POST_TONEMAP)
+    glUniform2f(program.tonemap, exposure_, white_scale_);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+GLuint PostProcess::CreateProgram(const char* strVsh, const char* strFsh,
+                                  const int32_t features) {
+  GLuint program;
+  GLuint vert_shader, frag_shader;
+
+  // Create shader program
+  program = glCreateProgram();
+  LOGI("Created Shader %d", program);
+
+  // Create and compile vertex shader
+  if (!ndk_helper::shader::CompileShader(&vert_shader, GL_VERTEX_SHADER,
+                                         strVsh)) {
+    LOGI("Failed to compile vertex shader");
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  // Create and compile fragment shader, a #define for each feature
+  std::string header = "#version 300 es";
+  if (features & POST_TONEMAP) header += "\n#define TONEMAP";
+  if (features & POST_SRGB_ENCODE) header += "\n#define SRGB_ENCODE";
+  if (features & POST_DITHER) header += "\n#define DITHER";
+  std::map<std::string, std::string> params;
+  params["#version 300 es"] = header;
+  if (!ndk_helper::shader::CompileShader(&frag_shader, GL_FRAGMENT_SHADER,
+                                         strFsh, params)) {
+    LOGI("Failed to compile fragment shader");
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  // Attach vertex shader to program
+  glAttachShader(program, vert_shader);
+
+  // Attach fragment shader to program
+  glAttachShader(program, frag_shader);
+
+  // Link program, the vertices come from gl_VertexID
+  if (!ndk_helper::shader::LinkProgram(program)) {
+    LOGI("Failed to link program: %d", program);
+
+    if (vert_shader) {
+      glDeleteShader(vert_shader);
+      vert_shader = 0;
+    }
+    if (frag_shader) {
+      glDeleteShader(frag_shader);
+      frag_shader = 0;
+    }
+    if (program) {
+      glDeleteProgram(program);
+    }
+
+    return 0;
+  }
+
+  // Release vertex and fragment shaders
+  if (vert_shader) glDeleteShader(vert_shader);
+  if (frag_shader) glDeleteShader(frag_shader);
+
+  return program;
+}
+
+bool PostProcess::LoadShaders(const int32_t features) {
+  const char* strVsh = "Shaders/VS_PostProcess.vsh";
+  const char* strFsh = "Shaders/PostProcess.fsh";
+  char variant[16];
+  snprintf(variant, sizeof(variant), "post%d", features);
+  GLuint program = ResourceRegistry::GetInstance()->AcquireProgram(
+      strVsh, strFsh, variant, [this, strVsh, strFsh, features]() {
+        return CreateProgram(strVsh, strFsh, features);
+      });
+  if (!program) return false;
+
+  GLStateCache::GetInstance()->UseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "sSceneTexture"), 0);
+  programs_[features].scene_scale = glGetUniformLocation(program, "vSceneScale");
+  programs_[features].tonemap = glGetUniformLocation(program, "vTonemap");
+
+  programs_[features].program = program;
+  return true;
+}
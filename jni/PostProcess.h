@@ -0,0 +1,90 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// PostProcess.h
+// Full screen pass from the scene target to the default framebuffer
+//--------------------------------------------------------------------------------
+#ifndef _POSTPROCESS_H
+#define _POSTPROCESS_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "NDKHelper.h"
+#include "SceneTarget.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Feature bits, each one a #define of PostProcess.fsh
+enum POST_FEATURE {
+  // Exposure and filmic curve
+  POST_TONEMAP = 1 << 0,
+  POST_SRGB_ENCODE = 1 << 1,
+  // Ordered dither below one step of the 8 bit backbuffer
+  POST_DITHER = 1 << 2,
+};
+const int32_t POST_VARIANTS = 1 << 3;
+const float POST_EXPOSURE = 1.f;
+
+/******************************************************************
+ * Everything between the scene and the backbuffer in one full screen
+ * triangle: upscale of the rendered part of the scene target, exposure,
+ * filmic tonemap, sRGB encode and dither. The scene target is read once and
+ * the backbuffer written once whatever the features are, a separate pass for
+ * each would cost a full screen of bandwidth each.
+ *
+ * A program variant per feature combination, compiled on first use.
+ *
+ * Thread safety: GL thread only.
+ */
+class PostProcess {
+  struct POST_PROGRAM {
+    GLuint program;
+    GLint scene_scale;
+    GLint tonemap;
+  };
+  POST_PROGRAM programs_[POST_VARIANTS];
+  int32_t features_;
+  float exposure_;
+  // 1 / curve of the brightest value the target holds after the exposure
+  float white_scale_;
+
+  GLuint CreateProgram(const char* strVsh, const char* strFsh,
+                       const int32_t features);
+  bool LoadShaders(const int32_t features);
+
+ public:
+  PostProcess();
+  virtual ~PostProcess();
+
+  // Compiles the variant of the current features ahead of the first frame
+  bool Init();
+  void Unload();
+
+  // POST_FEATURE bits
+  void SetFeatures(const int32_t features) { features_ = features; }
+  int32_t GetFeatures() const { return features_; }
+  void SetExposure(const float exposure);
+
+  // Draws the rendered part of the target to the default framebuffer with
+  // the full viewport, leaves it bound. With invalidate its previous contents
+  // are dropped.
+  void Apply(const SceneTarget& target, const bool invalidate);
+};
+
+#endif
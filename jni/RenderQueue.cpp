@@ -0,0 +1,104 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// RenderQueue.cpp
+// Draw packets sorted by state before submission
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+#include "UniformBlocks.h"
+
+#define BUFFER_OFFSET(i) ((char*)NULL + (i))
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+RenderQueue::RenderQueue() : draws_(0) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+RenderQueue::~RenderQueue() {}
+
+uint64_t RenderQueue::MakeKey(const RENDER_PASS pass, const GLuint program,
+                              const int32_t material, const GLuint texture,
+                              const float depth) {
+  const uint64_t depth_max = (1 << RENDER_KEY_DEPTH_BITS) - 1;
+  const uint64_t quantized = static_cast<uint64_t>(
+      std::min(std::max(depth, 0.f), 1.f) * depth_max);
+  return static_cast<uint64_t>(pass & 0xf) << RENDER_KEY_PASS_SHIFT |
+         static_cast<uint64_t>(program & 0xfff) << RENDER_KEY_PROGRAM_SHIFT |
+         static_cast<uint64_t>(material & 0xff) << RENDER_KEY_MATERIAL_SHIFT |
+         static_cast<uint64_t>(texture & 0xfff) << RENDER_KEY_TEXTURE_SHIFT |
+         quantized << RENDER_KEY_DEPTH_SHIFT;
+}
+
+//--------------------------------------------------------------------------------
+// Fixed function state of the passes
+//--------------------------------------------------------------------------------
+void RenderQueue::ApplyPass(const RENDER_PASS pass) {
+  GLStateCache* state = GLStateCache::GetInstance();
+  state->Enable(GL_CULL_FACE);
+  state->Enable(GL_DEPTH_TEST);
+  state->DepthFunc(GL_LEQUAL);
+  // The sky is at the far plane, nothing is drawn behind it
+  state->DepthMask(pass == RENDER_PASS_SKY ? GL_FALSE : GL_TRUE);
+}
+
+void RenderQueue::Execute() {
+  order_.resize(packets_.size());
+  for (size_t i = 0; i < packets_.size(); ++i)
+    order_[i] = std::make_pair(packets_[i].key, static_cast<int32_t>(i));
+  std::sort(order_.begin(), order_.end());
+
+  GLStateCache* state = GLStateCache::GetInstance();
+  UniformBlocks* blocks = UniformBlocks::GetInstance();
+  blocks->UploadObjects();
+
+  int32_t pass = -1;
+  for (size_t i = 0; i < order_.size(); ++i) {
+    const DRAW_PACKET& packet = packets_[order_[i].second];
+    const int32_t packet_pass =
+        static_cast<int32_t>(packet.key >> RENDER_KEY_PASS_SHIFT);
+    if (packet_pass != pass) {
+      pass = packet_pass;
+      ApplyPass(static_cast<RENDER_PASS>(pass));
+    }
+
+    state->UseProgram(packet.program);
+    state->BindVertexArray(packet.vertex_array);
+    state->ActiveTexture(GL_TEXTURE0);
+    state->BindTexture(packet.texture_target, packet.texture);
+    blocks->BindObject(packet.object);
+
+    if (packet.instances)
+      glDrawElementsInstanced(packet.mode, packet.count, packet.index_type,
+                              BUFFER_OFFSET(packet.first_index),
+                              packet.instances);
+    else
+      glDrawElements(packet.mode, packet.count, packet.index_type,
+                     BUFFER_OFFSET(packet.first_index));
+  }
+
+  draws_ = static_cast<int32_t>(packets_.size());
+  packets_.clear();
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// RenderQueue.h
+// Draw packets sorted by state before submission
+//--------------------------------------------------------------------------------
+#ifndef _RENDERQUEUE_H
+#define _RENDERQUEUE_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <vector>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Passes in submission order, each with its own depth and cull state
+enum RENDER_PASS {
+  RENDER_PASS_OPAQUE,
+  // Drawn last at the far plane, only where nothing else was drawn
+  RENDER_PASS_SKY,
+  RENDER_PASSES,
+};
+
+/*
+ * Sort key, most significant first:
+ *   pass 4 | program 12 | material 8 | texture 12 | depth 24 | unused 4
+ * GL names are truncated to their field, a collision costs a state change,
+ * not correctness.
+ */
+const int32_t RENDER_KEY_PASS_SHIFT = 60;
+const int32_t RENDER_KEY_PROGRAM_SHIFT = 48;
+const int32_t RENDER_KEY_MATERIAL_SHIFT = 40;
+const int32_t RENDER_KEY_TEXTURE_SHIFT = 28;
+const int32_t RENDER_KEY_DEPTH_SHIFT = 4;
+const int32_t RENDER_KEY_DEPTH_BITS = 24;
+
+struct DRAW_PACKET {
+  uint64_t key;
+  GLuint program;
+  GLuint vertex_array;
+  GLenum texture_target;
+  GLuint texture;
+  // Range of the ObjectUniforms block, see UniformBlocks::AddObject()
+  int32_t object;
+
+  GLenum mode;
+  GLsizei count;
+  GLenum index_type;
+  // Byte offset into the index buffer
+  intptr_t first_index;
+  // 0 for a non instanced draw
+  GLsizei instances;
+};
+
+/******************************************************************
+ * Renderers push their draws instead of issuing them. Execute() sorts the
+ * packets by key and submits them through the GLStateCache, so that draws
+ * sharing a program, material and texture are adjacent and only the first of
+ * them changes state. Within the same state, opaque draws go front to back.
+ *
+ * Object uniforms added by the renderers are uploaded once before the first
+ * draw.
+ *
+ * Thread safety: GL thread only.
+ */
+class RenderQueue {
+  std::vector<DRAW_PACKET> packets_;
+  // Key and packet index, sorted instead of the packets
+  std::vector<std::pair<uint64_t, int32_t> > order_;
+  int32_t draws_;
+
+  static void ApplyPass(const RENDER_PASS pass);
+
+ public:
+  RenderQueue();
+  virtual ~RenderQueue();
+
+  /*
+   * depth is the view distance normalized to [0, 1], nearer first.
+   * material is an index into the material table.
+   */
+  static uint64_t MakeKey(const RENDER_PASS pass, const GLuint program,
+                          const int32_t material, const GLuint texture,
+                          const float depth);
+
+  void Push(const DRAW_PACKET& packet) { packets_.push_back(packet); }
+  void Execute();
+  // Draws submitted by the last Execute()
+  int32_t GetDrawCount() const { return draws_; }
+};
+
+#endif
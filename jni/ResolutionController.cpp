@@ -0,0 +1,89 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ResolutionController.cpp
+// Render scale chosen from the frame time
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <math.h>
+
+#include <algorithm>
+
+#include "ResolutionController.h"
+
+// Weight of the newest frame in the smoothed frame time
+static const double FRAME_TIME_WEIGHT = 0.1;
+// Longer frames are pauses, e.g. a stage load, not load of the GPU
+static const double MAX_FRAME_TIME = 0.25;
+// Largest increase per change
+static const float SCALE_STEP = 0.05f;
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+ResolutionController::ResolutionController()
+    : min_scale_(RESOLUTION_MIN_SCALE),
+      max_scale_(RESOLUTION_MAX_SCALE),
+      target_frame_time_(RESOLUTION_TARGET_FRAME_TIME),
+      hysteresis_(RESOLUTION_HYSTERESIS) {
+  Reset();
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+ResolutionController::~ResolutionController() {}
+
+void ResolutionController::SetScaleRange(const float min_scale,
+                                         const float max_scale) {
+  min_scale_ = min_scale;
+  max_scale_ = std::max(max_scale, min_scale);
+  scale_ = std::min(std::max(scale_, min_scale_), max_scale_);
+}
+
+void ResolutionController::Reset() {
+  scale_ = max_scale_;
+  frame_time_ = target_frame_time_;
+  settle_frames_ = RESOLUTION_SETTLE_FRAMES;
+}
+
+float ResolutionController::Update(const double frame_time) {
+  if (frame_time <= 0.0 || frame_time > MAX_FRAME_TIME) return scale_;
+
+  frame_time_ += (frame_time - frame_time_) * FRAME_TIME_WEIGHT;
+  if (settle_frames_ > 0) {
+    settle_frames_--;
+    return scale_;
+  }
+
+  float scale = scale_;
+  if (frame_time_ > target_frame_time_ * (1.0 + hysteresis_)) {
+    // Fill rate bound, the pixel count goes with the square of the scale
+    scale = scale_ * static_cast<float>(sqrt(target_frame_time_ / frame_time_));
+  } else if (frame_time_ < target_frame_time_ * (1.0 - hysteresis_)) {
+    scale = scale_ + SCALE_STEP;
+  }
+  scale = std::min(std::max(scale, min_scale_), max_scale_);
+
+  if (scale != scale_) {
+    scale_ = scale;
+    settle_frames_ = RESOLUTION_SETTLE_FRAMES;
+  }
+  return scale_;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ResolutionController.h
+// Render scale chosen from the frame time
+//--------------------------------------------------------------------------------
+#ifndef _RESOLUTIONCONTROLLER_H
+#define _RESOLUTIONCONTROLLER_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+const float RESOLUTION_MIN_SCALE = 0.5f;
+const float RESOLUTION_MAX_SCALE = 1.f;
+// 60 FPS
+const double RESOLUTION_TARGET_FRAME_TIME = 1.0 / 60.0;
+// Dead band around the target as a fraction of it
+const double RESOLUTION_HYSTERESIS = 0.1;
+// Frames to settle after a change before the next one
+const int32_t RESOLUTION_SETTLE_FRAMES = 15;
+
+/******************************************************************
+ * Scale of the width and height steering the smoothed frame time toward the
+ * target. Above the dead band the pixel count is cut in proportion to the
+ * excess, below it the scale creeps back up so that it does not oscillate
+ * around the target.
+ */
+class ResolutionController {
+  float min_scale_;
+  float max_scale_;
+  double target_frame_time_;
+  double hysteresis_;
+  float scale_;
+  double frame_time_;
+  int32_t settle_frames_;
+
+ public:
+  ResolutionController();
+  virtual ~ResolutionController();
+
+  void SetScaleRange(const float min_scale, const float max_scale);
+  void SetTargetFrameTime(const double frame_time) {
+    target_frame_time_ = frame_time;
+  }
+  void SetHysteresis(const double hysteresis) { hysteresis_ = hysteresis; }
+  // Back to the maximum scale
+  void Reset();
+
+  // frame_time from PerfMonitor::GetFrameTime(), returns the scale
+  float Update(const double frame_time);
+  float GetScale() const { return scale_; }
+};
+
+#endif
@@ -0,0 +1,472 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ResourceRegistry.cpp
+// Ref-counted GPU resources shared between renderers
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "ResourceRegistry.h"
+#include "GLStateCache.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+ResourceRegistry::ResourceRegistry()
+    : use_clock_(0),
+      cache_budget_(0),
+      trim_level_(TRIM_LEVEL_NONE),
+      cubemap_format_(CUBEMAP_FORMAT) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+ResourceRegistry::~ResourceRegistry() {}
+
+//--------------------------------------------------------------------------------
+// FNV-1a
+//--------------------------------------------------------------------------------
+uint64_t ResourceRegistry::Hash(const void* data, const size_t size,
+                                const uint64_t seed) {
+  const uint64_t FNV_PRIME = 1099511628211ULL;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= p[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+uint64_t ResourceRegistry::HashFile(const char* file_name,
+                                    const uint64_t seed) {
+  std::vector<uint8_t> data;
+  if (!ndk_helper::JNIHelper::GetInstance()->ReadFile(file_name, &data) ||
+      data.empty())
+    return 0;
+  return Hash(&data[0], data.size(), seed);
+}
+
+static std::string MakeKey(const RESOURCE_TYPE type, const std::string& path) {
+  const char* PREFIXES[] = { "tex:", "buf:", "prog:" };
+  return std::string(PREFIXES[type]) + path;
+}
+
+RESOURCE* ResourceRegistry::Find(const RESOURCE_TYPE type,
+                                 const std::string& path) {
+  const std::string key = MakeKey(type, path);
+  std::map<std::string, RESOURCE*>::iterator it = resources_.find(key);
+  if (it != resources_.end()) return it->second;
+  it = aliases_.find(key);
+  if (it == aliases_.end()) return NULL;
+  return it->second;
+}
+
+RESOURCE* ResourceRegistry::FindByHash(const RESOURCE_TYPE type,
+                                       const uint64_t hash) {
+  // 0 indicates the content could not be hashed
+  if (hash == 0) return NULL;
+
+  std::map<std::string, RESOURCE*>::iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    if (it->second->type == type && it->second->content_hash == hash)
+      return it->second;
+  }
+  return NULL;
+}
+
+RESOURCE* ResourceRegistry::FindByName(const RESOURCE_TYPE type,
+                                       const GLuint name) {
+  std::map<std::string, RESOURCE*>::iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    if (it->second->type == type && it->second->name == name)
+      return it->second;
+  }
+  return NULL;
+}
+
+RESOURCE* ResourceRegistry::Register(const RESOURCE_TYPE type,
+                                     const std::string& path,
+                                     const uint64_t hash) {
+  RESOURCE* res = new RESOURCE();
+  res->type = type;
+  res->path = path;
+  res->content_hash = hash;
+  res->ref_count = 1;
+  res->last_used = ++use_clock_;
+  res->name = 0;
+  res->size = 0;
+  res->cubemap = NULL;
+  resources_[MakeKey(type, path)] = res;
+  return res;
+}
+
+void ResourceRegistry::Destroy(RESOURCE* res) {
+  LOGI("Releasing %s", res->path.c_str());
+  switch (res->type) {
+    case RESOURCE_TEXTURE:
+      delete res->cubemap;
+      break;
+    case RESOURCE_BUFFER:
+      GLStateCache::GetInstance()->DeleteBuffer(res->name);
+      break;
+    case RESOURCE_PROGRAM:
+      GLStateCache::GetInstance()->DeleteProgram(res->name);
+      break;
+  }
+  resources_.erase(MakeKey(res->type, res->path));
+  std::map<std::string, RESOURCE*>::iterator it = aliases_.begin();
+  while (it != aliases_.end()) {
+    if (it->second == res)
+      aliases_.erase(it++);
+    else
+      ++it;
+  }
+  delete res;
+}
+
+//--------------------------------------------------------------------------------
+// Cubemaps
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Identify the content by the mip 0 faces, or the single image, which are read
+// but not decoded
+//--------------------------------------------------------------------------------
+uint64_t ResourceRegistry::HashCubemap(const char* file_name,
+                                       const uint64_t seed) {
+  // Single image converted at load time
+  if (strchr(file_name, '%') == NULL) return HashFile(file_name, seed);
+
+  uint64_t hash = seed;
+  for (int32_t face = 0; face < CUBEMAP_FACES && hash; ++face) {
+    const int32_t BUFFER_SIZE = 256;
+    char file_name_buffer[BUFFER_SIZE];
+    snprintf(file_name_buffer, BUFFER_SIZE, file_name, 0, face);
+    hash = HashFile(file_name_buffer, hash);
+  }
+  return hash;
+}
+
+//--------------------------------------------------------------------------------
+// Shared by the Acquire*() texture flavors: the content hash is only computed
+// when the path misses, load() runs on a new, configured texture. NULL when it
+// fails, nothing is cached so that the next acquire retries.
+//--------------------------------------------------------------------------------
+CubemapTexture* ResourceRegistry::AcquireTexture(
+    const std::string& path, const std::function<uint64_t()>& hash,
+    const std::function<bool(CubemapTexture*)>& load) {
+  RESOURCE* res = Find(RESOURCE_TEXTURE, path);
+  if (res == NULL) {
+    const uint64_t content_hash = hash();
+    res = FindByHash(RESOURCE_TEXTURE, content_hash);
+    if (res == NULL) {
+      res = Register(RESOURCE_TEXTURE, path, content_hash);
+      res->cubemap = new CubemapTexture();
+      res->cubemap->SetFormat(cubemap_format_);
+      if (trim_level_ >= TRIM_LEVEL_MIPS)
+        res->cubemap->SetLevelLimit(CUBEMAP_TRIM_LEVEL);
+      if (!load(res->cubemap)) {
+        LOGI("Failed to load %s", path.c_str());
+        Destroy(res);
+        return NULL;
+      }
+      EvictCubemaps(cache_budget_);
+      return res->cubemap;
+    }
+    // Later acquires of this path skip reading and hashing the files
+    aliases_[MakeKey(RESOURCE_TEXTURE, path)] = res;
+  }
+  if (res->ref_count == 0) LOGI("Reusing cached %s", res->path.c_str());
+  res->ref_count++;
+  res->last_used = ++use_clock_;
+  return res->cubemap;
+}
+
+CubemapTexture* ResourceRegistry::AcquireCubemap(const char* file_name) {
+  return AcquireTexture(
+      file_name,
+      [file_name]() {
+        return HashCubemap(file_name, 14695981039346656037ULL);
+      },
+      [file_name](CubemapTexture* cubemap) {
+        return cubemap->Load(file_name);
+      });
+}
+
+CubemapTexture* ResourceRegistry::AcquireCubemapArray(
+    const std::vector<std::string>& file_names) {
+  std::string path;
+  for (size_t i = 0; i < file_names.size(); ++i) {
+    if (i) path += "|";
+    path += file_names[i];
+  }
+
+  return AcquireTexture(
+      path,
+      [&file_names]() {
+        // Missing layers are left out of the hash, they are filled with black
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < file_names.size(); ++i) {
+          const uint64_t layer_hash = HashCubemap(file_names[i].c_str(), hash);
+          if (layer_hash) hash = layer_hash;
+        }
+        return hash;
+      },
+      [&file_names](CubemapTexture* cubemap) {
+        return cubemap->LoadArray(file_names);
+      });
+}
+
+CubemapTexture* ResourceRegistry::AcquireOctahedral(const char* file_name) {
+  return AcquireTexture(
+      file_name,
+      [file_name]() {
+        // Seeded apart from cubemaps, the mip 0 image identifies the chain
+        const int32_t BUFFER_SIZE = 256;
+        char file_name_buffer[BUFFER_SIZE];
+        snprintf(file_name_buffer, BUFFER_SIZE, file_name, 0);
+        return HashFile(file_name_buffer,
+                        Hash("octahedral", strlen("octahedral")));
+      },
+      [file_name](CubemapTexture* cubemap) {
+        return cubemap->LoadOctahedral(file_name);
+      });
+}
+
+void ResourceRegistry::ReleaseCubemap(CubemapTexture* cubemap) {
+  if (cubemap == NULL) return;
+
+  std::map<std::string, RESOURCE*>::iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    RESOURCE* res = it->second;
+    if (res->type == RESOURCE_TEXTURE && res->cubemap == cubemap) {
+      // Keep it cached while within budget
+      if (--res->ref_count == 0) {
+        // Nobody samples it, stop decoding into the upload ring
+        cubemap->CancelUpload();
+        res->last_used = ++use_clock_;
+        if (trim_level_ >= TRIM_LEVEL_INACTIVE)
+          Destroy(res);
+        else
+          EvictCubemaps(cache_budget_);
+      }
+      return;
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------
+GLuint ResourceRegistry::AcquireBuffer(const char* path, const GLenum target,
+                                       const void* data, const int32_t size) {
+  RESOURCE* res = Find(RESOURCE_BUFFER, path);
+  if (res == NULL) {
+    const uint64_t hash = Hash(data, size);
+    res = FindByHash(RESOURCE_BUFFER, hash);
+    if (res == NULL) {
+      res = Register(RESOURCE_BUFFER, path, hash);
+      res->size = size;
+      glGenBuffers(1, &res->name);
+      // An index buffer would end up in the bound vertex array object
+      GLStateCache* state = GLStateCache::GetInstance();
+      if (target == GL_ELEMENT_ARRAY_BUFFER) state->BindVertexArray(0);
+      state->BindBuffer(target, res->name);
+      glBufferData(target, size, data, GL_STATIC_DRAW);
+      return res->name;
+    }
+  }
+  res->ref_count++;
+  return res->name;
+}
+
+void ResourceRegistry::ReleaseBuffer(const GLuint buffer) {
+  RESOURCE* res = FindByName(RESOURCE_BUFFER, buffer);
+  if (res && --res->ref_count == 0) Destroy(res);
+}
+
+//--------------------------------------------------------------------------------
+// Programs
+//--------------------------------------------------------------------------------
+GLuint ResourceRegistry::AcquireProgram(const char* vsh, const char* fsh,
+                                        const char* variant,
+                                        const std::function<GLuint()>& create) {
+  std::string path = std::string(vsh) + "|" + fsh;
+  if (*variant) path += std::string(":") + variant;
+  RESOURCE* res = Find(RESOURCE_PROGRAM, path);
+  if (res == NULL) {
+    uint64_t hash = HashFile(vsh, Hash(variant, strlen(variant)));
+    if (hash) hash = HashFile(fsh, hash);
+    res = FindByHash(RESOURCE_PROGRAM, hash);
+    if (res == NULL) {
+      GLuint program = create();
+      if (!program) return 0;
+
+      res = Register(RESOURCE_PROGRAM, path, hash);
+      res->name = program;
+      // Driver side footprint is not exposed, the binary size is the closest
+      // estimate
+      GLint length = 0;
+      glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+      res->size = length;
+      return res->name;
+    }
+  }
+  res->ref_count++;
+  return res->name;
+}
+
+void ResourceRegistry::ReleaseProgram(const GLuint program) {
+  RESOURCE* res = FindByName(RESOURCE_PROGRAM, program);
+  if (res && --res->ref_count == 0) Destroy(res);
+}
+
+//--------------------------------------------------------------------------------
+// Streaming
+//--------------------------------------------------------------------------------
+void ResourceRegistry::Stream(const int32_t budget) {
+  std::map<std::string, RESOURCE*>::iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    // Follow the level requirements of the users
+    if (it->second->type == RESOURCE_TEXTURE && it->second->ref_count)
+      it->second->cubemap->UpdateResidency();
+  }
+
+  for (it = resources_.begin(); it != resources_.end(); ++it) {
+    // Cached cubemaps resume streaming once they are acquired again
+    if (it->second->type == RESOURCE_TEXTURE && it->second->ref_count &&
+        it->second->cubemap->IsStreaming()) {
+      if (it->second->cubemap->Stream(budget)) EvictCubemaps(cache_budget_);
+      // One cubemap per frame keeps the upload within budget
+      return;
+    }
+  }
+}
+
+void ResourceRegistry::Flush() {
+  std::map<std::string, RESOURCE*>::iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    if (it->second->type != RESOURCE_TEXTURE || it->second->ref_count == 0)
+      continue;
+    while (it->second->cubemap->IsStreaming())
+      it->second->cubemap->Stream(INT32_MAX);
+  }
+  EvictCubemaps(cache_budget_);
+}
+
+//--------------------------------------------------------------------------------
+// Cache
+//--------------------------------------------------------------------------------
+void ResourceRegistry::SetCacheBudget(const int32_t budget) {
+  cache_budget_ = budget;
+  EvictCubemaps(cache_budget_);
+}
+
+//--------------------------------------------------------------------------------
+// Destroy unreferenced cubemaps, least recently used first, until the cubemap
+// residency fits in the budget
+//--------------------------------------------------------------------------------
+void ResourceRegistry::EvictCubemaps(const int32_t budget) {
+  int32_t bytes = GetCubemapBytes();
+  while (bytes > budget) {
+    RESOURCE* lru = NULL;
+    std::map<std::string, RESOURCE*>::iterator it = resources_.begin();
+    for (; it != resources_.end(); ++it) {
+      RESOURCE* res = it->second;
+      if (res->type == RESOURCE_TEXTURE && res->ref_count == 0 &&
+          (lru == NULL || res->last_used < lru->last_used))
+        lru = res;
+    }
+    // Everything left is in use
+    if (lru == NULL) return;
+
+    bytes -= GetResidentBytes(lru);
+    Destroy(lru);
+  }
+}
+
+void ResourceRegistry::SetCubemapFormat(const GLenum format) {
+  if (format == cubemap_format_) return;
+
+  cubemap_format_ = format;
+  // Pooled storage of the other format is useless as well
+  EvictUnreferenced();
+}
+
+void ResourceRegistry::EvictUnreferenced() {
+  EvictCubemaps(0);
+  TexturePool::GetInstance()->Clear();
+  UploadRing::GetInstance()->Release();
+}
+
+int32_t ResourceRegistry::GetCubemapBytes() const {
+  int32_t bytes = 0;
+  std::map<std::string, RESOURCE*>::const_iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    if (it->second->type == RESOURCE_TEXTURE)
+      bytes += GetResidentBytes(it->second);
+  }
+  return bytes;
+}
+
+//--------------------------------------------------------------------------------
+// Tiered trimming
+//--------------------------------------------------------------------------------
+void ResourceRegistry::Trim(const TRIM_LEVEL level) {
+  LOGI("Trim level %d -> %d", trim_level_, level);
+  trim_level_ = level;
+
+  const int32_t limit = level >= TRIM_LEVEL_MIPS ? CUBEMAP_TRIM_LEVEL : 0;
+  std::map<std::string, RESOURCE*>::iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    if (it->second->type == RESOURCE_TEXTURE)
+      it->second->cubemap->SetLevelLimit(limit);
+  }
+
+  if (level >= TRIM_LEVEL_INACTIVE)
+    EvictUnreferenced();
+  else
+    EvictCubemaps(cache_budget_);
+}
+
+//--------------------------------------------------------------------------------
+// Residency report
+//--------------------------------------------------------------------------------
+int32_t ResourceRegistry::GetResidentBytes(const RESOURCE* res) const {
+  if (res->type == RESOURCE_TEXTURE) return res->cubemap->GetResidentBytes();
+  return res->size;
+}
+
+int32_t ResourceRegistry::GetResidentBytes() const {
+  int32_t bytes = 0;
+  std::map<std::string, RESOURCE*>::const_iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) bytes += GetResidentBytes(it->second);
+  return bytes;
+}
+
+void ResourceRegistry::DumpResidency() const {
+  std::map<std::string, RESOURCE*>::const_iterator it = resources_.begin();
+  for (; it != resources_.end(); ++it) {
+    LOGI("Resource %s refs:%d resident:%d bytes", it->first.c_str(),
+         it->second->ref_count, GetResidentBytes(it->second));
+  }
+  LOGI("Resident total:%d bytes, cubemaps:%d/%d bytes", GetResidentBytes(),
+       GetCubemapBytes(), cache_budget_);
+  TexturePool::GetInstance()->DumpStatistics();
+  UploadRing::GetInstance()->DumpStatistics();
+}
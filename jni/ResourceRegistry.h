@@ -0,0 +1,173 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ResourceRegistry.h
+// Ref-counted GPU resources shared between renderers
+//--------------------------------------------------------------------------------
+#ifndef _RESOURCEREGISTRY_H
+#define _RESOURCEREGISTRY_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "NDKHelper.h"
+#include "CubemapTexture.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Finest cubemap level kept resident under TRIM_LEVEL_MIPS, drops 128x128
+const int32_t CUBEMAP_TRIM_LEVEL = 1;
+
+enum RESOURCE_TYPE {
+  RESOURCE_TEXTURE,
+  RESOURCE_BUFFER,
+  RESOURCE_PROGRAM,
+};
+
+struct RESOURCE {
+  RESOURCE_TYPE type;
+  std::string path;
+  uint64_t content_hash;
+  int32_t ref_count;
+  // Use stamp for the LRU order of unreferenced cubemaps
+  uint32_t last_used;
+
+  // RESOURCE_BUFFER, RESOURCE_PROGRAM
+  GLuint name;
+  int32_t size;
+  // RESOURCE_TEXTURE
+  CubemapTexture* cubemap;
+};
+
+// Memory pressure tiers, each one includes the previous ones
+enum TRIM_LEVEL {
+  TRIM_LEVEL_NONE,
+  // Drop the finest cubemap levels
+  TRIM_LEVEL_MIPS,
+  // Drop cached cubemaps of inactive stages
+  TRIM_LEVEL_INACTIVE,
+  // Drop everything, the owner unloads its resources before trimming
+  TRIM_LEVEL_ALL,
+};
+
+/******************************************************************
+ * Registry of GPU resources keyed by asset path and content hash.
+ *
+ * Acquire*() returns the existing object when the same path, or the same
+ * content under another path, has been acquired before and bumps its
+ * reference count. A cubemap that fails to load is not kept, NULL is
+ * returned. The object is destroyed when the last reference is
+ * released, except cubemaps which stay cached in LRU order while the cubemap
+ * residency fits in the cache budget so that switching back to a stage is
+ * instant.
+ * Trim() sheds memory in tiers under memory pressure.
+ *
+ * Thread safety: the registry issues GL calls and must be used on the GL
+ * thread only.
+ */
+class ResourceRegistry {
+  std::map<std::string, RESOURCE*> resources_;
+  // Further paths of the same content, found by Find() without hashing again
+  std::map<std::string, RESOURCE*> aliases_;
+  uint32_t use_clock_;
+  int32_t cache_budget_;
+  TRIM_LEVEL trim_level_;
+  GLenum cubemap_format_;
+
+  RESOURCE* Find(const RESOURCE_TYPE type, const std::string& path);
+  RESOURCE* FindByHash(const RESOURCE_TYPE type, const uint64_t hash);
+  RESOURCE* FindByName(const RESOURCE_TYPE type, const GLuint name);
+  RESOURCE* Register(const RESOURCE_TYPE type, const std::string& path,
+                     const uint64_t hash);
+  void Destroy(RESOURCE* res);
+  void EvictCubemaps(const int32_t budget);
+  CubemapTexture* AcquireTexture(
+      const std::string& path, const std::function<uint64_t()>& hash,
+      const std::function<bool(CubemapTexture*)>& load);
+  int32_t GetCubemapBytes() const;
+  int32_t GetResidentBytes(const RESOURCE* res) const;
+
+  ResourceRegistry(ResourceRegistry const&);
+  void operator=(ResourceRegistry const&);
+  ResourceRegistry();
+  virtual ~ResourceRegistry();
+
+ public:
+  static ResourceRegistry* GetInstance() {
+    //Singleton, never destroyed so that renderers can still release their
+    //resources from static destructors
+    static ResourceRegistry* instance = new ResourceRegistry();
+
+    return instance;
+  }
+
+  static uint64_t Hash(const void* data, const size_t size,
+                       const uint64_t seed = 14695981039346656037ULL);
+  static uint64_t HashFile(const char* file_name, const uint64_t seed);
+
+  static uint64_t HashCubemap(const char* file_name, const uint64_t seed);
+
+  CubemapTexture* AcquireCubemap(const char* file_name);
+  // Stages as layers of one cubemap array, see CubemapTexture::LoadArray()
+  CubemapTexture* AcquireCubemapArray(
+      const std::vector<std::string>& file_names);
+  // Octahedral chain, see CubemapTexture::LoadOctahedral()
+  CubemapTexture* AcquireOctahedral(const char* file_name);
+  void ReleaseCubemap(CubemapTexture* cubemap);
+
+  GLuint AcquireBuffer(const char* path, const GLenum target, const void* data,
+                       const int32_t size);
+  void ReleaseBuffer(const GLuint buffer);
+
+  /*
+   * create is called when neither the path pair nor the shader sources are
+   * registered yet. It returns a linked program, or 0 on failure.
+   * variant names programs patched from the same sources, "" for none.
+   */
+  GLuint AcquireProgram(const char* vsh, const char* fsh, const char* variant,
+                        const std::function<GLuint()>& create);
+  void ReleaseProgram(const GLuint program);
+
+  // Apply level requirements and refine streaming cubemaps in use, called
+  // once per frame
+  void Stream(const int32_t budget = CUBEMAP_STREAMING_BUDGET);
+  // Stream cubemaps in use to completion, e.g. to measure load times
+  void Flush();
+
+  // Budget in bytes for resident cubemaps, 0 disables caching
+  void SetCacheBudget(const int32_t budget);
+  // Format of cubemaps loaded from now on, cached ones of another format are
+  // destroyed. The owner releases the cubemaps in use beforehand.
+  void SetCubemapFormat(const GLenum format);
+  GLenum GetCubemapFormat() const { return cubemap_format_; }
+  // Destroy all unreferenced cubemaps, e.g. before the context is lost
+  void EvictUnreferenced();
+  // TRIM_LEVEL_NONE lifts a previous trim and streams dropped levels back in
+  void Trim(const TRIM_LEVEL level);
+  TRIM_LEVEL GetTrimLevel() const { return trim_level_; }
+
+  int32_t GetResidentBytes() const;
+  void DumpResidency() const;
+};
+
+#endif
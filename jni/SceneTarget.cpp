@@ -0,0 +1,259 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// SceneTarget.cpp
+// Offscreen target the scene is rendered to below the screen resolution
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+
+#include "SceneTarget.h"
+#include "GLStateCache.h"
+
+// EXT_multisampled_render_to_texture, loaded by IsImplicitResolveSupported()
+static PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC
+    glFramebufferTexture2DMultisampleEXT_ = NULL;
+static PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC
+    glRenderbufferStorageMultisampleEXT_ = NULL;
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+SceneTarget::SceneTarget()
+    : framebuffer_(0),
+      color_(0),
+      depth_(0),
+      msaa_framebuffer_(0),
+      msaa_color_(0),
+      width_(0),
+      height_(0),
+      viewport_width_(0),
+      viewport_height_(0),
+      scale_(1.f),
+      color_space_(COLOR_SPACE_GAMMA),
+      samples_(1),
+      allow_implicit_resolve_(true),
+      implicit_resolve_(false) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+SceneTarget::~SceneTarget() { Unload(); }
+
+bool SceneTarget::IsImplicitResolveSupported() {
+  if (glFramebufferTexture2DMultisampleEXT_) return true;
+  if (!ndk_helper::GLContext::GetInstance()->CheckExtension(
+          "GL_EXT_multisampled_render_to_texture"))
+    return false;
+
+  glFramebufferTexture2DMultisampleEXT_ =
+      reinterpret_cast<PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC>(
+          eglGetProcAddress("glFramebufferTexture2DMultisampleEXT"));
+  glRenderbufferStorageMultisampleEXT_ =
+      reinterpret_cast<PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC>(
+          eglGetProcAddress("glRenderbufferStorageMultisampleEXT"));
+  if (glRenderbufferStorageMultisampleEXT_ == NULL)
+    glFramebufferTexture2DMultisampleEXT_ = NULL;
+  return glFramebufferTexture2DMultisampleEXT_ != NULL;
+}
+
+bool SceneTarget::Init(const int32_t width, const int32_t height) {
+  if (framebuffer_ && width == width_ && height == height_) return true;
+  Unload();
+
+  width_ = width;
+  height_ = height;
+  const int32_t samples = std::min(samples_, GetMaxSamples());
+  implicit_resolve_ = samples > 1 && allow_implicit_resolve_ &&
+                      IsImplicitResolveSupported();
+  const bool explicit_resolve = samples > 1 && !implicit_resolve_;
+
+  GLStateCache* state = GLStateCache::GetInstance();
+  glGenTextures(1, &color_);
+  state->ActiveTexture(GL_TEXTURE0);
+  state->BindTexture(GL_TEXTURE_2D, color_);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GetColorFormat(), width_, height_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glGenRenderbuffers(1, &depth_);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+  if (implicit_resolve_)
+    glRenderbufferStorageMultisampleEXT_(GL_RENDERBUFFER, samples,
+                                         GL_DEPTH_COMPONENT24, width_,
+                                         height_);
+  else if (explicit_resolve)
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples,
+                                     GL_DEPTH_COMPONENT24, width_, height_);
+  else
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width_,
+                          height_);
+
+  glGenFramebuffers(1, &framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  if (implicit_resolve_)
+    glFramebufferTexture2DMultisampleEXT_(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          GL_TEXTURE_2D, color_, 0, samples);
+  else
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, color_, 0);
+  // Only the blit destination with the explicit resolve
+  if (!explicit_resolve)
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depth_);
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+  if (explicit_resolve && status == GL_FRAMEBUFFER_COMPLETE) {
+    glGenRenderbuffers(1, &msaa_color_);
+    glBindRenderbuffer(GL_RENDERBUFFER, msaa_color_);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples,
+                                     GetColorFormat(), width_, height_);
+    glGenFramebuffers(1, &msaa_framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, msaa_framebuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, msaa_color_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depth_);
+    status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    LOGI("Scene target incomplete: 0x%x", status);
+    Unload();
+    return false;
+  }
+
+  LOGI("Scene target %dx%d MSAA:%d%s", width_, height_, samples,
+       implicit_resolve_ ? " on tile" : "");
+  SetScale(scale_);
+  return true;
+}
+
+void SceneTarget::Unload() {
+  GLStateCache* state = GLStateCache::GetInstance();
+  if (msaa_framebuffer_) {
+    glDeleteFramebuffers(1, &msaa_framebuffer_);
+    msaa_framebuffer_ = 0;
+  }
+  if (msaa_color_) {
+    glDeleteRenderbuffers(1, &msaa_color_);
+    msaa_color_ = 0;
+  }
+  if (framebuffer_) {
+    glDeleteFramebuffers(1, &framebuffer_);
+    framebuffer_ = 0;
+  }
+  if (depth_) {
+    glDeleteRenderbuffers(1, &depth_);
+    depth_ = 0;
+  }
+  if (color_) {
+    state->DeleteTexture(color_);
+    color_ = 0;
+  }
+  width_ = height_ = 0;
+  viewport_width_ = viewport_height_ = 0;
+}
+
+void SceneTarget::SetColorSpace(const COLOR_SPACE color_space) {
+  if (color_space == color_space_) return;
+
+  color_space_ = color_space;
+  Reallocate();
+}
+
+void SceneTarget::SetSamples(const int32_t samples) {
+  if (samples == samples_) return;
+
+  samples_ = samples;
+  Reallocate();
+}
+
+void SceneTarget::SetImplicitResolve(const bool allow) {
+  if (allow == allow_implicit_resolve_) return;
+
+  allow_implicit_resolve_ = allow;
+  Reallocate();
+}
+
+void SceneTarget::Reallocate() {
+  if (framebuffer_ == 0) return;
+
+  const int32_t width = width_;
+  const int32_t height = height_;
+  Unload();
+  Init(width, height);
+}
+
+int32_t SceneTarget::GetMaxSamples() const {
+  GLint max_samples = 1;
+  glGetIntegerv(IsImplicitResolveSupported() && allow_implicit_resolve_
+                    ? GL_MAX_SAMPLES_EXT
+                    : GL_MAX_SAMPLES,
+                &max_samples);
+  return std::max(max_samples, 1);
+}
+
+GLenum SceneTarget::GetColorFormat() const {
+  switch (color_space_) {
+    case COLOR_SPACE_SRGB_SURFACE:
+      return GL_SRGB8_ALPHA8;
+    case COLOR_SPACE_LINEAR_TARGET:
+      // 10 bits keep the dark end of linear values apart
+      return GL_RGB10_A2;
+    default:
+      return GL_RGBA8;
+  }
+}
+
+bool SceneTarget::SetScale(const float scale) {
+  const int32_t width = std::max(static_cast<int32_t>(width_ * scale), 1);
+  const int32_t height = std::max(static_cast<int32_t>(height_ * scale), 1);
+  scale_ = scale;
+  if (width == viewport_width_ && height == viewport_height_) return false;
+
+  viewport_width_ = width;
+  viewport_height_ = height;
+  return true;
+}
+
+void SceneTarget::Bind() {
+  glBindFramebuffer(GL_FRAMEBUFFER,
+                    msaa_framebuffer_ ? msaa_framebuffer_ : framebuffer_);
+  glViewport(0, 0, viewport_width_, viewport_height_);
+}
+
+void SceneTarget::Resolve(const bool invalidate) {
+  if (msaa_framebuffer_) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, msaa_framebuffer_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+    glBlitFramebuffer(0, 0, viewport_width_, viewport_height_, 0, 0,
+                      viewport_width_, viewport_height_, GL_COLOR_BUFFER_BIT,
+                      GL_NEAREST);
+    if (!invalidate) return;
+    const GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+    glInvalidateFramebuffer(GL_READ_FRAMEBUFFER, 2, attachments);
+  } else if (invalidate) {
+    // With the implicit resolve the samples are dropped on tile as well
+    const GLenum attachments[] = { GL_DEPTH_ATTACHMENT };
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, attachments);
+  }
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// SceneTarget.h
+// Offscreen target the scene is rendered to below the screen resolution
+//--------------------------------------------------------------------------------
+#ifndef _SCENETARGET_H
+#define _SCENETARGET_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Where lighting happens and where its result is encoded to sRGB
+enum COLOR_SPACE {
+  // On the sRGB encoded texels, no conversion at all
+  COLOR_SPACE_GAMMA,
+  // sRGB textures, the sRGB window surface encodes on write
+  COLOR_SPACE_SRGB_SURFACE,
+  // sRGB textures, a linear target encoded by the post process
+  COLOR_SPACE_LINEAR_TARGET,
+};
+
+/******************************************************************
+ * Color texture and depth renderbuffer of the screen size. A scale below 1
+ * renders to the lower left part only, so that changing the scale never
+ * reallocates. PostProcess draws the rendered part to the default
+ * framebuffer.
+ *
+ * The color format follows the color space. The sRGB surface gets an sRGB
+ * texture so that the upscale filters linear values, the linear target a
+ * RGB10_A2 texture which the post process tonemaps and encodes.
+ *
+ * With MSAA the samples live on tile only where the driver has
+ * EXT_multisampled_render_to_texture, it resolves into the texture as the
+ * tiles are written out. Elsewhere the scene goes to multisampled
+ * renderbuffers which Resolve() blits into the texture.
+ *
+ * Thread safety: GL thread only.
+ */
+class SceneTarget {
+  GLuint framebuffer_;
+  GLuint color_;
+  GLuint depth_;
+  // Explicit resolve, the scene is rendered here and blitted to framebuffer_
+  GLuint msaa_framebuffer_;
+  GLuint msaa_color_;
+  int32_t width_;
+  int32_t height_;
+  int32_t viewport_width_;
+  int32_t viewport_height_;
+  float scale_;
+  COLOR_SPACE color_space_;
+  // Requested, 1 for none
+  int32_t samples_;
+  bool allow_implicit_resolve_;
+  bool implicit_resolve_;
+
+  GLenum GetColorFormat() const;
+  int32_t GetMaxSamples() const;
+  void Reallocate();
+
+ public:
+  SceneTarget();
+  virtual ~SceneTarget();
+
+  // Allocates for the screen size, again only when it changed
+  bool Init(const int32_t width, const int32_t height);
+  void Unload();
+  bool IsValid() const { return framebuffer_ != 0; }
+
+  // Reallocates when it changes while allocated
+  void SetColorSpace(const COLOR_SPACE color_space);
+  COLOR_SPACE GetColorSpace() const { return color_space_; }
+
+  // MSAA samples, clamped to what the driver supports. Reallocates when it
+  // changes while allocated.
+  void SetSamples(const int32_t samples);
+  int32_t GetSamples() const { return samples_; }
+  // false forces the blit, e.g. to compare both resolves
+  void SetImplicitResolve(const bool allow);
+  bool IsImplicitResolve() const { return implicit_resolve_; }
+  static bool IsImplicitResolveSupported();
+
+  // Fraction of the width and height rendered, true when it changed
+  bool SetScale(const float scale);
+  float GetScale() const { return scale_; }
+
+  // Binds the framebuffer with the scaled viewport
+  void Bind();
+  // After the scene, resolves the samples. With invalidate the samples and
+  // the depth are dropped so that neither is written back to memory
+  void Resolve(const bool invalidate);
+
+  GLuint GetTexture() const { return color_; }
+  int32_t GetWidth() const { return width_; }
+  int32_t GetHeight() const { return height_; }
+  // Rendered part
+  int32_t GetViewportWidth() const { return viewport_width_; }
+  int32_t GetViewportHeight() const { return viewport_height_; }
+};
+
+#endif
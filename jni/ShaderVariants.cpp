@@ -0,0 +1,92 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ShaderVariants.cpp
+// Programs of a shader pair keyed by feature bits
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "ShaderVariants.h"
+#include "ResourceRegistry.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+ShaderVariants::ShaderVariants() {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+ShaderVariants::~ShaderVariants() { Unload(); }
+
+void ShaderVariants::Init(const char* vsh, const char* fsh,
+                          const SHADER_FEATURE_DEFINE* defines,
+                          const int32_t num_defines,
+                          const CREATE_FUNCTION& create,
+                          const SETUP_FUNCTION& setup) {
+  Unload();
+  vsh_ = vsh;
+  fsh_ = fsh;
+  defines_.assign(defines, defines + num_defines);
+  create_ = create;
+  setup_ = setup;
+}
+
+void ShaderVariants::Unload() {
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  std::map<uint32_t, GLuint>::iterator it = programs_.begin();
+  for (; it != programs_.end(); ++it) {
+    if (it->second) registry->ReleaseProgram(it->second);
+  }
+  programs_.clear();
+}
+
+std::string ShaderVariants::GetDefines(const uint32_t features) const {
+  std::string defines;
+  for (size_t i = 0; i < defines_.size(); ++i) {
+    if ((features & defines_[i].bit) && defines_[i].define) {
+      defines += "\n#define ";
+      defines += defines_[i].define;
+    }
+  }
+  return defines;
+}
+
+GLuint ShaderVariants::Get(const uint32_t features) {
+  std::map<uint32_t, GLuint>::iterator it = programs_.find(features);
+  if (it != programs_.end()) return it->second;
+  if (!create_) return 0;
+
+  char variant[32];
+  snprintf(variant, sizeof(variant), "features %x", features);
+  const CREATE_FUNCTION& create = create_;
+  GLuint program = ResourceRegistry::GetInstance()->AcquireProgram(
+      vsh_.c_str(), fsh_.c_str(), variant,
+      [&create, features]() { return create(features); });
+  if (program) {
+    setup_(program);
+  } else {
+    LOGI("Shader variant %x of %s failed", features, fsh_.c_str());
+  }
+  programs_[features] = program;
+  return program;
+}
+
+void ShaderVariants::Prewarm(const std::vector<uint32_t>& features) {
+  for (size_t i = 0; i < features.size(); ++i) Get(features[i]);
+}
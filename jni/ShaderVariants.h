@@ -0,0 +1,89 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// ShaderVariants.h
+// Programs of a shader pair keyed by feature bits
+//--------------------------------------------------------------------------------
+#ifndef _SHADERVARIANTS_H
+#define _SHADERVARIANTS_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "NDKHelper.h"
+
+// #define of a feature bit, NULL when the create function handles the bit
+// itself, e.g. one that changes the #version line
+struct SHADER_FEATURE_DEFINE {
+  uint32_t bit;
+  const char* define;
+};
+
+/******************************************************************
+ * Programs of one shader pair, one per combination of feature bits. A
+ * combination compiles with a #define per bit and is cached by its bitmask,
+ * the registry shares it with other users of the same pair.
+ *
+ * Get() compiles a combination on first use. Prewarm() compiles a list of
+ * them up front so that the first frame that draws one does not stall on the
+ * compiler.
+ *
+ * Thread safety: GL thread only.
+ */
+class ShaderVariants {
+ public:
+  // Compiles and links the combination, GetDefines() gives its #define lines
+  typedef std::function<GLuint(const uint32_t features)> CREATE_FUNCTION;
+  // Program state after each acquire, e.g. sampler units
+  typedef std::function<void(const GLuint program)> SETUP_FUNCTION;
+
+ private:
+  std::string vsh_;
+  std::string fsh_;
+  std::vector<SHADER_FEATURE_DEFINE> defines_;
+  CREATE_FUNCTION create_;
+  SETUP_FUNCTION setup_;
+  // 0 for a combination that failed, it is not retried
+  std::map<uint32_t, GLuint> programs_;
+
+ public:
+  ShaderVariants();
+  virtual ~ShaderVariants();
+
+  void Init(const char* vsh, const char* fsh,
+            const SHADER_FEATURE_DEFINE* defines, const int32_t num_defines,
+            const CREATE_FUNCTION& create, const SETUP_FUNCTION& setup);
+  // Releases the programs, Init() stays in effect
+  void Unload();
+
+  // Lines to append to the #version line
+  std::string GetDefines(const uint32_t features) const;
+
+  // 0 when the combination does not compile
+  GLuint Get(const uint32_t features);
+  void Prewarm(const std::vector<uint32_t>& features);
+  int32_t GetProgramCount() const {
+    return static_cast<int32_t>(programs_.size());
+  }
+};
+
+#endif
@@ -21,8 +21,12 @@
 //--------------------------------------------------------------------------------
 // Include files
 //--------------------------------------------------------------------------------
+#include <string.h>
+
 #include "SkyboxRenderer.h"
 #include "TeapotRenderer.h"
+#include "GLStateCache.h"
+#include "UniformBlocks.h"
 
 
 const float M = 200.0;
@@ -41,66 +45,73 @@ static uint16_t skyboxIndices[] = {0, 1, 2, 3, 7, 1, 5, 4, 7, 6, 2, 4, 0, 1};
 //--------------------------------------------------------------------------------
 // Ctor
 //--------------------------------------------------------------------------------
-SkyboxRenderer::SkyboxRenderer() {}
+SkyboxRenderer::SkyboxRenderer()
+    : ibo_(0), vbo_(0), vao_(0), cubemap_(NULL), envmap_type_(ENVMAP_CUBEMAP) {
+  shader_param_.program_ = 0;
+}
 
 //--------------------------------------------------------------------------------
 // Dtor
 //--------------------------------------------------------------------------------
 SkyboxRenderer::~SkyboxRenderer() { Unload(); }
 
-void SkyboxRenderer::SwitchStage(const char* file_name)
+void SkyboxRenderer::SwitchStage(const char* file_name, const bool octahedral)
 {
-  LOGI("Loading Cubemap Textures");
-  if (tex_cubemap_) {
-    glDeleteTextures(1, &tex_cubemap_);
-    tex_cubemap_ = 0;
-  }
+  // Shared with TeapotRenderer. The skybox is magnified so it only ever
+  // samples the finest resident level of the prefiltered chain
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  CubemapTexture* cubemap = octahedral ? registry->AcquireOctahedral(file_name)
+                                       : registry->AcquireCubemap(file_name);
+  SetCubemap(cubemap);
+}
 
-  // Create Cubemap
-  glGenTextures(1, &tex_cubemap_);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, tex_cubemap_);
-
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-  //128x128 - 1x1 cubemaps
-  for( int32_t i = 0; i < 1; ++i )
-  {
-    const int32_t BUFFER_SIZE = 256;
-    char file_name_buffer[BUFFER_SIZE];
-
-    for(int32_t face = 0; face < 6; ++face)
-    {
-      snprintf(file_name_buffer, BUFFER_SIZE, file_name, i, face);
-      ndk_helper::JNIHelper::GetInstance()->LoadCubemapTexture(file_name_buffer,
-                                                               GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
-                                                               i,
-                                                               false);
-    }
+void SkyboxRenderer::SetStageArray(const std::vector<std::string>& file_names)
+{
+  // Same array as TeapotRenderer
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  CubemapTexture* cubemap = registry->AcquireCubemapArray(file_names);
+  SetCubemap(cubemap);
+}
+
+void SkyboxRenderer::SetCubemap(CubemapTexture* cubemap)
+{
+  if (cubemap_) {
+    cubemap_->ReleaseLevel(this);
+    ResourceRegistry::GetInstance()->ReleaseCubemap(cubemap_);
   }
-  glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+  cubemap_ = cubemap;
+  // Magnified, mip 0 unless memory is trimmed
+  if (cubemap_) cubemap_->RequireLevel(this, 0, true);
+  UpdateProgram();
+}
+
+void SkyboxRenderer::UpdateProgram()
+{
+  if (cubemap_ == NULL || cubemap_->GetType() == envmap_type_) return;
+
+  envmap_type_ = cubemap_->GetType();
+  ResourceRegistry::GetInstance()->ReleaseProgram(shader_param_.program_);
+  LoadShaders(&shader_param_, "Shaders/VS_ShaderSkybox.vsh",
+              "Shaders/ShaderSkybox.fsh", envmap_type_);
 }
 
 void SkyboxRenderer::Init() {
   // Settings
-  glFrontFace(GL_CCW);
+  GLStateCache* state = GLStateCache::GetInstance();
+  state->FrontFace(GL_CCW);
 
   // Load shader
+  envmap_type_ = ENVMAP_CUBEMAP;
   LoadShaders(&shader_param_, "Shaders/VS_ShaderSkybox.vsh",
               "Shaders/ShaderSkybox.fsh");
 
 
 
   // Create Index buffer
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
   num_indices_ = sizeof(skyboxIndices) / sizeof(skyboxIndices[0]);
-  glGenBuffers(1, &ibo_);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(skyboxIndices), skyboxIndices,
-               GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  ibo_ = registry->AcquireBuffer("skybox:indices", GL_ELEMENT_ARRAY_BUFFER,
+                                 skyboxIndices, sizeof(skyboxIndices));
 
   // Create VBO
   num_vertices_ = sizeof(skyboxPositions) / sizeof(skyboxPositions[0]) / 3;
@@ -113,13 +124,21 @@ void SkyboxRenderer::Init() {
     p[i].pos[2] = skyboxPositions[iIndex + 2];
     iIndex += 3;
   }
-  glGenBuffers(1, &vbo_);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glBufferData(GL_ARRAY_BUFFER, iStride * num_vertices_, p, GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  vbo_ = registry->AcquireBuffer("skybox:vertices", GL_ARRAY_BUFFER, p,
+                                 iStride * num_vertices_);
 
   delete[] p;
 
+  // Positions only
+  glGenVertexArrays(1, &vao_);
+  state->BindVertexArray(vao_);
+  state->BindBuffer(GL_ARRAY_BUFFER, vbo_);
+  glVertexAttribPointer(ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, iStride,
+                        BUFFER_OFFSET(0));
+  glEnableVertexAttribArray(ATTRIB_VERTEX);
+  state->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+  state->BindVertexArray(0);
+
   UpdateViewport();
   mat_model_ = ndk_helper::Mat4::Translation(0, 0, -15.f);
 
@@ -152,110 +171,100 @@ void SkyboxRenderer::UpdateViewport() {
 }
 
 void SkyboxRenderer::Unload() {
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  if (vao_) {
+    GLStateCache::GetInstance()->DeleteVertexArray(vao_);
+    vao_ = 0;
+  }
+
   if (vbo_) {
-    glDeleteBuffers(1, &vbo_);
+    registry->ReleaseBuffer(vbo_);
     vbo_ = 0;
   }
 
   if (ibo_) {
-    glDeleteBuffers(1, &ibo_);
+    registry->ReleaseBuffer(ibo_);
     ibo_ = 0;
   }
 
-  if (tex_cubemap_) {
-    glDeleteTextures(1, &tex_cubemap_);
-    tex_cubemap_ = 0;
-  }
+  SetCubemap(NULL);
 
   if (shader_param_.program_) {
-    glDeleteProgram(shader_param_.program_);
+    registry->ReleaseProgram(shader_param_.program_);
     shader_param_.program_ = 0;
   }
 }
 
-void SkyboxRenderer::Update(const double time) {
+void SkyboxRenderer::Update(const FRAME_PACKET& frame) {
   const float CAM_X = 0.f;
   const float CAM_Y = 0.f;
   const float CAM_Z = 700.f;
 
+  // The stage does not follow the camera of the frame
   mat_view_ = ndk_helper::Mat4::LookAt(ndk_helper::Vec3(CAM_X, CAM_Y, CAM_Z),
                                        ndk_helper::Vec3(0.f, 0.f, 0.f),
                                        ndk_helper::Vec3(0.f, 1.f, 0.f));
-
-  if (camera_) {
-    camera_->Update(time);
-    mat_view_ = camera_->GetTransformMatrix() * mat_view_ *
-                camera_->GetRotationMatrix() * mat_model_;
-  } else {
-    mat_view_ = mat_view_ * mat_model_;
-  }
+  mat_view_ = mat_view_ * mat_model_;
 }
 
-void SkyboxRenderer::Render() {
+void SkyboxRenderer::Render(RenderQueue* queue) {
+  // The stage failed to load
+  if (cubemap_ == NULL) return;
 
-  // Feed Projection and Model View matrices to the shaders
+  // Feed Projection and Model View matrices to the shaders, the stage layers
+  // come from the frame block of TeapotRenderer
   ndk_helper::Mat4 mat_vp = mat_projection_ * mat_view_;
-
-  // Bind the VBO
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-
-  int32_t iStride = sizeof(SKYBOX_VERTEX);
-  // Pass the vertex data
-  glVertexAttribPointer(ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, iStride,
-                        BUFFER_OFFSET(0));
-  glEnableVertexAttribArray(ATTRIB_VERTEX);
-
-  glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, iStride,
-                        BUFFER_OFFSET(3 * sizeof(GLfloat)));
-  glEnableVertexAttribArray(ATTRIB_NORMAL);
-
-  // Bind the IB
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
-
-  // Set cubemap
-  glEnable( GL_TEXTURE_CUBE_MAP );
-  glActiveTexture( GL_TEXTURE0 );
-  glBindTexture( GL_TEXTURE_CUBE_MAP, tex_cubemap_ );
-
-  glUseProgram(shader_param_.program_);
-
-  glUniformMatrix4fv(shader_param_.matrix_projection_, 1, GL_FALSE,
-                     mat_vp.Ptr());
-  glUniformMatrix4fv(shader_param_.matrix_view_, 1, GL_FALSE, mat_view_.Ptr());
-
-  glUniform1i( shader_param_.sampler0_, 0 );
-
-  glDrawElements(GL_TRIANGLE_STRIP, num_indices_, GL_UNSIGNED_SHORT,
-                 BUFFER_OFFSET(0));
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  OBJECT_UNIFORMS object;
+  memcpy(object.model_view, mat_view_.Ptr(), sizeof(object.model_view));
+  memcpy(object.model_view_projection, mat_vp.Ptr(),
+         sizeof(object.model_view_projection));
+  memset(object.material, 0, sizeof(object.material));
+
+  // Last, at the far plane
+  DRAW_PACKET packet;
+  packet.key = RenderQueue::MakeKey(RENDER_PASS_SKY, shader_param_.program_, 0,
+                                    cubemap_->GetTexture(), 1.f);
+  packet.program = shader_param_.program_;
+  packet.vertex_array = vao_;
+  packet.texture_target = cubemap_->GetTarget();
+  packet.texture = cubemap_->GetTexture();
+  packet.object = UniformBlocks::GetInstance()->AddObject(object);
+  packet.mode = GL_TRIANGLE_STRIP;
+  packet.count = num_indices_;
+  packet.index_type = GL_UNSIGNED_SHORT;
+  packet.first_index = 0;
+  packet.instances = 0;
+  queue->Push(packet);
 }
 
-bool SkyboxRenderer::LoadShaders(SHADER_PARAMS_SKYBOX* params, const char* strVsh,
-                                 const char* strFsh) {
+GLuint SkyboxRenderer::CreateProgram(const char* strVsh, const char* strFsh,
+                                     const ENVMAP_TYPE envmap_type) {
   GLuint program;
   GLuint vert_shader, frag_shader;
-  char* vert_shader_pathname, *frag_shader_pathname;
 
   // Create shader program
   program = glCreateProgram();
   LOGI("Created Shader %d", program);
 
+  // Samples a samplerCubeArray or an octahedral sampler2D instead of a
+  // samplerCube
+  std::map<std::string, std::string> params;
+  CubemapTexture::GetShaderParams(envmap_type, &params);
+
   // Create and compile vertex shader
   if (!ndk_helper::shader::CompileShader(&vert_shader, GL_VERTEX_SHADER,
-                                         strVsh)) {
+                                         strVsh, params)) {
     LOGI("Failed to compile vertex shader");
     glDeleteProgram(program);
-    return false;
+    return 0;
   }
 
   // Create and compile fragment shader
   if (!ndk_helper::shader::CompileShader(&frag_shader, GL_FRAGMENT_SHADER,
-                                         strFsh)) {
+                                         strFsh, params)) {
     LOGI("Failed to compile fragment shader");
     glDeleteProgram(program);
-    return false;
+    return 0;
   }
 
   // Attach vertex shader to program
@@ -284,24 +293,31 @@ bool SkyboxRenderer::LoadShaders(SHADER_PARAMS_SKYBOX* params, const char* strVs
       glDeleteProgram(program);
     }
 
-    return false;
+    return 0;
   }
 
-  // Get uniform locations
-  params->matrix_projection_ = glGetUniformLocation(program, "uPMatrix");
-  params->matrix_view_ = glGetUniformLocation(program, "uMVMatrix");
-  params->sampler0_ = glGetUniformLocation( program, "sCubemapTexture" );
-
-
   // Release vertex and fragment shaders
   if (vert_shader) glDeleteShader(vert_shader);
   if (frag_shader) glDeleteShader(frag_shader);
 
-  params->program_ = program;
-  return true;
+  return program;
 }
 
-bool SkyboxRenderer::Bind(ndk_helper::TapCamera* camera) {
-  camera_ = camera;
+bool SkyboxRenderer::LoadShaders(SHADER_PARAMS_SKYBOX* params, const char* strVsh,
+                                 const char* strFsh, const ENVMAP_TYPE envmap_type) {
+  // Programs are shared through the registry, only the first user compiles
+  GLuint program = ResourceRegistry::GetInstance()->AcquireProgram(
+      strVsh, strFsh, CubemapTexture::GetShaderVariant(envmap_type),
+      [this, strVsh, strFsh, envmap_type]() {
+        return CreateProgram(strVsh, strFsh, envmap_type);
+      });
+  if (!program) return false;
+
+  // Program state, the same for every user of a shared program
+  UniformBlocks::BindProgram(program);
+  GLStateCache::GetInstance()->UseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "sCubemapTexture"), 0);
+
+  params->program_ = program;
   return true;
 }
@@ -39,6 +39,9 @@
 #include <cpu-features.h>
 
 #include "NDKHelper.h"
+#include "RenderQueue.h"
+#include "FramePackets.h"
+#include "ResourceRegistry.h"
 
 #define BUFFER_OFFSET(i) ((char*)NULL + (i))
 
@@ -46,12 +49,9 @@ struct SKYBOX_VERTEX {
   float pos[3];
 };
 
+// Uniforms are in the blocks of UniformBlocks.h
 struct SHADER_PARAMS_SKYBOX {
   GLuint program_;
-
-  GLuint matrix_projection_;
-  GLuint matrix_view_;
-  GLuint sampler0_;
 };
 
 class SkyboxRenderer {
@@ -59,29 +59,38 @@ class SkyboxRenderer {
   int32_t num_vertices_;
   GLuint ibo_;
   GLuint vbo_;
-  GLuint tex_cubemap_;
+  GLuint vao_;
+  CubemapTexture* cubemap_;
+  // Sampler the program is compiled for
+  ENVMAP_TYPE envmap_type_;
 
   SHADER_PARAMS_SKYBOX shader_param_;
+  GLuint CreateProgram(const char* strVsh, const char* strFsh,
+                       const ENVMAP_TYPE envmap_type);
   bool LoadShaders(SHADER_PARAMS_SKYBOX* params, const char* strVsh,
-                   const char* strFsh);
+                   const char* strFsh,
+                   const ENVMAP_TYPE envmap_type = ENVMAP_CUBEMAP);
+  void UpdateProgram();
+  void SetCubemap(CubemapTexture* cubemap);
 
   ndk_helper::Mat4 mat_projection_;
   ndk_helper::Mat4 mat_view_;
   ndk_helper::Mat4 mat_model_;
 
-  ndk_helper::TapCamera* camera_;
-
  public:
   SkyboxRenderer();
   virtual ~SkyboxRenderer();
   void Init();
-  void Render();
-  void Update(const double time);
-  bool Bind(ndk_helper::TapCamera* camera);
+  // Pushes the skybox into the sky pass, drawn by RenderQueue::Execute()
+  void Render(RenderQueue* queue);
+  // Every pixel, the cube is drawn at the far plane around the eye
+  bool IsCovering() const { return shader_param_.program_ && cubemap_; }
+  void Update(const FRAME_PACKET& frame);
   void Unload();
   void UpdateViewport();
 
-  void SwitchStage(const char* fileName);
+  void SwitchStage(const char* file_name, const bool octahedral = false);
+  void SetStageArray(const std::vector<std::string>& file_names);
 };
 
 #endif
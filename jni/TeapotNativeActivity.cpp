@@ -19,6 +19,9 @@
 //--------------------------------------------------------------------------------
 #include <jni.h>
 #include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include <android/sensor.h>
 #include <android/log.h>
@@ -28,6 +31,16 @@
 
 #include "TeapotRenderer.h"
 #include "SkyboxRenderer.h"
+#include "Benchmark.h"
+#include "GLStateCache.h"
+#include "UniformBlocks.h"
+#include "DynamicRing.h"
+#include "SceneTarget.h"
+#include "PostProcess.h"
+#include "ResolutionController.h"
+#include "RenderQueue.h"
+#include "CommandQueue.h"
+#include "FramePackets.h"
 #include "NDKHelper.h"
 #include "jui_helper/JavaUI.h"
 
@@ -41,9 +54,65 @@
 // Share object name of helper function library
 #define HELPER_CLASS_SONAME "TeapotNativeActivity"
 
+//-------------------------------------------------------------------------
+//Constants
+//-------------------------------------------------------------------------
+// Keeps all stages fully resident, 512KB each
+const int32_t STAGE_CACHE_BUDGET = 3 * 1024 * 1024;
+
+// Keep all stages in one cubemap array when supported.
+// ENVMAP_OCTAHEDRAL loads the octahedral maps of the stages that have one.
+const ENVMAP_TYPE STAGE_ENVMAP_TYPE = ENVMAP_CUBEMAP_ARRAY;
+// Cross fade time between stages in the cubemap array mode, in seconds
+const double STAGE_BLEND_TIME = 0.5;
+
+// Window buffer size relative to the window, below 1 the compositor upscales
+const float WINDOW_BUFFER_SCALE = 1.f;
+// Buffer scale of the hardware scaler benchmark scenario
+const float BENCHMARK_BUFFER_SCALE = 0.75f;
+
+// Samples of the window surface, fixed for the life of the context. The
+// driver resolves them on tile.
+const int32_t WINDOW_MSAA_SAMPLES = 1;
+// Samples of the scene target, which takes the scene offscreen above 1
+const int32_t SCENE_MSAA_SAMPLES = 1;
+
+// Lighting in linear space, the linear target when sRGB surfaces are missing
+const COLOR_SPACE WINDOW_COLOR_SPACE = COLOR_SPACE_SRGB_SURFACE;
+// Post process of the linear target
+const int32_t LINEAR_POST_FEATURES =
+    POST_TONEMAP | POST_SRGB_ENCODE | POST_DITHER;
+
+// 0.5 gray as written by the gamma space, and decoded for the linear spaces
+const float CLEAR_GRAY_GAMMA = 0.5f;
+const float CLEAR_GRAY_LINEAR = 0.214f;
+
+// Teapots along each side of the benchmark stress grid
+const int32_t STRESS_GRID_SIZE = 50;
+
+// ComponentCallbacks2 levels passed to onTrimMemory()
+const int32_t TRIM_MEMORY_RUNNING_CRITICAL = 15;
+const int32_t TRIM_MEMORY_MODERATE = 60;
+
+// Commands from the UI and input threads, consumed by the simulation thread
+enum ENGINE_COMMAND {
+  COMMAND_CAMERA_RESET,
+  COMMAND_CAMERA_BEGIN_DRAG,
+  COMMAND_CAMERA_DRAG,
+  COMMAND_CAMERA_END_DRAG,
+  COMMAND_CAMERA_BEGIN_PINCH,
+  COMMAND_CAMERA_PINCH,
+  COMMAND_SET_ROUGHNESS,
+  COMMAND_SET_MATERIAL,
+  COMMAND_SET_STAGE,
+  COMMAND_START_BENCHMARK,
+};
+
 struct RENDERER_STAGE {
   const char* stage_name;
   const char* file_name;
+  // Written by tools/octahedral_converter.cpp, NULL for none
+  const char* octahedral_file_name;
 };
 
 
@@ -54,6 +123,18 @@ struct android_app;
 class Engine {
   TeapotRenderer renderer_;
   SkyboxRenderer skybox_renderer_;
+  // Draws of both renderers, sorted by state
+  RenderQueue render_queue_;
+
+  // Dynamic resolution, the scene goes offscreen below the full scale
+  SceneTarget scene_target_;
+  PostProcess post_process_;
+  ResolutionController resolution_;
+  bool dynamic_resolution_;
+  bool offscreen_;
+  COLOR_SPACE color_space_;
+  // Invalidation and skipped clears of the default framebuffer
+  bool framebuffer_hints_;
 
   ndk_helper::GLContext* gl_context_;
 
@@ -65,8 +146,6 @@ class Engine {
   ndk_helper::DragDetector drag_detector_;
   ndk_helper::PerfMonitor monitor_;
 
-  ndk_helper::TapCamera tap_camera_;
-
   android_app* app_;
 
   ASensorManager* sensor_manager_;
@@ -76,12 +155,61 @@ class Engine {
   int32_t current_stage_;
   bool stage_updated_;
 
+  // Stage residency, ENVMAP_CUBEMAP_ARRAY switches stages by layer
+  ENVMAP_TYPE envmap_type_;
+  int32_t active_stage_;
+  int32_t previous_stage_;
+  double stage_switch_time_;
+
+  TRIM_LEVEL trim_level_;
+  bool resources_trimmed_;
+  // Set by the Java thread, consumed on the GL thread
+  std::atomic<int32_t> pending_trim_level_;
+
+  Benchmark benchmark_;
+  bool benchmark_requested_;
+
+  // Simulation thread, owns the camera and the settings of the UI. Runs one
+  // frame ahead of the GL thread and hands over a FRAME_PACKET per frame.
+  std::thread simulation_thread_;
+  CommandQueue commands_;
+  FramePackets frames_;
+  ndk_helper::TapCamera tap_camera_;
+  float sim_roughness_;
+  int32_t sim_material_;
+  int32_t sim_stage_;
+  int32_t sim_benchmark_requests_;
+  // UI thread, selections shown on the buttons
+  int32_t ui_material_;
+  int32_t ui_stage_;
+  // GL thread, changes of the packet are applied once
+  int32_t applied_stage_;
+  int32_t applied_benchmark_requests_;
 
   void UpdateFPS(float fFPS);
   void ShowUI();
   void InitUI();
   void UpdateStage();
+  void UpdateStageBlend();
+  void SetEnvmapType(const ENVMAP_TYPE type);
+  void StartBenchmark();
+  void ResetStressScenario();
+  void UpdateScreenSize();
+  void SetBufferScale(const float scale);
+  void SetColorSpace(const COLOR_SPACE color_space);
+  void BeginScene();
+  void ClearScene();
+  void EndScene();
   void TransformPosition(ndk_helper::Vec2& vec);
+  void PushCommand(const ENGINE_COMMAND type, const int32_t value = 0,
+                   const float x = 0.f, const float y = 0.f,
+                   const float z = 0.f, const float w = 0.f);
+  void PushCommand(const ENGINE_COMMAND type, ndk_helper::Vec2 v1,
+                   ndk_helper::Vec2 v2 = ndk_helper::Vec2());
+  void ProcessCommand(const COMMAND& command);
+  void Simulate(FRAME_PACKET* frame);
+  void RunSimulation();
+  void ApplyFrame(const FRAME_PACKET& frame);
 
   static RENDERER_STAGE stages_[];
   static const int32_t NUM_STAGES;
@@ -99,8 +227,13 @@ class Engine {
   void LoadResources();
   void UnloadResources();
   void DrawFrame();
+  void StartSimulation();
+  void StopSimulation();
   void TermDisplay(const int32_t cmd);
-  void TrimMemory();
+  void TrimMemory(const TRIM_LEVEL level);
+  void RestoreMemory();
+  void RequestTrimMemory(const int32_t android_level);
+  void ProcessTrimRequest();
   bool IsReady();
 
   void UpdatePosition(AInputEvent* event, int32_t iIndex, float& fX, float& fY);
@@ -113,10 +246,16 @@ class Engine {
 
 RENDERER_STAGE Engine::stages_[] =
 {
-    {"St Peters", "cubemaps/stpeters_phong_m%02d_c%02d.bmp"},
-    {"Eucalyptus Grove", "cubemaps/rnl_phong_m%02d_c%02d.bmp"},
-    {"Uffizi Gallery", "cubemaps/uffizi_phong_m%02d_c%02d.bmp"},
-    {"None", "none"},
+    {"St Peters", "cubemaps/stpeters_phong_m%02d_c%02d.bmp",
+     "cubemaps/stpeters_oct_m%02d.bmp"},
+    {"Eucalyptus Grove", "cubemaps/rnl_phong_m%02d_c%02d.bmp",
+     "cubemaps/rnl_oct_m%02d.bmp"},
+    {"Uffizi Gallery", "cubemaps/uffizi_phong_m%02d_c%02d.bmp",
+     "cubemaps/uffizi_oct_m%02d.bmp"},
+    //Single cross images, the chain is built at load time
+    {"St Peters (Cross)", "cubemaps/stpeters_cross.bmp", NULL},
+    {"Eucalyptus Grove (Cross)", "cubemaps/rnl_cross.bmp", NULL},
+    {"None", "none", NULL},
 };
 const int32_t Engine::NUM_STAGES = sizeof(Engine::stages_)/sizeof(Engine::stages_[0]);
 
@@ -124,14 +263,38 @@ const int32_t Engine::NUM_STAGES = sizeof(Engine::stages_)/sizeof(Engine::stages
 //Ctor
 //-------------------------------------------------------------------------
 Engine::Engine()
-    : initialized_resources_(false),
-      current_stage_(0),
+    : dynamic_resolution_(true),
+      offscreen_(false),
+      color_space_(COLOR_SPACE_GAMMA),
+      framebuffer_hints_(true),
+      initialized_resources_(false),
       has_focus_(false),
       app_(NULL),
       sensor_manager_(NULL),
       accelerometer_sensor_(NULL),
-      sensor_event_queue_(NULL) {
+      sensor_event_queue_(NULL),
+      current_stage_(0),
+      stage_updated_(false),
+      envmap_type_(STAGE_ENVMAP_TYPE),
+      active_stage_(0),
+      previous_stage_(0),
+      stage_switch_time_(0.0),
+      trim_level_(TRIM_LEVEL_NONE),
+      resources_trimmed_(false),
+      pending_trim_level_(TRIM_LEVEL_NONE),
+      benchmark_requested_(false),
+      sim_roughness_(0.f),
+      sim_material_(0),
+      sim_stage_(0),
+      sim_benchmark_requests_(0),
+      ui_material_(0),
+      ui_stage_(0),
+      applied_stage_(0),
+      applied_benchmark_requests_(0) {
   gl_context_ = ndk_helper::GLContext::GetInstance();
+
+  tap_camera_.SetFlip(1.f, -1.f, -1.f);
+  tap_camera_.SetPinchTransformFactor(2.f, 2.f, 8.f);
 }
 
 //-------------------------------------------------------------------------
@@ -145,17 +308,286 @@ Engine::~Engine() {
  * Load resources
  */
 void Engine::LoadResources() {
+  // Possibly a new context
+  GLStateCache::GetInstance()->Invalidate();
   renderer_.Init();
-  renderer_.Bind(&tap_camera_);
   skybox_renderer_.Init();
-//  skybox_renderer_.Bind(&tap_camera_);
+  scene_target_.Init(gl_context_->GetScreenWidth(),
+                     gl_context_->GetScreenHeight());
+  post_process_.Init();
+
+  SetEnvmapType(envmap_type_);
+}
+
+/**
+ * Switch the stage residency, the renderers pick the matching program variant
+ */
+void Engine::SetEnvmapType(const ENVMAP_TYPE type) {
+  envmap_type_ = type;
+  if (envmap_type_ == ENVMAP_CUBEMAP_ARRAY &&
+      !CubemapTexture::IsArraySupported()) {
+    LOGI("Cubemap arrays are not supported, loading stages individually");
+    envmap_type_ = ENVMAP_CUBEMAP;
+  }
+
+  if (envmap_type_ == ENVMAP_CUBEMAP_ARRAY) {
+    //All stages are resident, switching is a uniform change
+    std::vector<std::string> file_names;
+    for (int32_t i = 0; i < NUM_STAGES; ++i)
+      file_names.push_back(stages_[i].file_name);
+    renderer_.SetStageArray(file_names);
+    skybox_renderer_.SetStageArray(file_names);
+    active_stage_ = previous_stage_ = current_stage_;
+  }
   UpdateStage();
 }
 
 void Engine::UpdateStage()
 {
-  renderer_.SwitchStage(stages_[current_stage_].file_name);
-  skybox_renderer_.SwitchStage(stages_[current_stage_].file_name);
+  if (envmap_type_ == ENVMAP_CUBEMAP_ARRAY) {
+    //Cross fade from the stage on screen
+    previous_stage_ = active_stage_;
+    active_stage_ = current_stage_;
+    stage_switch_time_ = monitor_.GetCurrentTime();
+    UpdateStageBlend();
+    return;
+  }
+
+  //Both renderers share one cubemap through the resource registry
+  const RENDERER_STAGE& stage = stages_[current_stage_];
+  const bool octahedral =
+      envmap_type_ == ENVMAP_OCTAHEDRAL && stage.octahedral_file_name;
+  const char* file_name =
+      octahedral ? stage.octahedral_file_name : stage.file_name;
+  renderer_.SwitchStage(file_name, octahedral);
+  skybox_renderer_.SwitchStage(file_name, octahedral);
+  ResourceRegistry::GetInstance()->DumpResidency();
+}
+
+/**
+ * Cold and warm stage loads, samplerCube against octahedral sampling on the
+ * stages that have both, then each mesh LOD against the full mesh
+ */
+void Engine::StartBenchmark() {
+  if (benchmark_.IsRunning()) return;
+
+  const ENVMAP_TYPE envmap_type = envmap_type_;
+  const int32_t stage = current_stage_;
+  benchmark_.Clear();
+  //Full resolution unless a scenario asks for it
+  dynamic_resolution_ = false;
+
+  //A face set and a cross converted at load time
+  const int32_t load_stages[] = { 0, 3 };
+  for (int32_t i : load_stages) {
+    for (int32_t cold = 1; cold >= 0; --cold) {
+      std::string name = stages_[i].stage_name;
+      name += cold ? " cold load" : " warm load";
+      benchmark_.AddScenario(
+          name.c_str(),
+          [this, i]() {
+            current_stage_ = i;
+            envmap_type_ = ENVMAP_CUBEMAP;
+            UpdateStage();
+            ResourceRegistry::GetInstance()->Flush();
+            ImageCache::GetInstance()->DumpStatistics();
+          },
+          [this, cold]() {
+            //Nothing of the stage may stay resident
+            renderer_.SwitchStage("none");
+            skybox_renderer_.SwitchStage("none");
+            ResourceRegistry::GetInstance()->EvictUnreferenced();
+            if (cold) ImageCache::GetInstance()->Clear();
+            ImageCache::GetInstance()->ResetStatistics();
+          });
+    }
+  }
+
+  for (int32_t i = 0; i < NUM_STAGES; ++i) {
+    if (stages_[i].octahedral_file_name == NULL) continue;
+
+    std::string name = stages_[i].stage_name;
+    benchmark_.AddScenario((name + " samplerCube").c_str(), [this, i]() {
+      current_stage_ = i;
+      SetEnvmapType(ENVMAP_CUBEMAP);
+    });
+    benchmark_.AddScenario((name + " octahedral").c_str(), [this, i]() {
+      current_stage_ = i;
+      SetEnvmapType(ENVMAP_OCTAHEDRAL);
+    });
+  }
+
+  benchmark_.AddCounter("triangles",
+                        [this]() { return renderer_.GetTriangleCount(); });
+  GLStateCache* state = GLStateCache::GetInstance();
+  benchmark_.AddCounter("GL state calls issued",
+                        [state]() { return state->GetIssuedCalls(); });
+  benchmark_.AddCounter("GL state calls filtered",
+                        [state]() { return state->GetFilteredCalls(); });
+  benchmark_.AddCounter("draws",
+                        [this]() { return render_queue_.GetDrawCount(); });
+  benchmark_.AddCounter("shader variants",
+                        [this]() { return renderer_.GetVariantCount(); });
+  benchmark_.AddCounter("resolution scale %", [this]() {
+    return static_cast<int32_t>((offscreen_ ? scene_target_.GetScale() : 1.f) *
+                                100.f);
+  });
+  DynamicRing* ring = DynamicRing::GetInstance();
+  benchmark_.AddCounter("dynamic ring stall us",
+                        [ring]() { return ring->GetStallMicroseconds(); });
+  benchmark_.AddCounter("dynamic ring bytes",
+                        [ring]() { return ring->GetBytes(); });
+  int32_t full_detail = -1;
+  for (int32_t lod = 0; lod < renderer_.GetLodCount(); ++lod) {
+    char name[32];
+    snprintf(name, sizeof(name), "Teapot LOD %d", lod);
+    const int32_t scenario = benchmark_.AddScenario(
+        name, [this, lod]() { renderer_.SetLodOverride(lod); });
+    if (lod == 0)
+      full_detail = scenario;
+    else
+      benchmark_.SetBaseline(scenario, full_detail);
+  }
+  const int32_t selected = benchmark_.AddScenario(
+      "Teapot LOD by screen size", [this]() { renderer_.SetLodOverride(-1); });
+  benchmark_.SetBaseline(selected, full_detail);
+
+  //Stress scene, the same grid of teapots as separate draws and instanced.
+  //Every knob is reset before a scenario, which then changes the one it
+  //measures
+  const int32_t per_draw = benchmark_.AddScenario(
+      "Stress per-draw", []() {}, [this]() { ResetStressScenario(); });
+  //The material variant against the full diffuse path, same for plastic
+  const int32_t full_shader = benchmark_.AddScenario(
+      "Stress per-draw without shader variants",
+      [this]() { renderer_.SetSelectVariants(false); },
+      [this]() { ResetStressScenario(); });
+  benchmark_.SetBaseline(full_shader, per_draw);
+  const int32_t instanced = benchmark_.AddScenario(
+      "Stress instanced", [this]() { renderer_.SetInstancing(true); },
+      [this]() { ResetStressScenario(); });
+  benchmark_.SetBaseline(instanced, per_draw);
+  const int32_t dynamic = benchmark_.AddScenario(
+      "Stress per-draw dynamic resolution",
+      [this]() {
+        resolution_.Reset();
+        dynamic_resolution_ = true;
+      },
+      [this]() { ResetStressScenario(); });
+  benchmark_.SetBaseline(dynamic, per_draw);
+  const int32_t scaler = benchmark_.AddScenario(
+      "Stress per-draw hardware scaler",
+      [this]() { SetBufferScale(BENCHMARK_BUFFER_SCALE); },
+      [this]() { ResetStressScenario(); });
+  benchmark_.SetBaseline(scaler, per_draw);
+
+  //Tile bandwidth, full clears and depth written back on swap
+  const int32_t no_hints = benchmark_.AddScenario(
+      "Stress per-draw without framebuffer hints",
+      [this]() { framebuffer_hints_ = false; },
+      [this]() { ResetStressScenario(); });
+  benchmark_.SetBaseline(no_hints, per_draw);
+  //MSAA through the scene target, resolved on tile where supported
+  const int32_t msaa_samples[] = { 2, 4 };
+  int32_t msaa = -1;
+  for (int32_t samples : msaa_samples) {
+    char name[64];
+    snprintf(name, sizeof(name), "Stress per-draw MSAA %dx", samples);
+    msaa = benchmark_.AddScenario(
+        name, [this, samples]() { scene_target_.SetSamples(samples); },
+        [this]() { ResetStressScenario(); });
+    benchmark_.SetBaseline(msaa, per_draw);
+  }
+  if (SceneTarget::IsImplicitResolveSupported()) {
+    const int32_t blit = benchmark_.AddScenario(
+        "Stress per-draw MSAA 4x blit resolve",
+        [this]() { scene_target_.SetImplicitResolve(false); },
+        [this]() {
+          ResetStressScenario();
+          scene_target_.SetSamples(4);
+        });
+    benchmark_.SetBaseline(blit, msaa);
+  }
+
+  //Linear space lighting against the gamma space output of the stress scene
+  const COLOR_SPACE color_spaces[] = { COLOR_SPACE_GAMMA,
+                                       COLOR_SPACE_SRGB_SURFACE,
+                                       COLOR_SPACE_LINEAR_TARGET };
+  const char* color_space_names[] = { "gamma space", "sRGB surface",
+                                      "linear target" };
+  const int32_t num_color_spaces =
+      sizeof(color_spaces) / sizeof(color_spaces[0]);
+  int32_t gamma_space = -1;
+  int32_t linear_target = -1;
+  for (int32_t i = 0; i < num_color_spaces; ++i) {
+    const COLOR_SPACE color_space = color_spaces[i];
+    std::string name = "Stress per-draw ";
+    name += color_space_names[i];
+    const int32_t scenario = benchmark_.AddScenario(
+        name.c_str(), []() {},
+        [this, color_space]() {
+          //Reloads the stages in the texture format of the color space
+          ResetStressScenario();
+          SetColorSpace(color_space);
+          ResourceRegistry::GetInstance()->Flush();
+        });
+    if (color_space == COLOR_SPACE_GAMMA)
+      gamma_space = scenario;
+    else
+      benchmark_.SetBaseline(scenario, gamma_space);
+    if (color_space == COLOR_SPACE_LINEAR_TARGET) linear_target = scenario;
+  }
+  //Cost of tonemap and dither on top of the encode in the fused pass
+  const int32_t encode_only = benchmark_.AddScenario(
+      "Stress per-draw linear target encode only",
+      [this]() {
+        post_process_.SetFeatures(POST_SRGB_ENCODE);
+        post_process_.Init();
+      },
+      [this]() {
+        ResetStressScenario();
+        SetColorSpace(COLOR_SPACE_LINEAR_TARGET);
+        ResourceRegistry::GetInstance()->Flush();
+      });
+  benchmark_.SetBaseline(encode_only, linear_target);
+
+  benchmark_.SetDoneCallback([this, envmap_type, stage]() {
+    current_stage_ = stage;
+    SetEnvmapType(envmap_type);
+    DynamicRing::GetInstance()->DumpStatistics();
+    ResetStressScenario();
+    //Back to the interactive scene
+    renderer_.SetInstanceGrid(0);
+    renderer_.SetInstancing(true);
+    dynamic_resolution_ = true;
+  });
+  benchmark_.Start();
+}
+
+/**
+ * Default of every knob a stress scenario changes, the grid as separate draws
+ * with shader variants at full resolution in the window color space
+ */
+void Engine::ResetStressScenario() {
+  renderer_.SetLodOverride(-1);
+  renderer_.SetInstanceGrid(STRESS_GRID_SIZE);
+  renderer_.SetInstancing(false);
+  renderer_.SetSelectVariants(true);
+  dynamic_resolution_ = false;
+  SetBufferScale(WINDOW_BUFFER_SCALE);
+  framebuffer_hints_ = true;
+  scene_target_.SetImplicitResolve(true);
+  scene_target_.SetSamples(SCENE_MSAA_SAMPLES);
+  //Also the post process features of the color space
+  SetColorSpace(WINDOW_COLOR_SPACE);
+}
+
+void Engine::UpdateStageBlend()
+{
+  const double elapsed = monitor_.GetCurrentTime() - stage_switch_time_;
+  const float blend =
+      static_cast<float>(std::max(1.0 - elapsed / STAGE_BLEND_TIME, 0.0));
+  renderer_.SetStageLayers(active_stage_, previous_stage_, blend);
 }
 
 /**
@@ -164,6 +596,12 @@ void Engine::UpdateStage()
 void Engine::UnloadResources() {
   renderer_.Unload();
   skybox_renderer_.Unload();
+  //Cached stages would not survive a context loss either
+  ResourceRegistry::GetInstance()->EvictUnreferenced();
+  UniformBlocks::GetInstance()->Release();
+  DynamicRing::GetInstance()->Release();
+  scene_target_.Unload();
+  post_process_.Unload();
 }
 
 /**
@@ -171,8 +609,14 @@ void Engine::UnloadResources() {
  */
 int Engine::InitDisplay(const int32_t cmd) {
   if (!initialized_resources_) {
-    gl_context_->Init(app_->window);
+    gl_context_->SetBufferScale(WINDOW_BUFFER_SCALE);
+    gl_context_->SetSRGBSurface(WINDOW_COLOR_SPACE == COLOR_SPACE_SRGB_SURFACE);
+    gl_context_->Init(app_->window, WINDOW_MSAA_SAMPLES);
     gl_context_->SetSwapInterval(0);  //Set interval of 0 for a benchmark
+    ResourceRegistry::GetInstance()->SetCacheBudget(STAGE_CACHE_BUDGET);
+    //Texture formats and the scene target before anything loads
+    SetColorSpace(WINDOW_COLOR_SPACE);
+    scene_target_.SetSamples(SCENE_MSAA_SAMPLES);
     InitUI();
     LoadResources();
     initialized_resources_ = true;
@@ -187,21 +631,69 @@ int Engine::InitDisplay(const int32_t cmd) {
 
   ShowUI();
 
-  // Initialize GL state.
-  glEnable(GL_CULL_FACE);
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LEQUAL);
+  // Depth and cull state is set by the renderers through the GLStateCache
 
   //Note that screen size might have been changed
+  UpdateScreenSize();
+
+  return 0;
+}
+
+/**
+ * Viewport, projections and the scene target follow the window buffer size
+ */
+void Engine::UpdateScreenSize() {
   glViewport(0, 0, gl_context_->GetScreenWidth(),
              gl_context_->GetScreenHeight());
   renderer_.UpdateViewport();
   skybox_renderer_.UpdateViewport();
+  scene_target_.Init(gl_context_->GetScreenWidth(),
+                     gl_context_->GetScreenHeight());
+  offscreen_ = false;
+}
 
-  tap_camera_.SetFlip(1.f, -1.f, -1.f);
-  tap_camera_.SetPinchTransformFactor(2.f, 2.f, 8.f);
+/**
+ * Render resolution through the hardware scaler, recreates the surface
+ */
+void Engine::SetBufferScale(const float scale) {
+  if (scale == gl_context_->GetBufferScale()) return;
 
-  return 0;
+  if (!gl_context_->SetBufferScale(scale)) {
+    UnloadResources();
+    LoadResources();
+  }
+  UpdateScreenSize();
+}
+
+/**
+ * Lighting space, the stages are sRGB textures in both linear spaces. The sRGB
+ * surface falls back to the linear target without EGL_KHR_gl_colorspace.
+ * Reloads all resources when the texture format changes.
+ */
+void Engine::SetColorSpace(const COLOR_SPACE color_space) {
+  const bool srgb_surface = color_space == COLOR_SPACE_SRGB_SURFACE;
+  const bool surface_valid = gl_context_->SetSRGBSurface(srgb_surface);
+  COLOR_SPACE granted = color_space;
+  if (srgb_surface && !gl_context_->IsSRGBSurface()) {
+    LOGI("No sRGB window surface, encoding in the post process");
+    granted = COLOR_SPACE_LINEAR_TARGET;
+  }
+  post_process_.SetFeatures(
+      granted == COLOR_SPACE_LINEAR_TARGET ? LINEAR_POST_FEATURES : 0);
+  if (granted == color_space_ && surface_valid) {
+    if (initialized_resources_) UpdateScreenSize();
+    return;
+  }
+
+  color_space_ = granted;
+  if (initialized_resources_) UnloadResources();
+  ResourceRegistry::GetInstance()->SetCubemapFormat(
+      color_space_ == COLOR_SPACE_GAMMA ? CUBEMAP_FORMAT : CUBEMAP_SRGB_FORMAT);
+  scene_target_.SetColorSpace(color_space_);
+  if (initialized_resources_) {
+    LoadResources();
+    UpdateScreenSize();
+  }
 }
 
 /**
@@ -213,20 +705,45 @@ void Engine::DrawFrame() {
     UpdateFPS(fFPS);
   }
 
+  //Simulated while the previous frame was submitted
+  const FRAME_PACKET& frame = frames_.Acquire();
+  ApplyFrame(frame);
+
+  if (resources_trimmed_) {
+    //Dropped by TRIM_LEVEL_ALL while still visible
+    LoadResources();
+    resources_trimmed_ = false;
+  }
+
   if( stage_updated_ )
   {
     //Reload cubemap
     UpdateStage();
     stage_updated_ = false;
   }
-  renderer_.Update(monitor_.GetCurrentTime());
-  skybox_renderer_.Update(monitor_.GetCurrentTime());
-
-  // Just fill the screen with a color.
-  glClearColor(0.5f, 0.5f, 0.5f, 1.f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  renderer_.Render();
-  skybox_renderer_.Render();
+  if (benchmark_requested_) {
+    StartBenchmark();
+    benchmark_requested_ = false;
+  }
+  benchmark_.Update(monitor_.GetCurrentTime());
+  if (envmap_type_ == ENVMAP_CUBEMAP_ARRAY) UpdateStageBlend();
+  //Refine cubemaps toward mip 0 within the per-frame upload budget
+  ResourceRegistry::GetInstance()->Stream();
+  renderer_.Update(frame);
+  skybox_renderer_.Update(frame);
+
+  //Waits for the GPU to release the ring region of this frame
+  DynamicRing::GetInstance()->BeginFrame();
+  UniformBlocks::GetInstance()->BeginFrame();
+
+  BeginScene();
+  ClearScene();
+  renderer_.Render(&render_queue_);
+  skybox_renderer_.Render(&render_queue_);
+  render_queue_.Execute();
+  EndScene();
+  DynamicRing::GetInstance()->EndFrame();
+  GLStateCache::GetInstance()->EndFrame();
 
   // Swap
   if (EGL_SUCCESS != gl_context_->Swap()) {
@@ -235,6 +752,181 @@ void Engine::DrawFrame() {
   }
 }
 
+/**
+ * Render target of the frame, the scale follows the frame time
+ */
+void Engine::BeginScene() {
+  const float scale = dynamic_resolution_
+                          ? resolution_.Update(monitor_.GetFrameTime())
+                          : RESOLUTION_MAX_SCALE;
+  //The linear target is encoded by the post process even at the full scale,
+  //MSAA is resolved by the scene target
+  const bool offscreen =
+      (scale < 1.f || color_space_ == COLOR_SPACE_LINEAR_TARGET ||
+       scene_target_.GetSamples() > 1) &&
+      scene_target_.IsValid();
+  const bool resized =
+      scene_target_.SetScale(scale) || offscreen != offscreen_;
+  offscreen_ = offscreen;
+
+  if (offscreen_)
+    scene_target_.Bind();
+  else
+    glViewport(0, 0, gl_context_->GetScreenWidth(),
+               gl_context_->GetScreenHeight());
+  //Projection and LOD follow the viewport
+  if (resized) {
+    renderer_.UpdateViewport();
+    skybox_renderer_.UpdateViewport();
+  }
+}
+
+/**
+ * The skybox covers every pixel, so the color is dropped instead of cleared
+ * and the tiles start without loading it
+ */
+void Engine::ClearScene() {
+  if (framebuffer_hints_ && skybox_renderer_.IsCovering()) {
+    const GLenum attachment = offscreen_ ? GL_COLOR_ATTACHMENT0 : GL_COLOR;
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, &attachment);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return;
+  }
+
+  // Just fill the screen with a color.
+  const float gray = color_space_ == COLOR_SPACE_GAMMA ? CLEAR_GRAY_GAMMA
+                                                       : CLEAR_GRAY_LINEAR;
+  glClearColor(gray, gray, gray, 1.f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void Engine::EndScene() {
+  if (offscreen_) {
+    scene_target_.Resolve(framebuffer_hints_);
+    post_process_.Apply(scene_target_, framebuffer_hints_);
+  }
+  //The depth is not needed after the frame, keep it from being written back
+  if (framebuffer_hints_) {
+    const GLenum attachments[] = { GL_DEPTH, GL_STENCIL };
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, 2, attachments);
+  }
+}
+
+/**
+ * Settings of the frame packet, stage and benchmark requests only when they
+ * changed since the benchmark switches stages on this thread as well
+ */
+void Engine::ApplyFrame(const FRAME_PACKET& frame) {
+  renderer_.SetRoughness(frame.roughness);
+  renderer_.SetMaterial(frame.material);
+  if (frame.stage != applied_stage_) {
+    applied_stage_ = frame.stage;
+    current_stage_ = frame.stage;
+    stage_updated_ = true;
+  }
+  if (frame.benchmark_requests != applied_benchmark_requests_) {
+    applied_benchmark_requests_ = frame.benchmark_requests;
+    benchmark_requested_ = true;
+  }
+}
+
+//-------------------------------------------------------------------------
+//Simulation thread
+//-------------------------------------------------------------------------
+void Engine::StartSimulation() {
+  if (simulation_thread_.joinable()) return;
+
+  FRAME_PACKET frame;
+  Simulate(&frame);
+  frames_.Reset(frame);
+  simulation_thread_ = std::thread(&Engine::RunSimulation, this);
+}
+
+void Engine::StopSimulation() {
+  if (!simulation_thread_.joinable()) return;
+
+  frames_.Cancel();
+  simulation_thread_.join();
+}
+
+void Engine::RunSimulation() {
+  do {
+    Simulate(frames_.GetBack());
+    frames_.Publish();
+  } while (frames_.WaitConsumed());
+}
+
+void Engine::Simulate(FRAME_PACKET* frame) {
+  COMMAND command;
+  while (commands_.Pop(&command)) ProcessCommand(command);
+
+  const double time = ndk_helper::PerfMonitor::GetCurrentTime();
+  tap_camera_.Update(time);
+
+  frame->time = time;
+  frame->camera_transform = tap_camera_.GetTransformMatrix();
+  frame->camera_rotation = tap_camera_.GetRotationMatrix();
+  frame->roughness = sim_roughness_;
+  frame->material = sim_material_;
+  frame->stage = sim_stage_;
+  frame->benchmark_requests = sim_benchmark_requests_;
+}
+
+void Engine::ProcessCommand(const COMMAND& command) {
+  const ndk_helper::Vec2 v1(command.args[0], command.args[1]);
+  const ndk_helper::Vec2 v2(command.args[2], command.args[3]);
+  switch (command.type) {
+    case COMMAND_CAMERA_RESET:
+      tap_camera_.Reset(true);
+      break;
+    case COMMAND_CAMERA_BEGIN_DRAG:
+      tap_camera_.BeginDrag(v1);
+      break;
+    case COMMAND_CAMERA_DRAG:
+      tap_camera_.Drag(v1);
+      break;
+    case COMMAND_CAMERA_END_DRAG:
+      tap_camera_.EndDrag();
+      break;
+    case COMMAND_CAMERA_BEGIN_PINCH:
+      tap_camera_.BeginPinch(v1, v2);
+      break;
+    case COMMAND_CAMERA_PINCH:
+      tap_camera_.Pinch(v1, v2);
+      break;
+    case COMMAND_SET_ROUGHNESS:
+      sim_roughness_ = command.args[0];
+      break;
+    case COMMAND_SET_MATERIAL:
+      sim_material_ = command.value;
+      break;
+    case COMMAND_SET_STAGE:
+      sim_stage_ = command.value;
+      break;
+    case COMMAND_START_BENCHMARK:
+      ++sim_benchmark_requests_;
+      break;
+  }
+}
+
+/**
+ * Called from the UI and input threads
+ */
+void Engine::PushCommand(const ENGINE_COMMAND type, const int32_t value,
+                         const float x, const float y, const float z,
+                         const float w) {
+  COMMAND command = { type, value, { x, y, z, w } };
+  commands_.Push(command);
+}
+
+void Engine::PushCommand(const ENGINE_COMMAND type, ndk_helper::Vec2 v1,
+                         ndk_helper::Vec2 v2) {
+  float x1, y1, x2, y2;
+  v1.Value(x1, y1);
+  v2.Value(x2, y2);
+  PushCommand(type, 0, x1, y1, x2, y2);
+}
+
 /**
  * Tear down the EGL context currently associated with the display.
  */
@@ -243,9 +935,59 @@ void Engine::TermDisplay(const int32_t cmd) {
   jui_helper::JUIWindow::GetInstance()->Suspend(cmd);
 }
 
-void Engine::TrimMemory() {
-  LOGI("Trimming memory");
-  gl_context_->Invalidate();
+/**
+ * Shed GL memory in tiers instead of dropping the context.
+ * Tiers only escalate until RestoreMemory() is called.
+ */
+void Engine::TrimMemory(const TRIM_LEVEL level) {
+  if (!initialized_resources_ || level <= trim_level_) return;
+
+  LOGI("Trimming memory, level %d", level);
+  trim_level_ = level;
+  if (level == TRIM_LEVEL_ALL && !resources_trimmed_) {
+    UnloadResources();
+    resources_trimmed_ = true;
+  }
+  ResourceRegistry::GetInstance()->Trim(level);
+  ResourceRegistry::GetInstance()->DumpResidency();
+}
+
+/**
+ * Lift the trim, dropped mip levels are streamed back in
+ */
+void Engine::RestoreMemory() {
+  if (trim_level_ == TRIM_LEVEL_NONE) return;
+
+  LOGI("Restoring memory");
+  trim_level_ = TRIM_LEVEL_NONE;
+  ResourceRegistry::GetInstance()->Trim(TRIM_LEVEL_NONE);
+  if (resources_trimmed_) {
+    LoadResources();
+    resources_trimmed_ = false;
+  }
+}
+
+/**
+ * Called from the Java thread by onTrimMemory()
+ */
+void Engine::RequestTrimMemory(const int32_t android_level) {
+  //Still in the foreground, keep the current stage as long as possible
+  TRIM_LEVEL level = TRIM_LEVEL_MIPS;
+  if (android_level >= TRIM_MEMORY_MODERATE)
+    level = TRIM_LEVEL_ALL;
+  else if (android_level >= TRIM_MEMORY_RUNNING_CRITICAL)
+    level = TRIM_LEVEL_INACTIVE;
+
+  int32_t pending = pending_trim_level_.load();
+  while (pending < level &&
+         !pending_trim_level_.compare_exchange_weak(pending, level)) {
+  }
+  if (app_) ALooper_wake(app_->looper);
+}
+
+void Engine::ProcessTrimRequest() {
+  const int32_t level = pending_trim_level_.exchange(TRIM_LEVEL_NONE);
+  if (level != TRIM_LEVEL_NONE) TrimMemory(static_cast<TRIM_LEVEL>(level));
 }
 /**
  * Process the next input event.
@@ -261,7 +1003,7 @@ int32_t Engine::HandleInput(android_app* app, AInputEvent* event) {
     //Double tap detector has a priority over other detectors
     if (doubleTapState == ndk_helper::GESTURE_STATE_ACTION) {
       //Detect double tap
-      eng->tap_camera_.Reset(true);
+      eng->PushCommand(COMMAND_CAMERA_RESET);
     } else {
       //Handle drag state
       if (dragState & ndk_helper::GESTURE_STATE_START) {
@@ -269,14 +1011,14 @@ int32_t Engine::HandleInput(android_app* app, AInputEvent* event) {
         ndk_helper::Vec2 v;
         eng->drag_detector_.GetPointer(v);
         eng->TransformPosition(v);
-        eng->tap_camera_.BeginDrag(v);
+        eng->PushCommand(COMMAND_CAMERA_BEGIN_DRAG, v);
       } else if (dragState & ndk_helper::GESTURE_STATE_MOVE) {
         ndk_helper::Vec2 v;
         eng->drag_detector_.GetPointer(v);
         eng->TransformPosition(v);
-        eng->tap_camera_.Drag(v);
+        eng->PushCommand(COMMAND_CAMERA_DRAG, v);
       } else if (dragState & ndk_helper::GESTURE_STATE_END) {
-        eng->tap_camera_.EndDrag();
+        eng->PushCommand(COMMAND_CAMERA_END_DRAG);
       }
 
       //Handle pinch state
@@ -287,7 +1029,7 @@ int32_t Engine::HandleInput(android_app* app, AInputEvent* event) {
         eng->pinch_detector_.GetPointers(v1, v2);
         eng->TransformPosition(v1);
         eng->TransformPosition(v2);
-        eng->tap_camera_.BeginPinch(v1, v2);
+        eng->PushCommand(COMMAND_CAMERA_BEGIN_PINCH, v1, v2);
       } else if (pinchState & ndk_helper::GESTURE_STATE_MOVE) {
         //Multi touch
         //Start new pinch
@@ -296,7 +1038,7 @@ int32_t Engine::HandleInput(android_app* app, AInputEvent* event) {
         eng->pinch_detector_.GetPointers(v1, v2);
         eng->TransformPosition(v1);
         eng->TransformPosition(v2);
-        eng->tap_camera_.Pinch(v1, v2);
+        eng->PushCommand(COMMAND_CAMERA_PINCH, v1, v2);
       }
     }
     return 1;
@@ -335,6 +1077,7 @@ void Engine::HandleCmd(struct android_app* app, int32_t cmd) {
       eng->has_focus_ = true;
       jui_helper::JUIWindow::GetInstance()->Resume(app->activity,
                                                    APP_CMD_GAINED_FOCUS);
+      eng->RestoreMemory();
       break;
     case APP_CMD_LOST_FOCUS:
       eng->SuspendSensors();
@@ -343,8 +1086,9 @@ void Engine::HandleCmd(struct android_app* app, int32_t cmd) {
       eng->DrawFrame();
       break;
     case APP_CMD_LOW_MEMORY:
-      //Free up GL resources
-      eng->TrimMemory();
+      //Free up GL resources, one more tier on each warning
+      eng->TrimMemory(static_cast<TRIM_LEVEL>(
+          std::min(eng->trim_level_ + 1, static_cast<int32_t>(TRIM_LEVEL_ALL))));
       break;
   }
 }
@@ -409,9 +1153,10 @@ bool Engine::IsReady() {
 }
 
 void Engine::TransformPosition(ndk_helper::Vec2& vec) {
+  //Touches are in window pixels, the buffers may be scaled
   vec = ndk_helper::Vec2(2.0f, 2.0f) * vec
-      / ndk_helper::Vec2(gl_context_->GetScreenWidth(),
-                         gl_context_->GetScreenHeight())
+      / ndk_helper::Vec2(gl_context_->GetWindowWidth(),
+                         gl_context_->GetWindowHeight())
       - ndk_helper::Vec2(1.f, 1.f);
 }
 
@@ -432,7 +1177,7 @@ void Engine::InitUI() {
                        [this](jui_helper::JUIView * view, const int32_t mes,
                           const int32_t p1, const int32_t p2) {
     LOGI("Seek progress %d", p1);
-    renderer_.SetRoughness(float(p1) / 100.f);
+    PushCommand(COMMAND_SET_ROUGHNESS, 0, float(p1) / 100.f);
   });
   seekBar->SetMargins(0, 0, 0, 50);
   seekBar->AddRule(jui_helper::LAYOUT_PARAMETER_ALIGN_PARENT_BOTTOM,
@@ -446,33 +1191,46 @@ void Engine::InitUI() {
       [this, changeMaterialButton](jui_helper::JUIView * view, const int32_t message) {
         LOGI("button_sign_in_ click: %d", message);
         if (message == jui_helper::JUICALLBACK_BUTTON_UP) {
-          renderer_.SwitchMaterial();
-          changeMaterialButton->SetAttribute("Text", renderer_.GetMaterialName());
+          ui_material_ =
+              (ui_material_ + 1) % TeapotRenderer::GetMaterialCount();
+          changeMaterialButton->SetAttribute(
+              "Text", TeapotRenderer::GetMaterialName(ui_material_));
+          PushCommand(COMMAND_SET_MATERIAL, ui_material_);
 
         }
       });
   changeMaterialButton->SetLayoutParams(jui_helper::ATTRIBUTE_SIZE_WRAP_CONTENT,
                            jui_helper::ATTRIBUTE_SIZE_WRAP_CONTENT,
                            0.5f);
-  changeMaterialButton->SetAttribute("Text", renderer_.GetMaterialName());
+  changeMaterialButton->SetAttribute(
+      "Text", TeapotRenderer::GetMaterialName(ui_material_));
 
   auto changeStageButton = new jui_helper::JUIButton("Stage");
   changeStageButton->SetCallback(
       [this, changeStageButton](jui_helper::JUIView * view, const int32_t message) {
         if (message == jui_helper::JUICALLBACK_BUTTON_UP) {
 
-          current_stage_ = (current_stage_ + 1) % NUM_STAGES;
-          changeStageButton->SetAttribute("Text", stages_[current_stage_].stage_name);
-          stage_updated_ = true;
-//          ndk_helper::JNIHelper::GetInstance()->RunOnUiThread([this]() {
-//            UpdateStage();
-//          });
+          ui_stage_ = (ui_stage_ + 1) % NUM_STAGES;
+          changeStageButton->SetAttribute("Text", stages_[ui_stage_].stage_name);
+          PushCommand(COMMAND_SET_STAGE, ui_stage_);
         }
       });
   changeStageButton->SetLayoutParams(jui_helper::ATTRIBUTE_SIZE_WRAP_CONTENT,
                            jui_helper::ATTRIBUTE_SIZE_WRAP_CONTENT,
                            0.5f);
-  changeStageButton->SetAttribute("Text", stages_[current_stage_].stage_name);
+  changeStageButton->SetAttribute("Text", stages_[ui_stage_].stage_name);
+
+  auto benchmarkButton = new jui_helper::JUIButton("Benchmark");
+  benchmarkButton->SetCallback(
+      [this](jui_helper::JUIView * view, const int32_t message) {
+        if (message == jui_helper::JUICALLBACK_BUTTON_UP) {
+          //Results are written to the log
+          PushCommand(COMMAND_START_BENCHMARK);
+        }
+      });
+  benchmarkButton->SetLayoutParams(jui_helper::ATTRIBUTE_SIZE_WRAP_CONTENT,
+                           jui_helper::ATTRIBUTE_SIZE_WRAP_CONTENT,
+                           0.5f);
 
   // Setting up linear layout
   auto layout = new jui_helper::JUILinearLayout();
@@ -482,6 +1240,7 @@ void Engine::InitUI() {
                        jui_helper::LAYOUT_ORIENTATION_HORIZONTAL);
   layout->AddView(changeStageButton);
   layout->AddView(changeMaterialButton);
+  layout->AddView(benchmarkButton);
   layout->AddRule(jui_helper::LAYOUT_PARAMETER_ABOVE,
                   seekBar);
 
@@ -532,6 +1291,9 @@ void android_main(android_app* state) {
 
   //Init helper functions
   ndk_helper::JNIHelper::Init(state->activity, HELPER_CLASS_NAME, HELPER_CLASS_SONAME);
+  //Decoded images persist across launches
+  ImageCache::GetInstance()->SetDirectory(
+      ndk_helper::JNIHelper::GetInstance()->GetCacheDir() + "/images");
 
   state->userData = &g_engine;
   state->onAppCmd = Engine::HandleCmd;
@@ -543,6 +1305,8 @@ void android_main(android_app* state) {
 
   // Prepare to monitor accelerometer
   g_engine.InitSensors();
+  // Camera and UI state, paced by DrawFrame()
+  g_engine.StartSimulation();
 
   // loop waiting for stuff to do.
   while (1) {
@@ -565,10 +1329,16 @@ void android_main(android_app* state) {
       // Check if we are exiting.
       if (state->destroyRequested != 0) {
         g_engine.TermDisplay(APP_CMD_TERM_WINDOW);
+        g_engine.StopSimulation();
+        //Finish pending decodes, the process may start a new activity
+        WorkerPool::GetInstance()->Shutdown();
         return;
       }
     }
 
+    // Memory pressure reported through onTrimMemory()
+    g_engine.ProcessTrimRequest();
+
     if (g_engine.IsReady()) {
       // Drawing is throttled to the screen update rate, so there
       // is no need to do timing here.
@@ -590,4 +1360,11 @@ Java_com_sample_teapotpbr_TeapotNativeActivity_OnPauseHandler(
   // through JNI call.
   jui_helper::JUIWindow::GetInstance()->Suspend(APP_CMD_PAUSE);
 }
+
+JNIEXPORT void
+Java_com_sample_teapotpbr_TeapotNativeActivity_OnTrimMemoryHandler(
+    JNIEnv *env, jobject thiz, jint level) {
+  // Trimming issues GL calls, hand it over to the GL thread
+  g_engine.RequestTrimMemory(level);
+}
 }
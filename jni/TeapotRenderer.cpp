@@ -21,13 +21,29 @@
 //--------------------------------------------------------------------------------
 // Include files
 //--------------------------------------------------------------------------------
-#include "TeapotRenderer.h"
+#include <stddef.h>
+#include <string.h>
 
-//--------------------------------------------------------------------------------
-// Teapot model data
-//--------------------------------------------------------------------------------
-#include "teapot.inl"
+#include <limits>
+#include <string>
+
+#include "TeapotRenderer.h"
+#include "GLStateCache.h"
+#include "UniformBlocks.h"
 
+/*
+ Specular colors of metals
+               R            G            B
+Silver      0.971519    0.959915    0.915324
+Aluminium   0.913183    0.921494    0.924524
+Gold        1           0.765557    0.336057
+Copper      0.955008    0.637427    0.538163
+Chromium    0.549585    0.556114    0.554256
+Nickel      0.659777    0.608679    0.525649
+Titanium    0.541931    0.496791    0.449419
+Cobalt      0.662124    0.654864    0.633732
+Platinum    0.672411    0.637331    0.585456
+ */
 MATERIAL_PARAMETERS TeapotRenderer::materials_[] = {
     { "Gold", { {0.f, 0.f, 0.f}, {1.f, 0.765557f, 0.336057f, 0.f }, { 0,0,0 } } },
     { "Copper", { {0.f, 0.f, 0.f}, {0.955008f, 0.637427f, 0.538163, 0.f }, { 0,0,0 } } },
@@ -36,12 +52,35 @@ MATERIAL_PARAMETERS TeapotRenderer::materials_[] = {
 
 const int32_t TeapotRenderer::NUM_MATERIALS = sizeof(TeapotRenderer::materials_)/sizeof(TeapotRenderer::materials_[0]);
 
+// The envmap bits are turned into the header by CreateProgram()
+static const SHADER_FEATURE_DEFINE SHADER_FEATURE_DEFINES[] = {
+    { TEAPOT_SHADER_INSTANCED, "INSTANCED" },
+    { TEAPOT_SHADER_CUBEMAP_ARRAY, NULL },
+    { TEAPOT_SHADER_OCTAHEDRAL, NULL },
+    { TEAPOT_SHADER_DIFFUSE, "DIFFUSE" },
+};
+
 //--------------------------------------------------------------------------------
 // Ctor
 //--------------------------------------------------------------------------------
 TeapotRenderer::TeapotRenderer()
-: roughness_(0.f), current_material(0)
-{}
+: select_variants_(true),
+  viewport_height_(1),
+  lod_(0),
+  lod_override_(-1),
+  instance_vbo_(0),
+  instance_vao_(0),
+  instances_dirty_(false),
+  instancing_(true),
+  min_instance_roughness_(0.f),
+  cubemap_(NULL),
+  envmap_type_(ENVMAP_CUBEMAP),
+  envmap_type_valid_(false),
+  roughness_(0.f),
+  current_material(0)
+{
+  SetStageLayers(0, 0, 0.f);
+}
 
 //--------------------------------------------------------------------------------
 // Dtor
@@ -50,67 +89,39 @@ TeapotRenderer::~TeapotRenderer() { Unload(); }
 
 void TeapotRenderer::Init() {
   // Settings
-  glFrontFace(GL_CCW);
-
-  //
-  //
-  //
-  // SRGB test
-  // Enable Linear space
-#if 0
-  glEnable(GL_FRAMEBUFFER_SRGB_EXT);
-  if( glIsEnabled(GL_EXT_sRGB_write_control))
-  {
-    LOGI("Enabled!!!");
-  }
-  glEnable(GL_EXT_sRGB_write_control);
-  if( glIsEnabled(GL_EXT_sRGB_write_control))
-  {
-    LOGI("Enabled!!!");
-  }
-#endif
-
-  //  FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING
-  //
-  //
-  //
+  GLStateCache::GetInstance()->FrontFace(GL_CCW);
 
   // Load shader
-  LoadShaders(&shader_param_, "Shaders/VS_ShaderPlain.vsh",
-              "Shaders/ShaderPlain.fsh");
-
-  // Create Index buffer
-  num_indices_ = sizeof(teapotIndices) / sizeof(teapotIndices[0]);
-  glGenBuffers(1, &ibo_);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(teapotIndices), teapotIndices,
-               GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-  // Create VBO
-  num_vertices_ = sizeof(teapotPositions) / sizeof(teapotPositions[0]) / 3;
-  int32_t iStride = sizeof(TEAPOT_VERTEX);
-  int32_t iIndex = 0;
-  TEAPOT_VERTEX* p = new TEAPOT_VERTEX[num_vertices_];
-  for (int32_t i = 0; i < num_vertices_; ++i) {
-    p[i].pos[0] = teapotPositions[iIndex];
-    p[i].pos[1] = teapotPositions[iIndex + 1];
-    p[i].pos[2] = teapotPositions[iIndex + 2];
-
-    p[i].normal[0] = teapotNormals[iIndex];
-    p[i].normal[1] = teapotNormals[iIndex + 1];
-    p[i].normal[2] = teapotNormals[iIndex + 2];
-    iIndex += 3;
+  const char* strVsh = "Shaders/VS_ShaderPlain.vsh";
+  const char* strFsh = "Shaders/ShaderPlain.fsh";
+  variants_.Init(
+      strVsh, strFsh, SHADER_FEATURE_DEFINES,
+      sizeof(SHADER_FEATURE_DEFINES) / sizeof(SHADER_FEATURE_DEFINES[0]),
+      [this, strVsh, strFsh](const uint32_t features) {
+        return CreateProgram(strVsh, strFsh, features);
+      },
+      SetupProgram);
+  // Prewarmed by the first SetCubemap(), compiling for a guessed sampler would
+  // be wasted on the other stage residencies
+  envmap_type_valid_ = false;
+
+  // The material table, the objects select an entry
+  MATERIAL_UNIFORMS table[MATERIAL_TABLE_SIZE];
+  memset(table, 0, sizeof(table));
+  for (int32_t i = 0; i < NUM_MATERIALS && i < MATERIAL_TABLE_SIZE; ++i) {
+    const TEAPOT_MATERIALS& material = materials_[i].material;
+    memcpy(table[i].diffuse_color, material.diffuse_color,
+           sizeof(material.diffuse_color));
+    memcpy(table[i].ambient_color, material.ambient_color,
+           sizeof(material.ambient_color));
+    memcpy(table[i].specular_color, material.specular_color,
+           sizeof(material.specular_color));
   }
-  glGenBuffers(1, &vbo_);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glBufferData(GL_ARRAY_BUFFER, iStride * num_vertices_, p, GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  UniformBlocks::GetInstance()->SetMaterials(table, NUM_MATERIALS);
 
-  //Create cubemap
-  //CreateCubemap();
-
-  delete[] p;
+  // Pre-interleaved by tools/mesh_converter.cpp
+  if (!mesh_.Load(TEAPOT_MESH))
+    LOGI("Failed to load %s, the teapots are not drawn", TEAPOT_MESH);
 
   UpdateViewport();
   mat_model_ = ndk_helper::Mat4::Translation(0, 0, -15.f);
@@ -119,73 +130,173 @@ void TeapotRenderer::Init() {
   mat_model_ = mat * mat_model_;
 }
 
-void TeapotRenderer::SwitchStage(const char* file_name)
+void TeapotRenderer::SwitchStage(const char* file_name, const bool octahedral)
+{
+  // The skybox shares the same cubemap, acquire before release so that a
+  // switch to the current stage does not reload it
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  CubemapTexture* cubemap = octahedral ? registry->AcquireOctahedral(file_name)
+                                       : registry->AcquireCubemap(file_name);
+  SetCubemap(cubemap);
+}
+
+//--------------------------------------------------------------------------------
+// Cubemap array residency, stages are switched by SetStageLayers()
+//--------------------------------------------------------------------------------
+void TeapotRenderer::SetStageArray(const std::vector<std::string>& file_names)
+{
+  ResourceRegistry* registry = ResourceRegistry::GetInstance();
+  CubemapTexture* cubemap = registry->AcquireCubemapArray(file_names);
+  SetCubemap(cubemap);
+}
+
+//--------------------------------------------------------------------------------
+// Hand the cubemap over, the caller has acquired the new one
+//--------------------------------------------------------------------------------
+void TeapotRenderer::SetCubemap(CubemapTexture* cubemap)
+{
+  if (cubemap_) {
+    cubemap_->ReleaseLevel(this);
+    ResourceRegistry::GetInstance()->ReleaseCubemap(cubemap_);
+  }
+  cubemap_ = cubemap;
+  if (cubemap_) cubemap_->RequireLevel(this, GetRequiredLevel());
+  UpdateProgram();
+}
+
+//--------------------------------------------------------------------------------
+// MipmapIndex in ShaderPlain.fsh, trilinear filtering also reads the next
+// coarser level
+//--------------------------------------------------------------------------------
+int32_t TeapotRenderer::GetRequiredLevel() const
+{
+  const float roughness =
+      instances_.empty() ? roughness_ : min_instance_roughness_;
+  return static_cast<int32_t>(roughness * (MIPLEVELS - 1));
+}
+
+//--------------------------------------------------------------------------------
+// Switch to the program variants sampling the current stage, the variants of
+// the previous sampler stay cached
+//--------------------------------------------------------------------------------
+void TeapotRenderer::UpdateProgram()
+{
+  if (cubemap_ == NULL) return;
+  if (envmap_type_valid_ && cubemap_->GetType() == envmap_type_) return;
+
+  envmap_type_ = cubemap_->GetType();
+  envmap_type_valid_ = true;
+  PrewarmVariants();
+}
+
+//--------------------------------------------------------------------------------
+// Variants of the current sampler, for every material and the instanced draw
+// when there are instances
+//--------------------------------------------------------------------------------
+void TeapotRenderer::PrewarmVariants()
+{
+  std::vector<uint32_t> features;
+  for (int32_t material = 0; material < NUM_MATERIALS; ++material) {
+    features.push_back(GetFeatures(material, false));
+    if (!instances_.empty() && instancing_)
+      features.push_back(GetFeatures(material, true));
+  }
+  variants_.Prewarm(features);
+}
+
+//--------------------------------------------------------------------------------
+// Variant drawing the material, the instanced draw uses the material table for
+// the diffuse color as well
+//--------------------------------------------------------------------------------
+uint32_t TeapotRenderer::GetFeatures(const int32_t material,
+                                     const bool instanced) const
 {
-  LOGI("Loading Cubemap Textures");
-  if (tex_cubemap_) {
-    glDeleteTextures(1, &tex_cubemap_);
-    tex_cubemap_ = 0;
+  uint32_t features = select_variants_ ? GetMaterialFeatures(material)
+                                       : TEAPOT_SHADER_DIFFUSE;
+  if (instanced) features |= TEAPOT_SHADER_INSTANCED;
+  if (envmap_type_ == ENVMAP_CUBEMAP_ARRAY)
+    features |= TEAPOT_SHADER_CUBEMAP_ARRAY;
+  else if (envmap_type_ == ENVMAP_OCTAHEDRAL)
+    features |= TEAPOT_SHADER_OCTAHEDRAL;
+  return features;
+}
+
+void TeapotRenderer::SetInstances(
+    const std::vector<TEAPOT_INSTANCE>& instances) {
+  instances_ = instances;
+  instances_dirty_ = true;
+  min_instance_roughness_ = 1.f;
+  for (size_t i = 0; i < instances_.size(); ++i)
+    min_instance_roughness_ =
+        std::min(min_instance_roughness_, instances_[i].roughness);
+  if (!instances_.empty() && envmap_type_valid_) PrewarmVariants();
+}
+
+void TeapotRenderer::SetInstanceGrid(const int32_t size) {
+  std::vector<TEAPOT_INSTANCE> instances(size * size);
+  if (size == 0 || !mesh_.IsLoaded()) {
+    SetInstances(std::vector<TEAPOT_INSTANCE>());
+    return;
   }
 
-  // Create Cubemap
-  glGenTextures(1, &tex_cubemap_);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, tex_cubemap_);
-
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-  //128x128 - 1x1 cubemaps
-  // Create Cubemap
-  glGenTextures(1, &tex_cubemap_);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, tex_cubemap_);
-
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, MIPLEVELS - 1);
-
-  //128x128 - 1x1 cubemaps
-  for( int32_t i = 0; i < MIPLEVELS; ++i )
-  {
-    const int32_t BUFFER_SIZE = 256;
-    char file_name_buffer[BUFFER_SIZE];
-
-//#define GL_TEXTURE_CUBE_MAP_POSITIVE_X    0x8515
-//#define GL_TEXTURE_CUBE_MAP_NEGATIVE_X    0x8516
-//#define GL_TEXTURE_CUBE_MAP_POSITIVE_Y    0x8517
-//#define GL_TEXTURE_CUBE_MAP_NEGATIVE_Y    0x8518
-//#define GL_TEXTURE_CUBE_MAP_POSITIVE_Z    0x8519
-//#define GL_TEXTURE_CUBE_MAP_NEGATIVE_Z    0x851A
-
-    for(int32_t face = 0; face < 6; ++face)
-    {
-      snprintf(file_name_buffer, BUFFER_SIZE, file_name, i, face);
-      ndk_helper::JNIHelper::GetInstance()->LoadCubemapTexture(file_name_buffer,
-                                                               GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
-                                                               i,
-                                                               false);
+  // Teapots fill a cell each, centered on it
+  float center[3];
+  mesh_.GetBoundingSphere(center);
+  const float* bounds_min = mesh_.GetBoundsMin();
+  const float* bounds_max = mesh_.GetBoundsMax();
+  const float extent = std::max(bounds_max[0] - bounds_min[0],
+                                bounds_max[1] - bounds_min[1]);
+  const float cell = extent / size;
+  const float scale = 0.8f / size;
+  ndk_helper::Mat4 mat_center = ndk_helper::Mat4::Scale(scale, scale, scale) *
+                                ndk_helper::Mat4::Translation(
+                                    -center[0], -center[1], -center[2]);
+
+  for (int32_t y = 0; y < size; ++y) {
+    for (int32_t x = 0; x < size; ++x) {
+      TEAPOT_INSTANCE& instance = instances[y * size + x];
+      ndk_helper::Mat4 transform =
+          ndk_helper::Mat4::Translation(center[0] + (x + 0.5f - size * 0.5f) * cell,
+                                        center[1] + (y + 0.5f - size * 0.5f) * cell,
+                                        center[2]) *
+          mat_center;
+      memcpy(instance.transform, transform.Ptr(), sizeof(instance.transform));
+
+      const float u = size > 1 ? static_cast<float>(x) / (size - 1) : 0.f;
+      const float v = size > 1 ? static_cast<float>(y) / (size - 1) : 0.f;
+      const float material = u * (NUM_MATERIALS - 1);
+      const int32_t first = std::min(static_cast<int32_t>(material),
+                                     NUM_MATERIALS - 2);
+      const float blend = material - first;
+      for (int32_t i = 0; i < 4; ++i) {
+        instance.specular_color[i] =
+            materials_[first].material.specular_color[i] * (1.f - blend) +
+            materials_[first + 1].material.specular_color[i] * blend;
+      }
+      instance.roughness = v;
     }
   }
+  SetInstances(instances);
+}
 
-  glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+void TeapotRenderer::SetStageLayers(const int32_t layer,
+                                    const int32_t previous_layer,
+                                    const float blend) {
+  cubemap_layers_[0] = layer;
+  cubemap_layers_[1] = previous_layer;
+  cubemap_layers_[2] = blend;
 }
 
+const float CAM_NEAR = 5.f;
+const float CAM_FAR = 10000.f;
 
 void TeapotRenderer::UpdateViewport() {
   // Init Projection matrices
   int32_t viewport[4];
   glGetIntegerv(GL_VIEWPORT, viewport);
+  viewport_height_ = viewport[3];
   float fAspect;
 
-  const float CAM_NEAR = 5.f;
-  const float CAM_FAR = 10000.f;
-
   // Set aspect ratio as wider axis becomes -1-1 to show sprite in same physical size on screen
   if (viewport[2] < viewport[3]) {
     fAspect = (float) viewport[2] / (float) viewport[3];
@@ -202,24 +313,21 @@ void TeapotRenderer::UpdateViewport() {
 }
 
 void TeapotRenderer::Unload() {
-  if (vbo_) {
-    glDeleteBuffers(1, &vbo_);
-    vbo_ = 0;
-  }
+  mesh_.Unload();
 
-  if (ibo_) {
-    glDeleteBuffers(1, &ibo_);
-    ibo_ = 0;
-  }
+  SetCubemap(NULL);
 
-  if (tex_cubemap_) {
-    glDeleteTextures(1, &tex_cubemap_);
-    tex_cubemap_ = 0;
-  }
+  variants_.Unload();
 
-  if (shader_param_.program_) {
-    glDeleteProgram(shader_param_.program_);
-    shader_param_.program_ = 0;
+  // The instances stay, they are uploaded again on the next Render()
+  GLStateCache* state = GLStateCache::GetInstance();
+  if (instance_vao_) {
+    state->DeleteVertexArray(instance_vao_);
+    instance_vao_ = 0;
+  }
+  if (instance_vbo_) {
+    state->DeleteBuffer(instance_vbo_);
+    instance_vbo_ = 0;
   }
 
 }
@@ -228,124 +336,262 @@ const float CAM_X = 0.f;
 const float CAM_Y = 0.f;
 const float CAM_Z = 700.f;
 
-void TeapotRenderer::Update(const double time) {
+void TeapotRenderer::Update(const FRAME_PACKET& frame) {
+  // The slider is moved on the UI thread, requirements change on this one
+  if (cubemap_) cubemap_->RequireLevel(this, GetRequiredLevel());
 
   mat_view_ = ndk_helper::Mat4::LookAt(ndk_helper::Vec3(CAM_X, CAM_Y, CAM_Z),
                                        ndk_helper::Vec3(0.f, 0.f, 0.f),
                                        ndk_helper::Vec3(0.f, 1.f, 0.f));
 
-  if (camera_) {
-    camera_->Update(time);
-    mat_view_ = camera_->GetTransformMatrix() * mat_view_ *
-                camera_->GetRotationMatrix() * mat_model_;
+  // The camera was advanced by the simulation thread
+  mat_view_ = frame.camera_transform * mat_view_ * frame.camera_rotation *
+              mat_model_;
+  UpdateLod();
+}
+
+//--------------------------------------------------------------------------------
+// Project the bounding sphere with the current matrices
+//--------------------------------------------------------------------------------
+void TeapotRenderer::UpdateLod() {
+  if (!mesh_.IsLoaded()) return;
+  if (lod_override_ >= 0) {
+    lod_ = std::min(lod_override_, mesh_.GetLodCount() - 1);
+    return;
+  }
+
+  float pixels_per_unit = 0.f;
+  if (instances_.empty()) {
+    pixels_per_unit = GetPixelsPerUnit(mat_view_);
   } else {
-    mat_view_ = mat_view_ * mat_model_;
+    // The nearest instance decides for all of them
+    for (size_t i = 0; i < instances_.size(); ++i)
+      pixels_per_unit = std::max(
+          pixels_per_unit,
+          GetPixelsPerUnit(mat_view_ *
+                           ndk_helper::Mat4(instances_[i].transform)));
   }
+  lod_ = mesh_.SelectLod(pixels_per_unit, lod_);
 }
 
-void TeapotRenderer::Render() {
-  // Feed Projection and Model View matrices to the shaders
-  ndk_helper::Mat4 mat_vp = mat_projection_ * mat_view_;
+float TeapotRenderer::GetPixelsPerUnit(const ndk_helper::Mat4& mat_view) const {
+  float center[3];
+  const float radius = mesh_.GetBoundingSphere(center);
+  ndk_helper::Vec4 view_center =
+      mat_view * ndk_helper::Vec4(center[0], center[1], center[2], 1.f);
+  float x, y, z, w;
+  view_center.Value(x, y, z, w);
+
+  // The camera may scale, measure a unit along the object x axis
+  ndk_helper::Mat4 view_matrix = mat_view;
+  const float* view = view_matrix.Ptr();
+  const float scale =
+      sqrtf(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+  const float distance = -z - radius * scale;
+  // Camera inside the bounds, selects the full detail
+  if (distance <= 0.f) return std::numeric_limits<float>::max();
+
+  // Pixels per object unit at the near side of the sphere
+  ndk_helper::Mat4 projection = mat_projection_;
+  return scale * projection.Ptr()[5] / distance * viewport_height_ * 0.5f;
+}
 
-  // Bind the VBO
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+void TeapotRenderer::Render(RenderQueue* queue) {
+  // The stage failed to load
+  if (cubemap_ == NULL) return;
+  UpdateFrameUniforms();
+
+  if (instances_.empty()) {
+    OBJECT_UNIFORMS object;
+    GetObjectUniforms(ndk_helper::Mat4::Identity(), roughness_, &object);
+    const GLuint program = variants_.Get(GetFeatures(current_material, false));
+    queue->Push(GetDrawPacket(program,
+                              UniformBlocks::GetInstance()->AddObject(object),
+                              GetViewDepth(mat_view_)));
+  } else if (instancing_) {
+    RenderInstanced(queue);
+  } else {
+    RenderPerDraw(queue);
+  }
+}
 
-  int32_t iStride = sizeof(TEAPOT_VERTEX);
-  // Pass the vertex data
-  glVertexAttribPointer(ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, iStride,
-                        BUFFER_OFFSET(0));
-  glEnableVertexAttribArray(ATTRIB_VERTEX);
+//--------------------------------------------------------------------------------
+// Mesh draw of the current LOD with the cubemap, the sampler uniforms are set
+// to unit 0 at load time
+//--------------------------------------------------------------------------------
+DRAW_PACKET TeapotRenderer::GetDrawPacket(const GLuint program,
+                                          const int32_t object,
+                                          const float depth) const {
+  DRAW_PACKET packet;
+  mesh_.GetDrawPacket(lod_, &packet);
+  packet.key = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, program,
+                                    current_material, cubemap_->GetTexture(),
+                                    depth);
+  packet.program = program;
+  packet.texture_target = cubemap_->GetTarget();
+  packet.texture = cubemap_->GetTexture();
+  packet.object = object;
+  return packet;
+}
 
-  glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, iStride,
-                        BUFFER_OFFSET(3 * sizeof(GLfloat)));
-  glEnableVertexAttribArray(ATTRIB_NORMAL);
+//--------------------------------------------------------------------------------
+// Distance of the bounding sphere center over the far plane
+//--------------------------------------------------------------------------------
+float TeapotRenderer::GetViewDepth(const ndk_helper::Mat4& mat_view) const {
+  float center[3];
+  mesh_.GetBoundingSphere(center);
+  ndk_helper::Vec4 view_center =
+      mat_view * ndk_helper::Vec4(center[0], center[1], center[2], 1.f);
+  float x, y, z, w;
+  view_center.Value(x, y, z, w);
+  return -z / CAM_FAR;
+}
 
-  // Bind the IB
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+//--------------------------------------------------------------------------------
+// The skybox draws after the teapot and shares the frame block
+//--------------------------------------------------------------------------------
+void TeapotRenderer::UpdateFrameUniforms() {
+  FRAME_UNIFORMS frame = {
+    //Dynamic light
+    { 200.f, -200.f, -200.f, 0.f },
+    { CAM_X, CAM_Y, CAM_Z, 1.f },
+    { cubemap_layers_[0], cubemap_layers_[1], cubemap_layers_[2], 0.f },
+    //LOD is relative to the finest resident level while the cubemap streams in
+    { MIPLEVELS - 1.f, static_cast<float>(cubemap_->GetBaseLevel()), 0.f, 0.f },
+  };
+  UniformBlocks::GetInstance()->SetFrame(frame);
+}
 
-  glUseProgram(shader_param_.program_);
+//--------------------------------------------------------------------------------
+// Matrices of the teapot with mat_model in its object space, the current
+// material
+//--------------------------------------------------------------------------------
+void TeapotRenderer::GetObjectUniforms(const ndk_helper::Mat4& mat_model,
+                                       const float roughness,
+                                       OBJECT_UNIFORMS* object) {
+  ndk_helper::Mat4 mat_mv = mat_view_ * mat_model;
+  ndk_helper::Mat4 mat_mvp = mat_projection_ * mat_mv;
+  memcpy(object->model_view, mat_mv.Ptr(), sizeof(object->model_view));
+  memcpy(object->model_view_projection, mat_mvp.Ptr(),
+         sizeof(object->model_view_projection));
+  object->material[0] = static_cast<float>(current_material);
+  object->material[1] = roughness;
+  object->material[2] = 0.f;
+  object->material[3] = 0.f;
+}
 
-  /*
-               R            G            B
-Silver      0.971519    0.959915    0.915324
-Aluminium   0.913183    0.921494    0.924524
-Gold        1           0.765557    0.336057
-Copper      0.955008    0.637427    0.538163
-Chromium    0.549585    0.556114    0.554256
-Nickel      0.659777    0.608679    0.525649
-Titanium    0.541931    0.496791    0.449419
-Cobalt      0.662124    0.654864    0.633732
-Platinum    0.672411    0.637331    0.585456
-   *
-   */
+//--------------------------------------------------------------------------------
+// All instances in one draw
+//--------------------------------------------------------------------------------
+void TeapotRenderer::RenderInstanced(RenderQueue* queue) {
+  const GLuint program = variants_.Get(GetFeatures(current_material, true));
+  if (program == 0) return;
+
+  if (instance_vao_ == 0) CreateInstanceVertexArray();
+  if (instances_dirty_) {
+    GLStateCache::GetInstance()->BindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+    glBufferData(GL_ARRAY_BUFFER, instances_.size() * sizeof(TEAPOT_INSTANCE),
+                 &instances_[0], GL_DYNAMIC_DRAW);
+    instances_dirty_ = false;
+  }
 
-  TEAPOT_MATERIALS material = {
-    { 1.0f, 0.5f, 0.5f },
-    { 1.0f, 0.765557, 0.538163, 10.f }, //Gold specular
-    { 0.1f, 0.1f, 0.1f },
-  };
+  // Roughness and specular color come from the instances
+  OBJECT_UNIFORMS object;
+  GetObjectUniforms(ndk_helper::Mat4::Identity(), roughness_, &object);
+  DRAW_PACKET packet =
+      GetDrawPacket(program, UniformBlocks::GetInstance()->AddObject(object),
+                    GetViewDepth(mat_view_));
+  packet.vertex_array = instance_vao_;
+  packet.instances = static_cast<GLsizei>(instances_.size());
+  queue->Push(packet);
+}
+
+//--------------------------------------------------------------------------------
+// Mesh attributes and the per instance attributes, advancing once per instance
+//--------------------------------------------------------------------------------
+void TeapotRenderer::CreateInstanceVertexArray() {
+  GLStateCache* state = GLStateCache::GetInstance();
+  glGenBuffers(1, &instance_vbo_);
+  glGenVertexArrays(1, &instance_vao_);
+  state->BindVertexArray(instance_vao_);
+  mesh_.BindAttributes();
+
+  state->BindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+  const GLsizei stride = sizeof(TEAPOT_INSTANCE);
+  for (int32_t column = 0; column < 4; ++column) {
+    glVertexAttribPointer(ATTRIB_INSTANCE_TRANSFORM + column, 4, GL_FLOAT,
+                          GL_FALSE, stride,
+                          BUFFER_OFFSET(column * 4 * sizeof(float)));
+  }
+  glVertexAttribPointer(ATTRIB_INSTANCE_SPECULAR, 4, GL_FLOAT, GL_FALSE, stride,
+                        BUFFER_OFFSET(offsetof(TEAPOT_INSTANCE,
+                                               specular_color)));
+  glVertexAttribPointer(ATTRIB_INSTANCE_ROUGHNESS, 1, GL_FLOAT, GL_FALSE,
+                        stride,
+                        BUFFER_OFFSET(offsetof(TEAPOT_INSTANCE, roughness)));
+  for (int32_t i = ATTRIB_INSTANCE_TRANSFORM; i <= ATTRIB_INSTANCE_ROUGHNESS;
+       ++i) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+  // Uploaded by RenderInstanced()
+  instances_dirty_ = true;
+}
 
-  //Update uniforms
-  TEAPOT_MATERIALS& mat = materials_[current_material].material;
-  glUniform3f(shader_param_.material_diffuse_, mat.diffuse_color[0],
-              mat.diffuse_color[1], mat.diffuse_color[2]);
-
-  glUniform4f(shader_param_.material_specular_, mat.specular_color[0],
-              mat.specular_color[1],
-              mat.specular_color[2],
-              mat.specular_color[3]);
-  //
-  //using glUniform3fv here was troublesome
-  //
-  glUniform3f(shader_param_.material_ambient_, mat.ambient_color[0],
-              mat.ambient_color[1], mat.ambient_color[2]);
-
-  glUniformMatrix4fv(shader_param_.matrix_projection_, 1, GL_FALSE,
-                     mat_vp.Ptr());
-  glUniformMatrix4fv(shader_param_.matrix_view_, 1, GL_FALSE, mat_view_.Ptr());
-
-  //Dynamic light
-  glUniform3f(shader_param_.light0_, 200.f, -200.f, -200.f);
-  glUniform3f(shader_param_.camera_pos_, CAM_X, CAM_Y, CAM_Z);
-
-  // Set cubemap
-  glEnable(GL_TEXTURE_CUBE_MAP);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, tex_cubemap_);
-  glUniform1i(shader_param_.sampler0_, 0);
-  glUniform2f(shader_param_.roughness_, roughness_, MIPLEVELS-1);
-
-  glDrawElements(GL_TRIANGLES, num_indices_, GL_UNSIGNED_SHORT,
-                 BUFFER_OFFSET(0));
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+//--------------------------------------------------------------------------------
+// Baseline of RenderInstanced(), a draw and a set of uniforms per instance
+//--------------------------------------------------------------------------------
+void TeapotRenderer::RenderPerDraw(RenderQueue* queue) {
+  // The specular color comes from the material table, per instance colors
+  // are instanced only. The queue sorts the draws front to back.
+  UniformBlocks* blocks = UniformBlocks::GetInstance();
+  const GLuint program = variants_.Get(GetFeatures(current_material, false));
+  for (size_t i = 0; i < instances_.size(); ++i) {
+    const ndk_helper::Mat4 mat_model(instances_[i].transform);
+    OBJECT_UNIFORMS object;
+    GetObjectUniforms(mat_model, instances_[i].roughness, &object);
+    queue->Push(GetDrawPacket(program, blocks->AddObject(object),
+                              GetViewDepth(mat_view_ * mat_model)));
+  }
 }
 
-bool TeapotRenderer::LoadShaders(SHADER_PARAMS* params, const char* strVsh,
-                                 const char* strFsh) {
+GLuint TeapotRenderer::CreateProgram(const char* strVsh, const char* strFsh,
+                                     const uint32_t features) {
   GLuint program;
   GLuint vert_shader, frag_shader;
-  char* vert_shader_pathname, *frag_shader_pathname;
 
   // Create shader program
   program = glCreateProgram();
   LOGI("Created Shader %d", program);
 
+  // Samples a samplerCubeArray or an octahedral sampler2D instead of a
+  // samplerCube, the other features follow as #defines
+  ENVMAP_TYPE envmap_type = ENVMAP_CUBEMAP;
+  if (features & TEAPOT_SHADER_CUBEMAP_ARRAY)
+    envmap_type = ENVMAP_CUBEMAP_ARRAY;
+  else if (features & TEAPOT_SHADER_OCTAHEDRAL)
+    envmap_type = ENVMAP_OCTAHEDRAL;
+  const bool instanced = (features & TEAPOT_SHADER_INSTANCED) != 0;
+  std::map<std::string, std::string> params;
+  CubemapTexture::GetShaderParams(envmap_type, &params);
+  std::string& header = params["#version 300 es"];
+  if (header.empty()) header = "#version 300 es";
+  header += variants_.GetDefines(features);
+
   // Create and compile vertex shader
   if (!ndk_helper::shader::CompileShader(&vert_shader, GL_VERTEX_SHADER,
-                                         strVsh)) {
+                                         strVsh, params)) {
     LOGI("Failed to compile vertex shader");
     glDeleteProgram(program);
-    return false;
+    return 0;
   }
 
   // Create and compile fragment shader
   if (!ndk_helper::shader::CompileShader(&frag_shader, GL_FRAGMENT_SHADER,
-                                         strFsh)) {
+                                         strFsh, params)) {
     LOGI("Failed to compile fragment shader");
     glDeleteProgram(program);
-    return false;
+    return 0;
   }
 
   // Attach vertex shader to program
@@ -359,6 +605,14 @@ bool TeapotRenderer::LoadShaders(SHADER_PARAMS* params, const char* strVsh,
   glBindAttribLocation(program, ATTRIB_VERTEX, "myVertex");
   glBindAttribLocation(program, ATTRIB_NORMAL, "myNormal");
   glBindAttribLocation(program, ATTRIB_UV, "myUV");
+  if (instanced) {
+    glBindAttribLocation(program, ATTRIB_INSTANCE_TRANSFORM,
+                         "myInstanceTransform");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_SPECULAR,
+                         "myInstanceSpecular");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_ROUGHNESS,
+                         "myInstanceRoughness");
+  }
 
   // Link program
   if (!ndk_helper::shader::LinkProgram(program)) {
@@ -376,49 +630,47 @@ bool TeapotRenderer::LoadShaders(SHADER_PARAMS* params, const char* strVsh,
       glDeleteProgram(program);
     }
 
-    return false;
+    return 0;
   }
 
-  // Get uniform locations
-  params->matrix_projection_ = glGetUniformLocation(program, "uPMatrix");
-  params->matrix_view_ = glGetUniformLocation(program, "uMVMatrix");
-
-  params->light0_ = glGetUniformLocation(program, "vLight0");
-  params->camera_pos_ =  glGetUniformLocation(program, "vCamera");
-  params->material_diffuse_ = glGetUniformLocation(program, "vMaterialDiffuse");
-  params->material_ambient_ = glGetUniformLocation(program, "vMaterialAmbient");
-  params->material_specular_ =
-      glGetUniformLocation(program, "vMaterialSpecular");
-  params->sampler0_ = glGetUniformLocation( program, "sCubemapTexture" );
-
-  params->roughness_ = glGetUniformLocation(program, "vRoughness");
-
-
   // Release vertex and fragment shaders
   if (vert_shader) glDeleteShader(vert_shader);
   if (frag_shader) glDeleteShader(frag_shader);
 
-  params->program_ = program;
-  return true;
+  return program;
 }
 
-bool TeapotRenderer::Bind(ndk_helper::TapCamera* camera) {
-  camera_ = camera;
-  return true;
+//--------------------------------------------------------------------------------
+// Program state, the same for every user of a shared program
+//--------------------------------------------------------------------------------
+void TeapotRenderer::SetupProgram(const GLuint program) {
+  UniformBlocks::BindProgram(program);
+  GLStateCache::GetInstance()->UseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "sCubemapTexture"), 0);
 }
 
 //
 //Material control
 //
-void TeapotRenderer::SwitchMaterial()
+void TeapotRenderer::SetMaterial(const int32_t material)
 {
-  current_material = (current_material + 1) % NUM_MATERIALS;
+  current_material = material % NUM_MATERIALS;
 }
 
-const char* TeapotRenderer::GetMaterialName()
+const char* TeapotRenderer::GetMaterialName(const int32_t material)
 {
-  return materials_[current_material].material_name;
+  return materials_[material % NUM_MATERIALS].material_name;
 }
 
+int32_t TeapotRenderer::GetMaterialCount()
+{
+  return NUM_MATERIALS;
+}
 
-
+uint32_t TeapotRenderer::GetMaterialFeatures(const int32_t material)
+{
+  const float* diffuse = materials_[material % NUM_MATERIALS].material.diffuse_color;
+  if (diffuse[0] > 0.f || diffuse[1] > 0.f || diffuse[2] > 0.f)
+    return TEAPOT_SHADER_DIFFUSE;
+  return 0;
+}
@@ -27,6 +27,7 @@
 #include <jni.h>
 #include <errno.h>
 
+#include <algorithm>
 #include <vector>
 
 #include <EGL/egl.h>
@@ -43,35 +44,39 @@
 #define APPLICATION_CLASS_NAME "com/sample/teapot/TeapotApplication"
 
 #include "NDKHelper.h"
+#include "ResourceRegistry.h"
+#include "Mesh.h"
+#include "UniformBlocks.h"
+#include "RenderQueue.h"
+#include "FramePackets.h"
+#include "ShaderVariants.h"
 
 const int32_t MIPLEVELS = 6;
 
 #define BUFFER_OFFSET(i) ((char*)NULL + (i))
 
-struct TEAPOT_VERTEX {
-  float pos[3];
-  float normal[3];
-};
+const char* const TEAPOT_MESH = "Meshes/teapot.mesh";
 
+// Locations of the MESH_SEMANTICs, followed by the per instance attributes
 enum SHADER_ATTRIBUTES {
   ATTRIB_VERTEX,
   ATTRIB_NORMAL,
   ATTRIB_UV,
+  // A mat4 takes 4 locations
+  ATTRIB_INSTANCE_TRANSFORM,
+  ATTRIB_INSTANCE_SPECULAR = ATTRIB_INSTANCE_TRANSFORM + 4,
+  ATTRIB_INSTANCE_ROUGHNESS,
 };
 
-struct SHADER_PARAMS {
-  GLuint program_;
-  GLuint light0_;
-  GLuint camera_pos_;
-  GLuint material_diffuse_;
-  GLuint material_ambient_;
-  GLuint material_specular_;
-
-  GLuint matrix_projection_;
-  GLuint matrix_view_;
-
-  GLuint sampler0_;
-  GLuint roughness_;
+// Feature bits of the ShaderPlain variants, uniforms are in the blocks of
+// UniformBlocks.h
+enum TEAPOT_SHADER_FEATURE {
+  TEAPOT_SHADER_INSTANCED = 1 << 0,
+  // Sampler of the stages, see CubemapTexture::GetShaderParams()
+  TEAPOT_SHADER_CUBEMAP_ARRAY = 1 << 1,
+  TEAPOT_SHADER_OCTAHEDRAL = 1 << 2,
+  // Lambert term of the light and the envmap, metals have none
+  TEAPOT_SHADER_DIFFUSE = 1 << 3,
 };
 
 struct TEAPOT_MATERIALS {
@@ -80,28 +85,73 @@ struct TEAPOT_MATERIALS {
   float ambient_color[3];
 };
 
+// Interleaved in the instance buffer, transform is column major in object
+// space of the teapot and scales uniformly
+struct TEAPOT_INSTANCE {
+  float transform[16];
+  float specular_color[4];
+  float roughness;
+};
+
 struct MATERIAL_PARAMETERS {
   const char* material_name;
   TEAPOT_MATERIALS material;
 };
 
 class TeapotRenderer {
-  int32_t num_indices_;
-  int32_t num_vertices_;
-  GLuint ibo_;
-  GLuint vbo_;
-
-  SHADER_PARAMS shader_param_;
-  bool LoadShaders(SHADER_PARAMS* params, const char* strVsh,
-                   const char* strFsh);
+  Mesh mesh_;
+
+  // ShaderPlain by TEAPOT_SHADER_FEATURE bits
+  ShaderVariants variants_;
+  // false draws every material with the diffuse path
+  bool select_variants_;
+  GLuint CreateProgram(const char* strVsh, const char* strFsh,
+                       const uint32_t features);
+  static void SetupProgram(const GLuint program);
+  uint32_t GetFeatures(const int32_t material, const bool instanced) const;
+  void PrewarmVariants();
+  void UpdateProgram();
+  void UpdateFrameUniforms();
+  void GetObjectUniforms(const ndk_helper::Mat4& mat_model,
+                         const float roughness, OBJECT_UNIFORMS* object);
+  DRAW_PACKET GetDrawPacket(const GLuint program, const int32_t object,
+                            const float depth) const;
+  // Normalized view depth of the bounds for the sort key
+  float GetViewDepth(const ndk_helper::Mat4& mat_view) const;
+  void RenderInstanced(RenderQueue* queue);
+  void CreateInstanceVertexArray();
+  void RenderPerDraw(RenderQueue* queue);
+  void SetCubemap(CubemapTexture* cubemap);
+  // Finest cubemap level the shader samples at the current roughness
+  int32_t GetRequiredLevel() const;
 
   ndk_helper::Mat4 mat_projection_;
   ndk_helper::Mat4 mat_view_;
   ndk_helper::Mat4 mat_model_;
 
-  ndk_helper::TapCamera* camera_;
-
-  GLuint tex_cubemap_;
+  int32_t viewport_height_;
+
+  // Mesh LOD drawn, chosen in Update() unless overridden
+  int32_t lod_;
+  int32_t lod_override_;
+  void UpdateLod();
+  // Projected size of an object space unit at the bounds
+  float GetPixelsPerUnit(const ndk_helper::Mat4& mat_view) const;
+
+  // Drawn instead of the single teapot when not empty
+  std::vector<TEAPOT_INSTANCE> instances_;
+  GLuint instance_vbo_;
+  GLuint instance_vao_;
+  bool instances_dirty_;
+  bool instancing_;
+  float min_instance_roughness_;
+
+  CubemapTexture* cubemap_;
+  // Sampler the program is compiled for, valid once the first cubemap set it
+  ENVMAP_TYPE envmap_type_;
+  bool envmap_type_valid_;
+  // x: layer, y: previous layer, z: blend weight of the previous layer
+  float cubemap_layers_[3];
 
   float roughness_;
 
@@ -112,16 +162,48 @@ class TeapotRenderer {
   TeapotRenderer();
   virtual ~TeapotRenderer();
   void Init();
-  void Render();
-  void Update(const double time);
-  bool Bind(ndk_helper::TapCamera* camera);
+  // Pushes the draws of the frame, drawn by RenderQueue::Execute()
+  void Render(RenderQueue* queue);
+  void Update(const FRAME_PACKET& frame);
   void Unload();
   void UpdateViewport();
   void SetRoughness(const float f) {roughness_ = f;}
-  void SwitchStage(const char* file_name);
-
-  void SwitchMaterial();
-  const char* GetMaterialName();
+  void SwitchStage(const char* file_name, const bool octahedral = false);
+  void SetStageArray(const std::vector<std::string>& file_names);
+  void SetStageLayers(const int32_t layer, const int32_t previous_layer,
+                      const float blend);
+
+  void SetMaterial(const int32_t material);
+  // Static table, safe from any thread
+  static const char* GetMaterialName(const int32_t material);
+  static int32_t GetMaterialCount();
+  // Cheapest TEAPOT_SHADER_FEATURE bits rendering the material correctly
+  static uint32_t GetMaterialFeatures(const int32_t material);
+  void SetSelectVariants(const bool select) { select_variants_ = select; }
+  int32_t GetVariantCount() const { return variants_.GetProgramCount(); }
+
+  // -1 selects by screen size
+  void SetLodOverride(const int32_t lod) { lod_override_ = lod; }
+  int32_t GetLodCount() const { return mesh_.GetLodCount(); }
+  int32_t GetTriangleCount() const {
+    return mesh_.GetTriangleCount(lod_) *
+           std::max(static_cast<int32_t>(instances_.size()), 1);
+  }
+
+  /*
+   * Instances of the teapot, an empty vector draws the single teapot again.
+   * All of them are drawn with one glDrawElementsInstanced(), or with a
+   * glDrawElements() and a set of uniforms each when instancing is off. The
+   * whole set shares the LOD of the nearest instance.
+   */
+  void SetInstances(const std::vector<TEAPOT_INSTANCE>& instances);
+  // size x size grid in the footprint of the teapot, specular color blends
+  // across the materials along x, roughness increases along y. 0 clears it.
+  void SetInstanceGrid(const int32_t size);
+  void SetInstancing(const bool instancing) { instancing_ = instancing; }
+  int32_t GetInstanceCount() const {
+    return static_cast<int32_t>(instances_.size());
+  }
 };
 
 #endif
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// TexturePool.cpp
+// Pool of immutable cubemap texture objects
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "TexturePool.h"
+#include "GLStateCache.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+TexturePool::TexturePool() : allocations_(0), reuses_(0) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+TexturePool::~TexturePool() {}
+
+//--------------------------------------------------------------------------------
+// Storage of a 4 bytes per texel chain
+//--------------------------------------------------------------------------------
+int32_t TexturePool::GetCubemapBytes(const GLenum target, const GLsizei layers,
+                                     const GLsizei levels, const GLsizei size) {
+  const int32_t faces = target == GL_TEXTURE_2D ? 1 : 6;
+  int32_t bytes = 0;
+  for (int32_t level = 0; level < levels; ++level) {
+    const int32_t level_size = size >> level;
+    bytes += faces * layers * level_size * level_size * 4;
+  }
+  return bytes;
+}
+
+GLuint TexturePool::AcquireCubemap(const GLenum target, const GLsizei layers,
+                                   const GLsizei levels, const GLsizei size,
+                                   const GLenum format) {
+  std::vector<POOLED_TEXTURE>::iterator it = textures_.begin();
+  for (; it != textures_.end(); ++it) {
+    if (it->target == target && it->layers == layers &&
+        it->levels == levels && it->size == size && it->format == format) {
+      GLuint tex = it->tex;
+      textures_.erase(it);
+      reuses_++;
+      GLStateCache::GetInstance()->BindTexture(target, tex);
+      return tex;
+    }
+  }
+
+  GLuint tex;
+  glGenTextures(1, &tex);
+  GLStateCache::GetInstance()->BindTexture(target, tex);
+  if (target == GL_TEXTURE_CUBE_MAP || target == GL_TEXTURE_2D)
+    glTexStorage2D(target, levels, format, size, size);
+  else
+    // Depth counts layer-faces
+    glTexStorage3D(target, levels, format, size, size, 6 * layers);
+  allocations_++;
+  return tex;
+}
+
+void TexturePool::ReleaseCubemap(const GLuint tex, const GLenum target,
+                                 const GLsizei layers, const GLsizei levels,
+                                 const GLsizei size, const GLenum format) {
+  if (textures_.size() >= TEXTURE_POOL_SIZE) {
+    GLStateCache::GetInstance()->DeleteTexture(textures_.front().tex);
+    textures_.erase(textures_.begin());
+  }
+  POOLED_TEXTURE pooled = { tex, target, layers, levels, size, format };
+  textures_.push_back(pooled);
+}
+
+void TexturePool::Clear() {
+  std::vector<POOLED_TEXTURE>::iterator it = textures_.begin();
+  for (; it != textures_.end(); ++it)
+    GLStateCache::GetInstance()->DeleteTexture(it->tex);
+  textures_.clear();
+}
+
+int32_t TexturePool::GetPooledBytes() const {
+  int32_t bytes = 0;
+  std::vector<POOLED_TEXTURE>::const_iterator it = textures_.begin();
+  for (; it != textures_.end(); ++it)
+    bytes += GetCubemapBytes(it->target, it->layers, it->levels, it->size);
+  return bytes;
+}
+
+void TexturePool::DumpStatistics() const {
+  LOGI("Texture pool allocations:%d reuses:%d pooled:%d bytes", allocations_,
+       reuses_, GetPooledBytes());
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// TexturePool.h
+// Pool of immutable cubemap texture objects
+//--------------------------------------------------------------------------------
+#ifndef _TEXTUREPOOL_H
+#define _TEXTUREPOOL_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <vector>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Released textures kept for reuse
+const int32_t TEXTURE_POOL_SIZE = 2;
+
+struct POOLED_TEXTURE {
+  GLuint tex;
+  GLenum target;
+  // Cubemaps in a GL_TEXTURE_CUBE_MAP_ARRAY_EXT, 1 for GL_TEXTURE_CUBE_MAP
+  // and GL_TEXTURE_2D
+  GLsizei layers;
+  GLsizei levels;
+  GLsizei size;
+  GLenum format;
+};
+
+/******************************************************************
+ * Cubemaps are allocated with glTexStorage2D, or glTexStorage3D for cubemap
+ * arrays, for their whole chain, so their
+ * shape never changes after creation. Octahedral environment maps are plain
+ * GL_TEXTURE_2D chains and pooled the same way. Released textures of the same shape are
+ * handed out again instead of deleting and reallocating them on every stage
+ * switch.
+ *
+ * Thread safety: the pool issues GL calls and must be used on the GL thread
+ * only.
+ */
+class TexturePool {
+  // Oldest first
+  std::vector<POOLED_TEXTURE> textures_;
+  int32_t allocations_;
+  int32_t reuses_;
+
+  TexturePool(TexturePool const&);
+  void operator=(TexturePool const&);
+  TexturePool();
+  virtual ~TexturePool();
+
+ public:
+  static TexturePool* GetInstance() {
+    //Singleton, never destroyed like the resource registry
+    static TexturePool* instance = new TexturePool();
+
+    return instance;
+  }
+
+  static int32_t GetCubemapBytes(const GLenum target, const GLsizei layers,
+                                 const GLsizei levels, const GLsizei size);
+
+  // Returns a cubemap (array) bound to target
+  GLuint AcquireCubemap(const GLenum target, const GLsizei layers,
+                        const GLsizei levels, const GLsizei size,
+                        const GLenum format);
+  void ReleaseCubemap(const GLuint tex, const GLenum target,
+                      const GLsizei layers, const GLsizei levels,
+                      const GLsizei size, const GLenum format);
+  void Clear();
+
+  int32_t GetPooledBytes() const;
+  void DumpStatistics() const;
+};
+
+#endif
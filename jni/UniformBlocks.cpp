@@ -0,0 +1,202 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// UniformBlocks.cpp
+// std140 uniform buffers shared by the programs
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <string.h>
+
+#include <algorithm>
+
+#include "UniformBlocks.h"
+#include "GLStateCache.h"
+#include "DynamicRing.h"
+
+static const char* const UNIFORM_BLOCK_NAMES[UNIFORM_BLOCKS] = {
+    "FrameUniforms", "MaterialUniforms", "ObjectUniforms",
+};
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+UniformBlocks::UniformBlocks()
+    : frame_valid_(false),
+      frame_buffer_(0),
+      frame_offset_(0),
+      frame_uploaded_(false),
+      object_stride_(0),
+      object_alignment_(1),
+      object_count_(0),
+      uploaded_objects_(0),
+      object_buffer_(0),
+      object_offset_(0) {
+  for (int32_t i = 0; i < UNIFORM_BLOCKS; ++i) buffers_[i] = 0;
+}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+UniformBlocks::~UniformBlocks() {}
+
+//--------------------------------------------------------------------------------
+// Created on first use, the material table stays bound. The frame buffer is
+// the fallback when the ring is full.
+//--------------------------------------------------------------------------------
+void UniformBlocks::Init() {
+  if (buffers_[0]) return;
+
+  GLStateCache* state = GLStateCache::GetInstance();
+  glGenBuffers(UNIFORM_BLOCKS, buffers_);
+  state->BindBuffer(GL_UNIFORM_BUFFER, buffers_[UNIFORM_BLOCK_FRAME]);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FRAME_UNIFORMS), NULL,
+               GL_DYNAMIC_DRAW);
+  state->BindBuffer(GL_UNIFORM_BUFFER, buffers_[UNIFORM_BLOCK_MATERIALS]);
+  glBufferData(GL_UNIFORM_BUFFER,
+               sizeof(MATERIAL_UNIFORMS) * MATERIAL_TABLE_SIZE, NULL,
+               GL_STATIC_DRAW);
+  state->BindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_MATERIALS,
+                        buffers_[UNIFORM_BLOCK_MATERIALS]);
+
+  GLint alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  alignment = std::max(alignment, 1);
+  object_alignment_ = alignment;
+  object_stride_ = (sizeof(OBJECT_UNIFORMS) + alignment - 1) / alignment *
+                   alignment;
+  frame_valid_ = false;
+}
+
+void UniformBlocks::Release() {
+  if (buffers_[0] == 0) return;
+
+  GLStateCache* state = GLStateCache::GetInstance();
+  for (int32_t i = 0; i < UNIFORM_BLOCKS; ++i) {
+    state->DeleteBuffer(buffers_[i]);
+    buffers_[i] = 0;
+  }
+  object_buffer_ = 0;
+  uploaded_objects_ = 0;
+  frame_buffer_ = 0;
+  frame_uploaded_ = false;
+  frame_valid_ = false;
+}
+
+void UniformBlocks::BindProgram(const GLuint program) {
+  for (int32_t i = 0; i < UNIFORM_BLOCKS; ++i) {
+    const GLuint index = glGetUniformBlockIndex(program, UNIFORM_BLOCK_NAMES[i]);
+    if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, i);
+  }
+}
+
+//--------------------------------------------------------------------------------
+// A new range of the DynamicRing each frame, no glBufferSubData() into a buffer
+// the previous frames may still read. Unchanged values are not copied again
+// while their range is valid, in this frame or in the fallback buffer.
+//--------------------------------------------------------------------------------
+void UniformBlocks::SetFrame(const FRAME_UNIFORMS& frame) {
+  Init();
+  const bool unchanged =
+      frame_valid_ && memcmp(&frame, &frame_, sizeof(frame)) == 0;
+  if (unchanged && (frame_uploaded_ ||
+                    frame_buffer_ == buffers_[UNIFORM_BLOCK_FRAME]))
+    return;
+
+  frame_ = frame;
+  frame_valid_ = true;
+  GLStateCache* state = GLStateCache::GetInstance();
+  DYNAMIC_ALLOCATION allocation;
+  DynamicRing* ring = DynamicRing::GetInstance();
+  if (ring->Allocate(sizeof(frame), object_alignment_, &allocation)) {
+    memcpy(allocation.data, &frame, sizeof(frame));
+    ring->Flush();
+    frame_buffer_ = allocation.buffer;
+    frame_offset_ = allocation.offset;
+  } else {
+    // The ring grows on the next frame
+    state->BindBuffer(GL_UNIFORM_BUFFER, buffers_[UNIFORM_BLOCK_FRAME]);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+    frame_buffer_ = buffers_[UNIFORM_BLOCK_FRAME];
+    frame_offset_ = 0;
+  }
+  frame_uploaded_ = true;
+  state->BindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_FRAME, frame_buffer_,
+                         frame_offset_, sizeof(FRAME_UNIFORMS));
+}
+
+void UniformBlocks::SetMaterials(const MATERIAL_UNIFORMS* materials,
+                                 const int32_t count) {
+  Init();
+  GLStateCache::GetInstance()->BindBuffer(GL_UNIFORM_BUFFER,
+                                          buffers_[UNIFORM_BLOCK_MATERIALS]);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0,
+                  sizeof(MATERIAL_UNIFORMS) *
+                      std::min(count, MATERIAL_TABLE_SIZE),
+                  materials);
+}
+
+//--------------------------------------------------------------------------------
+// Frame and objects
+//--------------------------------------------------------------------------------
+void UniformBlocks::BeginFrame() {
+  frame_uploaded_ = false;
+  object_count_ = 0;
+  uploaded_objects_ = 0;
+}
+
+int32_t UniformBlocks::AddObject(const OBJECT_UNIFORMS& object) {
+  Init();
+  const size_t size = (object_count_ + 1) * object_stride_;
+  if (objects_.size() < size) objects_.resize(size);
+  memcpy(&objects_[object_count_ * object_stride_], &object, sizeof(object));
+  return object_count_++;
+}
+
+//--------------------------------------------------------------------------------
+// All objects of the frame in one range of the DynamicRing. Objects added
+// after an upload are uploaded with the earlier ones into a new range, the
+// draws issued so far keep the old one.
+//--------------------------------------------------------------------------------
+void UniformBlocks::UploadObjects() {
+  if (uploaded_objects_ == object_count_) return;
+
+  const GLsizeiptr size = object_count_ * object_stride_;
+  DYNAMIC_ALLOCATION allocation;
+  DynamicRing* ring = DynamicRing::GetInstance();
+  if (ring->Allocate(size, object_alignment_, &allocation)) {
+    memcpy(allocation.data, &objects_[0], size);
+    ring->Flush();
+    object_buffer_ = allocation.buffer;
+    object_offset_ = allocation.offset;
+  } else {
+    // The ring grows on the next frame, orphan the fallback buffer meanwhile
+    GLStateCache::GetInstance()->BindBuffer(GL_UNIFORM_BUFFER,
+                                            buffers_[UNIFORM_BLOCK_OBJECT]);
+    glBufferData(GL_UNIFORM_BUFFER, size, &objects_[0], GL_STREAM_DRAW);
+    object_buffer_ = buffers_[UNIFORM_BLOCK_OBJECT];
+    object_offset_ = 0;
+  }
+  uploaded_objects_ = object_count_;
+}
+
+void UniformBlocks::BindObject(const int32_t object) {
+  GLStateCache::GetInstance()->BindBufferRange(
+      GL_UNIFORM_BUFFER, UNIFORM_BLOCK_OBJECT, object_buffer_,
+      object_offset_ + object * object_stride_, sizeof(OBJECT_UNIFORMS));
+}
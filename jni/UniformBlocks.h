@@ -0,0 +1,137 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// UniformBlocks.h
+// std140 uniform buffers shared by the programs
+//--------------------------------------------------------------------------------
+#ifndef _UNIFORMBLOCKS_H
+#define _UNIFORMBLOCKS_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <vector>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Binding points, the blocks are declared in the shaders with these names
+enum UNIFORM_BLOCK {
+  UNIFORM_BLOCK_FRAME,      // FrameUniforms
+  UNIFORM_BLOCK_MATERIALS,  // MaterialUniforms
+  UNIFORM_BLOCK_OBJECT,     // ObjectUniforms
+  UNIFORM_BLOCKS,
+};
+
+// Entries of the material table, MATERIAL_TABLE_SIZE in the shaders
+const int32_t MATERIAL_TABLE_SIZE = 16;
+
+// std140 layouts, all members are vec4 or mat4 sized so that the C++ and the
+// GLSL offsets agree without padding rules
+struct FRAME_UNIFORMS {
+  float light0[4];
+  float camera[4];
+  // x: layer, y: previous layer, z: blend weight of the previous layer
+  float cubemap_layers[4];
+  // x: mip levels - 1, y: finest resident level
+  float envmap[4];
+};
+
+struct MATERIAL_UNIFORMS {
+  float diffuse_color[4];
+  float ambient_color[4];
+  float specular_color[4];
+};
+
+struct OBJECT_UNIFORMS {
+  float model_view[16];
+  float model_view_projection[16];
+  // x: material index, y: roughness
+  float material[4];
+};
+
+/******************************************************************
+ * Uniform buffers replace the glUniform*() calls of the renderers.
+ *
+ * FrameUniforms is allocated from the DynamicRing once per frame and bound
+ * with glBindBufferRange(), setting the same values again in a frame does not
+ * copy them.
+ * MaterialUniforms is the material table, uploaded when the materials are
+ * set. ObjectUniforms of all draws of a frame are appended with AddObject(),
+ * uploaded together into the DynamicRing with UploadObjects() and selected
+ * per draw by BindObject() with glBindBufferRange().
+ *
+ * BindProgram() connects the blocks a program declares to the binding points,
+ * once after linking.
+ *
+ * Thread safety: GL thread only.
+ */
+class UniformBlocks {
+  GLuint buffers_[UNIFORM_BLOCKS];
+  FRAME_UNIFORMS frame_;
+  bool frame_valid_;
+  // Range of frame_, in the ring only until the frame ends
+  GLuint frame_buffer_;
+  GLintptr frame_offset_;
+  bool frame_uploaded_;
+
+  // Objects of the frame, object_stride_ apart for the offset alignment
+  std::vector<uint8_t> objects_;
+  int32_t object_stride_;
+  int32_t object_alignment_;
+  int32_t object_count_;
+  int32_t uploaded_objects_;
+  // Range of the uploaded objects
+  GLuint object_buffer_;
+  GLintptr object_offset_;
+
+  UniformBlocks(UniformBlocks const&);
+  void operator=(UniformBlocks const&);
+  UniformBlocks();
+  virtual ~UniformBlocks();
+
+  void Init();
+
+ public:
+  static UniformBlocks* GetInstance() {
+    //Singleton, never destroyed like the texture pool
+    static UniformBlocks* instance = new UniformBlocks();
+
+    return instance;
+  }
+
+  static void BindProgram(const GLuint program);
+
+  // Delete the buffers, e.g. before the context is lost
+  void Release();
+
+  void SetFrame(const FRAME_UNIFORMS& frame);
+  void SetMaterials(const MATERIAL_UNIFORMS* materials, const int32_t count);
+
+  // Drop the frame block and the objects of the previous frame, after
+  // DynamicRing::BeginFrame()
+  void BeginFrame();
+  // Returns the index for BindObject()
+  int32_t AddObject(const OBJECT_UNIFORMS& object);
+  int32_t GetObjectCount() const { return object_count_; }
+  void UploadObjects();
+  void BindObject(const int32_t object);
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// UploadRing.cpp
+// Ring of pixel unpack buffers for texture uploads
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include "UploadRing.h"
+#include "GLStateCache.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+UploadRing::UploadRing() : next_slot_(0), maps_(0), stalls_(0) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+UploadRing::~UploadRing() {}
+
+int32_t UploadRing::Map(uint8_t** data) {
+  GLStateCache* state = GLStateCache::GetInstance();
+  if (slots_.empty()) {
+    // Created on first use, GL_STREAM_DRAW: written once, read once by GL
+    slots_.resize(UPLOAD_RING_SLOTS);
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      glGenBuffers(1, &slots_[i].buffer);
+      state->BindBuffer(GL_PIXEL_UNPACK_BUFFER, slots_[i].buffer);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, UPLOAD_SLOT_SIZE, NULL,
+                   GL_STREAM_DRAW);
+      slots_[i].fence = 0;
+      slots_[i].mapped = false;
+    }
+    state->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  int32_t slot = -1;
+  for (int32_t i = 0; i < UPLOAD_RING_SLOTS; ++i) {
+    const int32_t candidate = (next_slot_ + i) % UPLOAD_RING_SLOTS;
+    if (!slots_[candidate].mapped) {
+      slot = candidate;
+      break;
+    }
+  }
+  if (slot < 0) return -1;
+  next_slot_ = (slot + 1) % UPLOAD_RING_SLOTS;
+
+  UPLOAD_SLOT& s = slots_[slot];
+  bool synchronized = false;
+  if (s.fence) {
+    // The GPU should be done with a slot from two uploads ago
+    if (glClientWaitSync(s.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      stalls_++;
+      const GLenum result = glClientWaitSync(
+          s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UPLOAD_FENCE_TIMEOUT);
+      if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+        // The GPU may still read the slot, let the driver synchronize
+        LOGI("Upload slot %d fence wait timed out, mapping synchronized",
+             slot);
+        synchronized = true;
+      }
+    }
+    glDeleteSync(s.fence);
+    s.fence = 0;
+  }
+
+  // Fenced above, no need for the driver to synchronize unless timed out
+  GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+  if (!synchronized) access |= GL_MAP_UNSYNCHRONIZED_BIT;
+  state->BindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+  void* p =
+      glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, UPLOAD_SLOT_SIZE, access);
+  state->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (p == NULL) {
+    LOGI("Failed to map upload slot %d", slot);
+    return -1;
+  }
+
+  s.mapped = true;
+  maps_++;
+  *data = static_cast<uint8_t*>(p);
+  return slot;
+}
+
+bool UploadRing::Unmap(const int32_t slot) {
+  UPLOAD_SLOT& s = slots_[slot];
+  s.mapped = false;
+  GLStateCache* state = GLStateCache::GetInstance();
+  state->BindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+  if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+    LOGI("Upload slot %d was corrupted", slot);
+    state->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return false;
+  }
+  return true;
+}
+
+void UploadRing::Fence(const int32_t slot) {
+  slots_[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  GLStateCache::GetInstance()->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void UploadRing::Cancel(const int32_t slot) {
+  if (Unmap(slot))
+    GLStateCache::GetInstance()->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void UploadRing::Release() {
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    if (slots_[i].mapped) return;
+  }
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    if (slots_[i].fence) glDeleteSync(slots_[i].fence);
+    GLStateCache::GetInstance()->DeleteBuffer(slots_[i].buffer);
+  }
+  slots_.clear();
+}
+
+void UploadRing::DumpStatistics() const {
+  LOGI("Upload ring maps:%d fence stalls:%d", maps_, stalls_);
+}
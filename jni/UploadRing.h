@@ -0,0 +1,96 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// UploadRing.h
+// Ring of pixel unpack buffers for texture uploads
+//--------------------------------------------------------------------------------
+#ifndef _UPLOADRING_H
+#define _UPLOADRING_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <vector>
+
+#include "NDKHelper.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// One in flight, one being filled, one spare
+const int32_t UPLOAD_RING_SLOTS = 3;
+// Fits the largest level uploaded, a 256x256 RGBA octahedral level 0
+const int32_t UPLOAD_SLOT_SIZE = 256 * 256 * 4;
+// Upper bound of a fence wait in ns
+const GLuint64 UPLOAD_FENCE_TIMEOUT = 100000000;
+
+struct UPLOAD_SLOT {
+  GLuint buffer;
+  // Signaled once the uploads from the slot are done
+  GLsync fence;
+  bool mapped;
+};
+
+/******************************************************************
+ * Uploads from client memory make the driver copy the pixels on the GL thread.
+ * Here decode workers write into a slot mapped with glMapBufferRange instead,
+ * and glTexSubImage*() then sources the pixels from the
+ * GL_PIXEL_UNPACK_BUFFER, so the transfer overlaps rendering.
+ *
+ * Map() hands out the next free slot, waiting on its fence if the GPU is still
+ * reading it. A slot whose fence times out is mapped synchronized. Unmap() binds the slot for the uploads, Fence() recycles it.
+ * Each slot is its own buffer object, so one slot can stay mapped across
+ * frames while uploads are issued from another.
+ *
+ * Thread safety: the ring issues GL calls and must be used on the GL thread
+ * only. Mapped memory may be written from any thread until Unmap().
+ */
+class UploadRing {
+  std::vector<UPLOAD_SLOT> slots_;
+  int32_t next_slot_;
+  int32_t maps_;
+  int32_t stalls_;
+
+  UploadRing(UploadRing const&);
+  void operator=(UploadRing const&);
+  UploadRing();
+  virtual ~UploadRing();
+
+ public:
+  static UploadRing* GetInstance() {
+    //Singleton, never destroyed like the texture pool
+    static UploadRing* instance = new UploadRing();
+
+    return instance;
+  }
+
+  // Returns the slot, or -1 when every slot is mapped
+  int32_t Map(uint8_t** data);
+  // Leaves the slot bound to GL_PIXEL_UNPACK_BUFFER, false when the contents
+  // were lost
+  bool Unmap(const int32_t slot);
+  // After the uploads from the slot have been issued, unbinds it
+  void Fence(const int32_t slot);
+  // Unmap without uploading
+  void Cancel(const int32_t slot);
+  // Delete the buffers unless a slot is mapped, e.g. before the context is lost
+  void Release();
+
+  void DumpStatistics() const;
+};
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// WorkerPool.cpp
+// Worker threads for CPU side asset processing
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <algorithm>
+
+#include <cpu-features.h>
+
+#include "WorkerPool.h"
+
+//--------------------------------------------------------------------------------
+// Ctor
+//--------------------------------------------------------------------------------
+WorkerPool::WorkerPool() : stopping_(false) {}
+
+//--------------------------------------------------------------------------------
+// Dtor
+//--------------------------------------------------------------------------------
+WorkerPool::~WorkerPool() { Shutdown(); }
+
+void WorkerPool::Start() {
+  // Leave a core to the GL thread
+  const int32_t count = std::max(android_getCpuCount() - 1, 1);
+  LOGI("Starting %d worker threads", count);
+  for (int32_t i = 0; i < count; ++i)
+    threads_.push_back(std::thread(&WorkerPool::Run, this));
+}
+
+void WorkerPool::Run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() { return !tasks_.empty() || stopping_; });
+      // Queued tasks still run, batches may be waiting for them
+      if (tasks_.empty()) break;
+      task = tasks_.front();
+      tasks_.pop_front();
+    }
+    task();
+  }
+  // Tasks attach through JNIHelper, ART aborts on an attached thread exiting
+  ndk_helper::JNIHelper::GetInstance()->DetachCurrentThread();
+}
+
+void WorkerPool::Submit(const std::function<void()>& task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (threads_.empty()) Start();
+    tasks_.push_back(task);
+  }
+  cond_.notify_one();
+}
+
+void WorkerPool::Shutdown() {
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    threads.swap(threads_);
+  }
+  cond_.notify_all();
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+}
+
+int32_t WorkerPool::GetThreadCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (threads_.empty()) Start();
+  return static_cast<int32_t>(threads_.size());
+}
+
+//--------------------------------------------------------------------------------
+// Batch
+//--------------------------------------------------------------------------------
+void WorkerBatch::Submit(const std::function<void()>& task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_++;
+  }
+  WorkerPool::GetInstance()->Submit([this, task]() {
+    task();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) cond_.notify_all();
+  });
+}
+
+void WorkerBatch::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+bool WorkerBatch::IsDone() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_ == 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// WorkerPool.h
+// Worker threads for CPU side asset processing
+//--------------------------------------------------------------------------------
+#ifndef _WORKERPOOL_H
+#define _WORKERPOOL_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NDKHelper.h"
+
+/******************************************************************
+ * Fixed set of worker threads, one per core except the one running the GL
+ * thread, started on the first Submit(). Shutdown() runs the queued tasks to
+ * completion and joins the threads, the next Submit() starts them again.
+ *
+ * Tasks must not issue GL calls. JNIHelper calls are fine, workers are
+ * attached to the VM on their first JNI call and detached when they exit.
+ */
+class WorkerPool {
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()> > tasks_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stopping_;
+
+  void Start();
+  void Run();
+
+  WorkerPool(WorkerPool const&);
+  void operator=(WorkerPool const&);
+  WorkerPool();
+  virtual ~WorkerPool();
+
+ public:
+  static WorkerPool* GetInstance() {
+    //Singleton, never destroyed, the workers live as long as the process
+    static WorkerPool* instance = new WorkerPool();
+
+    return instance;
+  }
+
+  void Submit(const std::function<void()>& task);
+  int32_t GetThreadCount();
+  void Shutdown();
+};
+
+/******************************************************************
+ * Counts outstanding tasks of one batch so that the submitter can block
+ * until the batch is done.
+ */
+class WorkerBatch {
+  int32_t pending_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+
+ public:
+  WorkerBatch() : pending_(0) {}
+
+  // Run task on the pool as part of this batch
+  void Submit(const std::function<void()>& task);
+  void Wait();
+  // Poll instead of blocking, e.g. once per frame
+  bool IsDone();
+};
+
+#endif
@@ -31,13 +31,21 @@ namespace ndk_helper {
 //--------------------------------------------------------------------------------
 const int32_t SWAPINTERVAL_DEFAULT = 1;
 
+//EGL_KHR_gl_colorspace
+#ifndef EGL_GL_COLORSPACE_KHR
+#define EGL_GL_COLORSPACE_KHR 0x309D
+#define EGL_GL_COLORSPACE_SRGB_KHR 0x3089
+#define EGL_GL_COLORSPACE_LINEAR_KHR 0x308A
+#endif
+
 //--------------------------------------------------------------------------------
 // Ctor
 //--------------------------------------------------------------------------------
 GLContext::GLContext()
     : window_(nullptr), display_(EGL_NO_DISPLAY), surface_(EGL_NO_SURFACE),
       context_(EGL_NO_CONTEXT), screen_width_(0), screen_height_(0),
-      msaa_size_(1), restoreInterval_(false),
+      window_width_(0), window_height_(0), buffer_scale_(1.f),
+      srgb_surface_(false), msaa_size_(1), restoreInterval_(false),
       swapInterval_(SWAPINTERVAL_DEFAULT), gles_initialized_(false),
       egl_context_initialized_(false), es3_supported_(false), gl_version_(0),
       context_valid_(false) {}
@@ -96,8 +104,6 @@ bool GLContext::InitEGLSurface() {
                              EGL_SURFACE_TYPE, EGL_WINDOW_BIT, EGL_BLUE_SIZE, 8,
                              EGL_GREEN_SIZE, 8, EGL_RED_SIZE, 8, EGL_DEPTH_SIZE,
                              24,
-//                             EGL_COLORSPACE, EGL_COLORSPACE_sRGB,
-//                             EGL_COLORSPACE, EGL_COLORSPACE_LINEAR,
                              EGL_SAMPLES, msaa_size_, EGL_NONE };
   color_size_ = 8;
   depth_size_ = 24;
@@ -136,18 +142,79 @@ bool GLContext::InitEGLSurface() {
     return false;
   }
 
-  surface_ = eglCreateWindowSurface(display_, config_, window_, NULL);
-  eglQuerySurface(display_, surface_, EGL_WIDTH, &screen_width_);
-  eglQuerySurface(display_, surface_, EGL_HEIGHT, &screen_height_);
+  CreateSurface();
+  return true;
+}
 
+void GLContext::CreateSurface() {
   /* EGL_NATIVE_VISUAL_ID is an attribute of the EGLConfig that is
    * guaranteed to be accepted by ANativeWindow_setBuffersGeometry().
    * As soon as we picked a EGLConfig, we can safely reconfigure the
    * ANativeWindow buffers to match, using EGL_NATIVE_VISUAL_ID. */
   EGLint format;
   eglGetConfigAttrib(display_, config_, EGL_NATIVE_VISUAL_ID, &format);
+  //0 reverts to the window size
   ANativeWindow_setBuffersGeometry(window_, 0, 0, format);
+  window_width_ = ANativeWindow_getWidth(window_);
+  window_height_ = ANativeWindow_getHeight(window_);
+  if (buffer_scale_ < 1.f) {
+    ANativeWindow_setBuffersGeometry(
+        window_, static_cast<int32_t>(window_width_ * buffer_scale_),
+        static_cast<int32_t>(window_height_ * buffer_scale_), format);
+  }
+
+  //The color space is a surface attribute, any config takes it
+  surface_ = EGL_NO_SURFACE;
+  if (srgb_surface_) {
+    if (CheckEGLExtension("EGL_KHR_gl_colorspace")) {
+      const EGLint surface_attribs[] = { EGL_GL_COLORSPACE_KHR,
+                                         EGL_GL_COLORSPACE_SRGB_KHR,
+                                         EGL_NONE };
+      surface_ =
+          eglCreateWindowSurface(display_, config_, window_, surface_attribs);
+    }
+    if (surface_ == EGL_NO_SURFACE) {
+      LOGW("No sRGB window surface");
+      srgb_surface_ = false;
+    }
+  }
+  if (surface_ == EGL_NO_SURFACE)
+    surface_ = eglCreateWindowSurface(display_, config_, window_, NULL);
+  eglQuerySurface(display_, surface_, EGL_WIDTH, &screen_width_);
+  eglQuerySurface(display_, surface_, EGL_HEIGHT, &screen_height_);
+}
+
+bool GLContext::SetBufferScale(const float scale) {
+  if (scale == buffer_scale_)
+    return true;
+
+  buffer_scale_ = scale;
+  return RecreateSurface();
+}
 
+bool GLContext::SetSRGBSurface(const bool srgb) {
+  if (srgb == srgb_surface_)
+    return true;
+
+  srgb_surface_ = srgb;
+  return RecreateSurface();
+}
+
+bool GLContext::RecreateSurface() {
+  if (surface_ == EGL_NO_SURFACE)
+    return true;
+
+  //Same context, new surface
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroySurface(display_, surface_);
+  CreateSurface();
+  if (eglMakeCurrent(display_, surface_, surface_, context_) == EGL_FALSE) {
+    LOGW("Unable to eglMakeCurrent");
+    return false;
+  }
+  eglSwapInterval(display_, swapInterval_);
+  LOGI("Window buffers %dx%d%s", screen_width_, screen_height_,
+       srgb_surface_ ? " sRGB" : "");
   return true;
 }
 
@@ -220,9 +287,7 @@ EGLint GLContext::Resume(ANativeWindow *window) {
 
   //Create surface
   window_ = window;
-  surface_ = eglCreateWindowSurface(display_, config_, window_, NULL);
-  eglQuerySurface(display_, surface_, EGL_WIDTH, &screen_width_);
-  eglQuerySurface(display_, surface_, EGL_HEIGHT, &screen_height_);
+  CreateSurface();
 
   if (screen_width_ != original_widhth || screen_height_ != original_height) {
     //Screen resized
@@ -264,6 +329,22 @@ bool GLContext::Invalidate() {
   return true;
 }
 
+bool GLContext::CheckEGLExtension(const char *extension) {
+  const char *extensions = eglQueryString(display_, EGL_EXTENSIONS);
+  if (extension == NULL || extensions == NULL)
+    return false;
+
+  //Whole names only, one can be the prefix of another
+  const size_t length = strlen(extension);
+  for (const char *p = strstr(extensions, extension); p;
+       p = strstr(p + length, extension)) {
+    if ((p == extensions || p[-1] == ' ') &&
+        (p[length] == ' ' || p[length] == '\0'))
+      return true;
+  }
+  return false;
+}
+
 bool GLContext::CheckExtension(const char *extension) {
   if (extension == NULL)
     return false;
@@ -64,6 +64,12 @@ private:
   //Screen parameters
   int32_t screen_width_;
   int32_t screen_height_;
+  //Size of the window, the buffers are smaller when scaled
+  int32_t window_width_;
+  int32_t window_height_;
+  float buffer_scale_;
+  //Requested and granted, see SetSRGBSurface()
+  bool srgb_surface_;
   int32_t color_size_;
   int32_t depth_size_;
   int32_t msaa_size_;
@@ -82,6 +88,8 @@ private:
   void InitGLES();
   void Terminate();
   bool InitEGLSurface();
+  void CreateSurface();
+  bool RecreateSurface();
   bool InitEGLContext();
 
   GLContext(GLContext const &);
@@ -106,6 +114,26 @@ public:
 
   int32_t GetScreenWidth() { return screen_width_; }
   int32_t GetScreenHeight() { return screen_height_; }
+  int32_t GetWindowWidth() { return window_width_; }
+  int32_t GetWindowHeight() { return window_height_; }
+
+  /*
+   * Size of the window buffers relative to the window, 1 for native size.
+   * The compositor upscales smaller buffers in its hardware scaler at no GPU
+   * cost. The surface is recreated when the scale changes, the screen size
+   * is the buffer size afterwards.
+   */
+  bool SetBufferScale(const float scale);
+  float GetBufferScale() { return buffer_scale_; }
+
+  /*
+   * Window surface in the sRGB color space through EGL_KHR_gl_colorspace.
+   * Fragment outputs are linear and encoded on write, blending happens in
+   * linear space. Without the extension the surface stays linear and
+   * IsSRGBSurface() returns false. The surface is recreated when it changes.
+   */
+  bool SetSRGBSurface(const bool srgb);
+  bool IsSRGBSurface() { return srgb_surface_; }
 
   int32_t GetBufferColorSize() { return color_size_; }
   int32_t GetBufferDepthSize() { return depth_size_; }
@@ -113,6 +141,7 @@ public:
 
   float GetGLVersion() { return gl_version_; }
   bool CheckExtension(const char *extension);
+  bool CheckEGLExtension(const char *extension);
 
   /*
    * Set SwapInterval to EGL context
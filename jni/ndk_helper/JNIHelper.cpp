@@ -18,6 +18,10 @@
 #include <fstream>
 #include <iostream>
 #include <assert.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "JNIHelper.h"
 
@@ -25,6 +29,10 @@ namespace ndk_helper {
 
 #define NATIVEACTIVITY_CLASS_NAME "android/app/NativeActivity"
 
+// Holds the JavaVM of threads attached by AttachCurrentThread()
+static pthread_key_t attached_key;
+static pthread_once_t attached_key_once = PTHREAD_ONCE_INIT;
+
 /*
  * JNI Helper functions
  */
@@ -54,6 +62,42 @@ JNIHelper::~JNIHelper() {
   env->DeleteGlobalRef(jni_helper_java_class_);
 }
 
+/*
+ * Thread attachment
+ */
+// Unregister this thread from the VM, p is the JavaVM it was attached to
+static void DetachCurrentThreadDtor(void *p) {
+  JavaVM *vm = (JavaVM *)p;
+  JNIEnv *env;
+  // May have been detached directly already
+  if (vm->GetEnv((void **)&env, JNI_VERSION_1_4) != JNI_OK) return;
+  LOGI("detached current thread");
+  vm->DetachCurrentThread();
+}
+
+static void CreateAttachedKey() {
+  pthread_key_create(&attached_key, DetachCurrentThreadDtor);
+}
+
+JNIEnv *JNIHelper::AttachCurrentThread() {
+  JNIEnv *env;
+  if (activity_->vm->GetEnv((void **)&env, JNI_VERSION_1_4) == JNI_OK)
+    return env;
+  activity_->vm->AttachCurrentThread(&env, NULL);
+  // The destructor detaches the thread when it exits
+  pthread_once(&attached_key_once, CreateAttachedKey);
+  pthread_setspecific(attached_key, activity_->vm);
+  return env;
+}
+
+void JNIHelper::DetachCurrentThread() {
+  pthread_once(&attached_key_once, CreateAttachedKey);
+  void *vm = pthread_getspecific(attached_key);
+  if (vm == NULL) return;
+  pthread_setspecific(attached_key, NULL);
+  DetachCurrentThreadDtor(vm);
+}
+
 /*
  * Init
  */
@@ -95,6 +139,22 @@ void JNIHelper::Init(ANativeActivity *activity, const char *helper_class_name) {
   const char *label = env->GetStringUTFChars(labelName, NULL);
   helper.app_label_ = std::string(label);
 
+  //Paths of the file lookups, fixed for the process
+  jstring externalPath = helper.GetExternalFilesDirJString(env);
+  const char *external = env->GetStringUTFChars(externalPath, NULL);
+  helper.external_files_dir_ = std::string(external);
+  env->ReleaseStringUTFChars(externalPath, external);
+  env->DeleteLocalRef(externalPath);
+
+  jmethodID midGetPackageCodePath = env->GetMethodID(
+      android_content_Context, "getPackageCodePath", "()Ljava/lang/String;");
+  jstring apkPath = (jstring)
+      env->CallObjectMethod(helper.activity_->clazz, midGetPackageCodePath);
+  const char *apk = env->GetStringUTFChars(apkPath, NULL);
+  helper.apk_path_ = std::string(apk);
+  env->ReleaseStringUTFChars(apkPath, apk);
+  env->DeleteLocalRef(apkPath);
+
   env->ReleaseStringUTFChars(packageName, appname);
   env->ReleaseStringUTFChars(labelName, label);
   env->DeleteLocalRef(packageName);
@@ -189,28 +249,156 @@ bool JNIHelper::ReadFile(const char *fileName,
   }
 }
 
+/*
+ * MapFile
+ */
+bool JNIHelper::MapFile(const char *file_name, MAPPED_FILE *file) {
+  file->data = NULL;
+  file->size = 0;
+  file->map = NULL;
+  file->map_size = 0;
+  file->asset = NULL;
+  if (activity_ == NULL) {
+    LOGI("JNIHelper has not been initialized. Call init() to initialize the "
+         "helper");
+    return false;
+  }
+
+  // External storage overrides the assets
+  std::string s = GetExternalFilesDir();
+  if (file_name[0] != '/') {
+    s.append("/");
+  }
+  s.append(file_name);
+  int fd = open(s.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      LOGI("Failed to map:%s", s.c_str());
+      return false;
+    }
+    file->map = map;
+    file->map_size = st.st_size;
+    file->data = static_cast<const uint8_t *>(map);
+    file->size = st.st_size;
+    return true;
+  }
+
+  // The asset manager is thread safe, no need to wait for a decode on mutex_
+  AAsset *assetFile =
+      AAssetManager_open(activity_->assetManager, file_name, AASSET_MODE_BUFFER);
+  if (!assetFile) {
+    return false;
+  }
+  const void *data = AAsset_getBuffer(assetFile);
+  if (data == NULL) {
+    AAsset_close(assetFile);
+
+    LOGI("Failed to load:%s", file_name);
+    return false;
+  }
+  file->asset = assetFile;
+  file->data = static_cast<const uint8_t *>(data);
+  file->size = AAsset_getLength(assetFile);
+  return true;
+}
+
+void JNIHelper::UnmapFile(MAPPED_FILE *file) {
+  if (file->map) {
+    munmap(file->map, file->map_size);
+    file->map = NULL;
+    file->map_size = 0;
+  }
+  if (file->asset) {
+    AAsset_close(file->asset);
+    file->asset = NULL;
+  }
+  file->data = NULL;
+  file->size = 0;
+}
+
 std::string JNIHelper::GetExternalFilesDir() {
   if (activity_ == NULL) {
     LOGI("JNIHelper has not been initialized. Call init() to initialize the "
          "helper");
     return std::string("");
   }
+  // Set by Init(), no JNI call per lookup
+  return external_files_dir_;
+}
+
+std::string JNIHelper::GetCacheDir() {
+  if (activity_ == NULL) {
+    LOGI("JNIHelper has not been initialized. Call init() to initialize the "
+         "helper");
+    return std::string("");
+  }
 
   // Lock mutex
   std::lock_guard<std::mutex> lock(mutex_);
 
-  // First, try reading from externalFileDir;
   JNIEnv *env = AttachCurrentThread();
 
-  jstring strPath = GetExternalFilesDirJString(env);
+  // Invoking getCacheDir() java API
+  jclass cls_Env = env->FindClass(NATIVEACTIVITY_CLASS_NAME);
+  jmethodID mid =
+      env->GetMethodID(cls_Env, "getCacheDir", "()Ljava/io/File;");
+  jobject obj_File = env->CallObjectMethod(activity_->clazz, mid);
+  jclass cls_File = env->FindClass("java/io/File");
+  jmethodID mid_getPath =
+      env->GetMethodID(cls_File, "getPath", "()Ljava/lang/String;");
+  jstring strPath = (jstring) env->CallObjectMethod(obj_File, mid_getPath);
+
   const char *path = env->GetStringUTFChars(strPath, NULL);
   std::string s(path);
 
   env->ReleaseStringUTFChars(strPath, path);
   env->DeleteLocalRef(strPath);
+  env->DeleteLocalRef(obj_File);
+  env->DeleteLocalRef(cls_File);
+  env->DeleteLocalRef(cls_Env);
   return s;
 }
 
+bool JNIHelper::GetFileStamp(const char *file_name, int64_t *mtime,
+                             int64_t *size) {
+  if (activity_ == NULL) {
+    LOGI("JNIHelper has not been initialized. Call init() to initialize the "
+         "helper");
+    return false;
+  }
+
+  // External storage overrides the assets
+  std::string s = GetExternalFilesDir();
+  if (file_name[0] != '/') {
+    s.append("/");
+  }
+  s.append(file_name);
+  struct stat st;
+  if (stat(s.c_str(), &st) == 0) {
+    *mtime = st.st_mtime;
+    *size = st.st_size;
+    return true;
+  }
+
+  // stat() and the thread safe asset manager only, off mutex_ so that the GL
+  // thread does not wait for decodes on the workers
+  AAsset *assetFile =
+      AAssetManager_open(activity_->assetManager, file_name, AASSET_MODE_UNKNOWN);
+  if (!assetFile) {
+    return false;
+  }
+  *size = AAsset_getLength(assetFile);
+  AAsset_close(assetFile);
+
+  *mtime = stat(apk_path_.c_str(), &st) == 0 ? st.st_mtime : 0;
+  return true;
+}
+
 uint32_t JNIHelper::LoadTexture(const char *file_name, int32_t *outWidth,
                                 int32_t *outHeight, bool *hasAlpha) {
   if (activity_ == NULL) {
@@ -328,6 +516,84 @@ uint32_t JNIHelper::LoadCubemapTexture(const char *file_name,
   return 0;
 }
 
+bool JNIHelper::DecodeImage(const char *file_name,
+                            std::vector<uint8_t> *pixels, int32_t *outWidth,
+                            int32_t *outHeight) {
+  return DecodeImage(file_name, pixels, NULL, 0, outWidth, outHeight);
+}
+
+bool JNIHelper::DecodeImage(const char *file_name, uint8_t *pixels,
+                            const size_t capacity, int32_t *outWidth,
+                            int32_t *outHeight) {
+  return DecodeImage(file_name, NULL, pixels, capacity, outWidth, outHeight);
+}
+
+bool JNIHelper::DecodeImage(const char *file_name,
+                            std::vector<uint8_t> *buffer, uint8_t *pixels,
+                            const size_t capacity, int32_t *outWidth,
+                            int32_t *outHeight) {
+  if (activity_ == NULL) {
+    LOGI("JNIHelper has not been initialized. Call init() to initialize the "
+         "helper");
+    return false;
+  }
+
+  // Lock mutex
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  JNIEnv *env = AttachCurrentThread();
+  jstring name = env->NewStringUTF(file_name);
+
+  jmethodID mid = env->GetMethodID(jni_helper_java_class_, "decodeImage",
+                                   "(Ljava/lang/String;)Landroid/graphics/Bitmap;");
+  jobject bitmap = env->CallObjectMethod(jni_helper_java_ref_, mid, name);
+  env->DeleteLocalRef(name);
+  if (bitmap == NULL) {
+    LOGI("Image decode failed %s", file_name);
+    return false;
+  }
+
+  mid = env->GetMethodID(jni_helper_java_class_, "getBitmapWidth",
+                         "(Landroid/graphics/Bitmap;)I");
+  int32_t width = env->CallIntMethod(jni_helper_java_ref_, mid, bitmap);
+  mid = env->GetMethodID(jni_helper_java_class_, "getBitmapHeight",
+                         "(Landroid/graphics/Bitmap;)I");
+  int32_t height = env->CallIntMethod(jni_helper_java_ref_, mid, bitmap);
+
+  const size_t size = width * height * 4;
+  if (buffer != NULL) {
+    buffer->resize(size);
+    pixels = &(*buffer)[0];
+  } else if (size > capacity) {
+    LOGI("Image %s does not fit in %d bytes", file_name,
+         static_cast<int32_t>(capacity));
+    pixels = NULL;
+  }
+
+  // Let Java copy straight into the native buffer
+  jobject byte_buffer = NULL;
+  if (pixels != NULL) {
+    byte_buffer = env->NewDirectByteBuffer(pixels, size);
+    mid = env->GetMethodID(jni_helper_java_class_, "copyBitmapPixels",
+                           "(Landroid/graphics/Bitmap;Ljava/nio/ByteBuffer;)V");
+    env->CallVoidMethod(jni_helper_java_ref_, mid, bitmap, byte_buffer);
+  }
+  mid = env->GetMethodID(jni_helper_java_class_, "closeBitmap",
+                         "(Landroid/graphics/Bitmap;)V");
+  env->CallVoidMethod(jni_helper_java_ref_, mid, bitmap);
+
+  if (outWidth != NULL) {
+    *outWidth = width;
+  }
+  if (outHeight != NULL) {
+    *outHeight = height;
+  }
+
+  if (byte_buffer != NULL) env->DeleteLocalRef(byte_buffer);
+  env->DeleteLocalRef(bitmap);
+  return pixels != NULL;
+}
+
 std::string JNIHelper::ConvertString(const char *str, const char *encode) {
   if (activity_ == NULL) {
     LOGI("JNIHelper has not been initialized. Call init() to initialize the "
@@ -44,6 +44,18 @@ namespace ndk_helper {
 
 class JUIView;
 
+/*
+ * File contents mapped by JNIHelper::MapFile()
+ */
+struct MAPPED_FILE {
+  const uint8_t *data;
+  size_t size;
+
+  void *map;
+  size_t map_size;
+  AAsset *asset;
+};
+
 /******************************************************************
  * Helper functions for JNI calls
  * This class wraps JNI calls and provides handy interface calling commonly used
@@ -116,6 +128,21 @@ public:
    */
   bool ReadFile(const char *file_name, std::vector<uint8_t> *buffer_ref);
 
+  /*
+   * Map a file resolved like ReadFile() without copying it.
+   * External files are mapped with mmap(). Assets stored uncompressed in the
+   * APK are mapped by the asset manager, compressed ones are inflated by it
+   * once.
+   *
+   * arguments:
+   * in: file_name, file name to map
+   * out: file, valid until UnmapFile()
+   * return:
+   * true when the file was mapped
+   */
+  bool MapFile(const char *file_name, MAPPED_FILE *file);
+  void UnmapFile(MAPPED_FILE *file);
+
   /*
    * Load and create OpenGL texture from given file name.
    * The method invokes BitmapFactory in Java so it can read jpeg/png formatted
@@ -159,6 +186,40 @@ public:
                               int32_t *outWidth = NULL,
                        int32_t *outHeight = NULL, bool *hasAlpha = NULL);
 
+  /*
+   * Decode an image file into native memory as tightly packed RGBA8 pixels
+   * The method invokes BitmapFactory in Java so it can read bmp/jpeg/png
+   * formatted files, the pixels are then uploaded by the caller, e.g. with
+   * glTexSubImage2D into immutable texture storage
+   *
+   * arguments:
+   * in: file_name, file name to read
+   * out: pixels, resized to width * height * 4 bytes
+   * outWidth(Optional) pointer to retrieve bitmap width
+   * outHeight(Optional) pointer to retrieve bitmap height
+   * return:
+   * true when the image was decoded
+   */
+  bool DecodeImage(const char *file_name, std::vector<uint8_t> *pixels,
+                   int32_t *outWidth = NULL, int32_t *outHeight = NULL);
+
+  /*
+   * Decode an image file into caller provided memory, e.g. a mapped pixel
+   * unpack buffer, without an intermediate copy
+   *
+   * arguments:
+   * in: file_name, file name to read
+   * out: pixels, receives width * height * 4 bytes
+   * in: capacity, size of pixels in bytes, larger images fail to decode
+   * outWidth(Optional) pointer to retrieve bitmap width
+   * outHeight(Optional) pointer to retrieve bitmap height
+   * return:
+   * true when the image was decoded into pixels
+   */
+  bool DecodeImage(const char *file_name, uint8_t *pixels,
+                   const size_t capacity, int32_t *outWidth = NULL,
+                   int32_t *outHeight = NULL);
+
   /*
    * Convert string from character code other than UTF-8
    *
@@ -171,12 +232,33 @@ public:
    */
   std::string ConvertString(const char *str, const char *encode);
   /*
-   * Retrieve external file directory through JNI call
+   * Retrieve external file directory, queried through JNI by Init()
    *
    * return: std::string containing external file diretory
    */
   std::string GetExternalFilesDir();
 
+  /*
+   * Retrieve the application cache directory through JNI call
+   *
+   * return: std::string containing the cache directory
+   */
+  std::string GetCacheDir();
+
+  /*
+   * Identify the current version of a file resolved like ReadFile() and
+   * DecodeImage(), external storage first then APK assets.
+   * Assets carry no time stamp, the modification time of the APK is used.
+   *
+   * arguments:
+   * in: file_name, file name to check
+   * out: mtime, modification time in seconds
+   * out: size, file size in bytes
+   * return:
+   * true when the file exists
+   */
+  bool GetFileStamp(const char *file_name, int64_t *mtime, int64_t *size);
+
   /*
    * Audio helper
    * Retrieves native audio buffer size which is required to achieve low latency
@@ -226,22 +308,16 @@ public:
 
   /*
    * Attach current thread
-   * In Android, the thread doesn't have to be 'Detach' current thread
-   * as application process is only killed and VM does not shut down
+   * A thread attached here is detached when it exits, ART aborts on threads
+   * exiting while attached
+   */
+  JNIEnv *AttachCurrentThread();
+
+  /*
+   * Detach the current thread if AttachCurrentThread() attached it, e.g.
+   * before a worker thread returns
    */
-  JNIEnv *AttachCurrentThread() {
-    JNIEnv *env;
-    if (activity_->vm->GetEnv((void **)&env, JNI_VERSION_1_4) == JNI_OK)
-      return env;
-    activity_->vm->AttachCurrentThread(&env, NULL);
-    pthread_key_create((int32_t *)activity_, DetachCurrentThreadDtor);
-    return env;
-  }
-
-  void DetachCurrentThread() {
-    activity_->vm->DetachCurrentThread();
-    return;
-  }
+  void DetachCurrentThread();
 
   /*
    * Decrement a global reference to the object
@@ -267,8 +343,16 @@ public:
   jclass RetrieveClass(JNIEnv *jni, const char *class_name);
 
 private:
+  bool DecodeImage(const char *file_name, std::vector<uint8_t> *buffer,
+                   uint8_t *pixels, const size_t capacity, int32_t *outWidth,
+                   int32_t *outHeight);
+
   std::string app_bunlde_name_;
   std::string app_label_;
+  // Queried once by Init() so that file lookups need neither JNI nor mutex_
+  std::string external_files_dir_;
+  // Stamp of assets, see GetFileStamp()
+  std::string apk_path_;
 
   ANativeActivity *activity_;
   jobject jni_helper_java_ref_;
@@ -293,15 +377,6 @@ private:
                            ...);
   void CallVoidMethod(const char *strMethodName, const char *strSignature, ...);
 
-  /*
-   * Unregister this thread from the VM
-   */
-  static void DetachCurrentThreadDtor(void *p) {
-    LOGI("detached current thread");
-    ANativeActivity *activity = (ANativeActivity *)p;
-    activity->vm->DetachCurrentThread();
-  }
-
 };
 
 extern "C" {
@@ -20,7 +20,7 @@ namespace ndk_helper {
 
 PerfMonitor::PerfMonitor()
     : current_FPS_(0), tv_last_sec_(0), last_tick_(0.f), tickindex_(0),
-      ticksum_(0) {
+      ticksum_(0), frame_time_(0) {
   for (int32_t i = 0; i < NUM_SAMPLES; ++i)
     ticklist_[i] = 0;
 }
@@ -44,6 +44,7 @@ bool PerfMonitor::Update(float &fFPS) {
   double tick = time - last_tick_;
   double d = UpdateTick(tick);
   last_tick_ = time;
+  frame_time_ = tick;
 
   if (Time.tv_sec - tv_last_sec_ >= 1) {
     current_FPS_ = 1.f / d;
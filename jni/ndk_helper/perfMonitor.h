@@ -38,6 +38,7 @@ private:
   int32_t tickindex_;
   double ticksum_;
   double ticklist_[NUM_SAMPLES];
+  double frame_time_;
 
   double UpdateTick(double current_tick);
 
@@ -46,6 +47,8 @@ public:
   virtual ~PerfMonitor();
 
   bool Update(float &fFPS);
+  // Seconds between the last two Update() calls
+  double GetFrameTime() const { return frame_time_; }
 
   static double GetCurrentTime() {
     struct timeval time;
@@ -19,6 +19,7 @@ package com.sample.helper;
 import java.io.ByteArrayOutputStream;
 import java.io.File;
 import java.io.FileInputStream;
+import java.nio.ByteBuffer;
 import javax.microedition.khronos.opengles.GL10;
 
 import android.R.bool;
@@ -211,6 +212,36 @@ public class NDKHelper {
 
     }
 
+    public Bitmap decodeImage(String path) {
+        Bitmap bitmap = null;
+        BitmapFactory.Options options = new BitmapFactory.Options();
+        // Native side expects RGBA8 pixels
+        options.inPreferredConfig = Bitmap.Config.ARGB_8888;
+        try {
+            String str = path;
+            if (!path.startsWith("/")) {
+                str = "/" + path;
+            }
+
+            File file = new File(activity.getExternalFilesDir(null), str);
+            if (file.canRead()) {
+                bitmap = BitmapFactory.decodeStream(new FileInputStream(file),
+                        null, options);
+            } else {
+                bitmap = BitmapFactory.decodeStream(activity.getResources()
+                        .getAssets().open(path), null, options);
+            }
+        } catch (Exception e) {
+            Log.w("NDKHelper", "Coundn't load a file:" + path);
+            return null;
+        }
+        return bitmap;
+    }
+
+    public void copyBitmapPixels(Bitmap bmp, ByteBuffer buffer) {
+        bmp.copyPixelsToBuffer(buffer);
+    }
+
     public Bitmap openBitmap(String path, boolean iScalePOT) {
         Bitmap bitmap = null;
         try {
@@ -136,6 +136,14 @@ public class TeapotNativeActivity extends NativeActivity {
         OnPauseHandler();
     }
 
+    @Override
+    public void onTrimMemory(int level)
+    {
+        super.onTrimMemory(level);
+        // GL resources are trimmed in tiers on the native side
+        OnTrimMemoryHandler(level);
+    }
+
     public void updateFPS(final float fFPS)
     {
         if( _label == null )
@@ -151,6 +159,7 @@ public class TeapotNativeActivity extends NativeActivity {
     }
 
     // Implemented in C++.
-    native public void OnPauseHandler();}
+    native public void OnPauseHandler();
+    native public void OnTrimMemoryHandler(int level);}
 
 
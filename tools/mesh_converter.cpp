@@ -0,0 +1,426 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// mesh_converter.cpp
+// Host tool converting Wavefront OBJ meshes into binary mesh files
+//
+// Build and run on the host:
+//   g++ -std=c++11 -O2 -o mesh_converter tools/mesh_converter.cpp
+//   ./mesh_converter tools/meshes/teapot.obj assets/Meshes/teapot.mesh
+//
+// Test the reordering passes after changing mesh_optimizer.h:
+//   g++ -std=c++11 -O2 -o mesh_optimizer_test tools/mesh_optimizer_test.cpp
+//   ./mesh_optimizer_test tools/meshes/teapot.obj
+//
+// A chain of up to MESH_MAX_LODS levels of detail is built by
+// mesh_simplifier.h, each level about half the triangles of the previous one.
+// Triangles and vertices are reordered by mesh_optimizer.h unless
+// --no-optimize is given before the file names.
+//
+// Supports v, vt, vn and f records, polygons are triangulated as fans and
+// negative indices are relative. Vertices are unique per v/vt/vn triple and
+// kept in order of first use. Meshes without vn get smooth normals.
+// The layout is described in jni/MeshFormat.h.
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <array>
+#include <map>
+#include <vector>
+
+#include "../jni/MeshFormat.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Coarser levels are not worth a draw call of their own
+const uint32_t LOD_MIN_TRIANGLES = 64;
+// Stop the chain when simplification gets stuck above this ratio
+const float LOD_MIN_REDUCTION = 0.75f;
+
+struct OBJ_INDEX {
+  int32_t position;
+  int32_t texcoord;
+  int32_t normal;
+
+  bool operator<(const OBJ_INDEX& rhs) const {
+    if (position != rhs.position) return position < rhs.position;
+    if (texcoord != rhs.texcoord) return texcoord < rhs.texcoord;
+    return normal < rhs.normal;
+  }
+};
+
+struct MESH {
+  // Interleaved position, normal and texcoord when has_texcoords
+  std::vector<float> vertices;
+  // Full detail
+  std::vector<uint32_t> indices;
+  bool has_texcoords;
+  // Coarser levels indexing the same vertices
+  std::vector<std::vector<uint32_t> > lods;
+  std::vector<float> lod_errors;
+};
+
+//--------------------------------------------------------------------------------
+// OBJ indices are 1 based, negative ones count back from the last element
+//--------------------------------------------------------------------------------
+static int32_t ResolveIndex(const int32_t index, const size_t count) {
+  if (index > 0) return index - 1;
+  if (index < 0) return static_cast<int32_t>(count) + index;
+  return -1;
+}
+
+static bool ParseIndex(const char* token, const size_t positions,
+                       const size_t texcoords, const size_t normals,
+                       OBJ_INDEX* index) {
+  // v, v/vt, v//vn or v/vt/vn
+  int32_t v = 0, vt = 0, vn = 0;
+  char* p = NULL;
+  v = strtol(token, &p, 10);
+  if (*p == '/') {
+    ++p;
+    if (*p != '/') vt = strtol(p, &p, 10);
+    if (*p == '/') vn = strtol(p + 1, &p, 10);
+  }
+  index->position = ResolveIndex(v, positions);
+  index->texcoord = ResolveIndex(vt, texcoords);
+  index->normal = ResolveIndex(vn, normals);
+  return index->position >= 0 &&
+         index->position < static_cast<int32_t>(positions) &&
+         index->texcoord < static_cast<int32_t>(texcoords) &&
+         index->normal < static_cast<int32_t>(normals);
+}
+
+static bool ReadOBJ(const char* file_name, MESH* mesh) {
+  FILE* fp = fopen(file_name, "r");
+  if (fp == NULL) return false;
+
+  std::vector<float> positions;
+  std::vector<float> texcoords;
+  std::vector<float> normals;
+  std::vector<OBJ_INDEX> corners;
+  char line[1024];
+  int32_t line_number = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    ++line_number;
+    float x = 0.f, y = 0.f, z = 0.f;
+    if (strncmp(line, "v ", 2) == 0) {
+      sscanf(line + 2, "%f %f %f", &x, &y, &z);
+      positions.push_back(x);
+      positions.push_back(y);
+      positions.push_back(z);
+    } else if (strncmp(line, "vt ", 3) == 0) {
+      sscanf(line + 3, "%f %f", &x, &y);
+      texcoords.push_back(x);
+      texcoords.push_back(y);
+    } else if (strncmp(line, "vn ", 3) == 0) {
+      sscanf(line + 3, "%f %f %f", &x, &y, &z);
+      normals.push_back(x);
+      normals.push_back(y);
+      normals.push_back(z);
+    } else if (strncmp(line, "f ", 2) == 0) {
+      std::vector<OBJ_INDEX> polygon;
+      for (char* token = strtok(line + 2, " \t\r\n"); token;
+           token = strtok(NULL, " \t\r\n")) {
+        OBJ_INDEX index;
+        if (!ParseIndex(token, positions.size() / 3, texcoords.size() / 2,
+                        normals.size() / 3, &index)) {
+          fprintf(stderr, "%s:%d: bad index %s\n", file_name, line_number,
+                  token);
+          fclose(fp);
+          return false;
+        }
+        polygon.push_back(index);
+      }
+      for (size_t i = 2; i < polygon.size(); ++i) {
+        corners.push_back(polygon[0]);
+        corners.push_back(polygon[i - 1]);
+        corners.push_back(polygon[i]);
+      }
+    }
+  }
+  fclose(fp);
+  if (corners.empty()) return false;
+
+  // Mixed faces with and without vt get a zero texcoord
+  mesh->has_texcoords = !texcoords.empty();
+  const size_t components = mesh->has_texcoords ? 8 : 6;
+  std::map<OBJ_INDEX, uint32_t> unique;
+  mesh->vertices.clear();
+  mesh->indices.clear();
+  for (size_t i = 0; i < corners.size(); ++i) {
+    const OBJ_INDEX& corner = corners[i];
+    std::map<OBJ_INDEX, uint32_t>::iterator it = unique.find(corner);
+    if (it != unique.end()) {
+      mesh->indices.push_back(it->second);
+      continue;
+    }
+
+    const uint32_t vertex =
+        static_cast<uint32_t>(mesh->vertices.size() / components);
+    unique[corner] = vertex;
+    mesh->indices.push_back(vertex);
+    for (int32_t c = 0; c < 3; ++c)
+      mesh->vertices.push_back(positions[corner.position * 3 + c]);
+    for (int32_t c = 0; c < 3; ++c)
+      mesh->vertices.push_back(
+          corner.normal >= 0 ? normals[corner.normal * 3 + c] : 0.f);
+    if (mesh->has_texcoords) {
+      for (int32_t c = 0; c < 2; ++c)
+        mesh->vertices.push_back(
+            corner.texcoord >= 0 ? texcoords[corner.texcoord * 2 + c] : 0.f);
+    }
+  }
+
+  if (normals.empty()) {
+    // Area weighted face normals summed per position
+    std::vector<float> sums(positions.size(), 0.f);
+    for (size_t i = 0; i < corners.size(); i += 3) {
+      const float* p0 = &positions[corners[i].position * 3];
+      const float* p1 = &positions[corners[i + 1].position * 3];
+      const float* p2 = &positions[corners[i + 2].position * 3];
+      const float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      const float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      const float n[3] = { e0[1] * e1[2] - e0[2] * e1[1],
+                           e0[2] * e1[0] - e0[0] * e1[2],
+                           e0[0] * e1[1] - e0[1] * e1[0] };
+      for (int32_t k = 0; k < 3; ++k) {
+        for (int32_t c = 0; c < 3; ++c)
+          sums[corners[i + k].position * 3 + c] += n[c];
+      }
+    }
+    std::map<OBJ_INDEX, uint32_t>::const_iterator it = unique.begin();
+    for (; it != unique.end(); ++it) {
+      const float* n = &sums[it->first.position * 3];
+      float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length == 0.f) length = 1.f;
+      for (int32_t c = 0; c < 3; ++c)
+        mesh->vertices[it->second * components + 3 + c] = n[c] / length;
+    }
+  }
+  return true;
+}
+
+static uint32_t Align(const uint32_t offset) {
+  return (offset + MESH_ALIGNMENT - 1) & ~(MESH_ALIGNMENT - 1);
+}
+
+static bool WriteMesh(const char* file_name, const MESH& mesh) {
+  std::vector<MESH_ATTRIBUTE> attributes;
+  MESH_ATTRIBUTE position = { MESH_SEMANTIC_POSITION, 3, MESH_TYPE_FLOAT, 0,
+                              0 };
+  MESH_ATTRIBUTE normal = { MESH_SEMANTIC_NORMAL, 3, MESH_TYPE_FLOAT, 0,
+                            3 * sizeof(float) };
+  MESH_ATTRIBUTE texcoord = { MESH_SEMANTIC_TEXCOORD, 2, MESH_TYPE_FLOAT, 0,
+                              6 * sizeof(float) };
+  attributes.push_back(position);
+  attributes.push_back(normal);
+  if (mesh.has_texcoords) attributes.push_back(texcoord);
+
+  const uint32_t components = mesh.has_texcoords ? 8 : 6;
+  MESH_HEADER header;
+  memset(&header, 0, sizeof(header));
+  header.magic = MESH_MAGIC;
+  header.version = MESH_VERSION;
+  header.vertex_count =
+      static_cast<uint32_t>(mesh.vertices.size() / components);
+
+  // All levels in one index buffer, finest first
+  std::vector<uint32_t> indices(mesh.indices);
+  std::vector<MESH_LOD> lods(1);
+  lods[0].first_index = 0;
+  lods[0].index_count = static_cast<uint32_t>(mesh.indices.size());
+  lods[0].error = 0.f;
+  for (size_t i = 0; i < mesh.lods.size(); ++i) {
+    MESH_LOD lod;
+    lod.first_index = static_cast<uint32_t>(indices.size());
+    lod.index_count = static_cast<uint32_t>(mesh.lods[i].size());
+    lod.error = mesh.lod_errors[i];
+    lods.push_back(lod);
+    indices.insert(indices.end(), mesh.lods[i].begin(), mesh.lods[i].end());
+  }
+  header.index_count = static_cast<uint32_t>(indices.size());
+  const bool short_indices = header.vertex_count <= 0x10000;
+  header.index_type =
+      short_indices ? MESH_TYPE_UNSIGNED_SHORT : MESH_TYPE_UNSIGNED_INT;
+  header.stride = components * sizeof(float);
+  header.attribute_count = static_cast<uint32_t>(attributes.size());
+  header.lod_count = static_cast<uint32_t>(mesh.lods.size() + 1);
+  for (int32_t c = 0; c < 3; ++c) {
+    header.bounds_min[c] = mesh.vertices[c];
+    header.bounds_max[c] = mesh.vertices[c];
+  }
+  for (size_t i = 0; i < mesh.vertices.size(); i += components) {
+    for (int32_t c = 0; c < 3; ++c) {
+      header.bounds_min[c] = std::min(header.bounds_min[c], mesh.vertices[i + c]);
+      header.bounds_max[c] = std::max(header.bounds_max[c], mesh.vertices[i + c]);
+    }
+  }
+  header.vertex_offset =
+      Align(sizeof(header) + header.attribute_count * sizeof(MESH_ATTRIBUTE) +
+            header.lod_count * sizeof(MESH_LOD));
+  header.index_offset =
+      Align(header.vertex_offset + header.vertex_count * header.stride);
+
+  std::vector<uint8_t> data(header.index_offset);
+  memcpy(&data[0], &header, sizeof(header));
+  memcpy(&data[sizeof(header)], &attributes[0],
+         attributes.size() * sizeof(MESH_ATTRIBUTE));
+  memcpy(&data[sizeof(header) + attributes.size() * sizeof(MESH_ATTRIBUTE)],
+         &lods[0], lods.size() * sizeof(MESH_LOD));
+  memcpy(&data[header.vertex_offset], &mesh.vertices[0],
+         mesh.vertices.size() * sizeof(float));
+  if (short_indices) {
+    std::vector<uint16_t> shorts(indices.begin(), indices.end());
+    data.insert(data.end(), reinterpret_cast<const uint8_t*>(&shorts[0]),
+                reinterpret_cast<const uint8_t*>(&shorts[0] + shorts.size()));
+  } else {
+    data.insert(data.end(), reinterpret_cast<const uint8_t*>(&indices[0]),
+                reinterpret_cast<const uint8_t*>(&indices[0] + indices.size()));
+  }
+
+  FILE* fp = fopen(file_name, "wb");
+  if (fp == NULL) return false;
+  const bool written = fwrite(&data[0], 1, data.size(), fp) == data.size();
+  return fclose(fp) == 0 && written;
+}
+
+//--------------------------------------------------------------------------------
+// Reordering must keep every triangle with its winding, compare the sorted
+// lists of rotated corner values
+//--------------------------------------------------------------------------------
+static void GetTriangles(const MESH& mesh,
+                         std::vector<std::array<float, 24> >* triangles) {
+  const size_t components = mesh.has_texcoords ? 8 : 6;
+  triangles->clear();
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    // Start at the smallest index value so that rotations compare equal
+    size_t first = 0;
+    for (size_t k = 1; k < 3; ++k) {
+      const float* a = &mesh.vertices[mesh.indices[i + k] * components];
+      const float* b = &mesh.vertices[mesh.indices[i + first] * components];
+      if (std::lexicographical_compare(a, a + components, b, b + components))
+        first = k;
+    }
+    std::array<float, 24> triangle;
+    triangle.fill(0.f);
+    for (size_t k = 0; k < 3; ++k) {
+      const float* v =
+          &mesh.vertices[mesh.indices[i + (first + k) % 3] * components];
+      std::copy(v, v + components, triangle.begin() + k * components);
+    }
+    triangles->push_back(triangle);
+  }
+  std::sort(triangles->begin(), triangles->end());
+}
+
+//--------------------------------------------------------------------------------
+// Each level is simplified from the full mesh so that its error is measured
+// against the full mesh
+//--------------------------------------------------------------------------------
+static void BuildLods(MESH* mesh) {
+  const uint32_t components = mesh->has_texcoords ? 8 : 6;
+  uint32_t triangles = static_cast<uint32_t>(mesh->indices.size() / 3);
+  mesh->lods.clear();
+  mesh->lod_errors.clear();
+  while (mesh->lods.size() + 1 < MESH_MAX_LODS &&
+         triangles / 2 >= LOD_MIN_TRIANGLES) {
+    std::vector<uint32_t> lod;
+    const float error = SimplifyMesh(mesh->indices, mesh->vertices, components,
+                                     triangles / 2, &lod);
+    const uint32_t lod_triangles = static_cast<uint32_t>(lod.size() / 3);
+    if (lod_triangles > triangles * LOD_MIN_REDUCTION) break;
+
+    printf("LOD %zu: %u triangles, error %f\n", mesh->lods.size() + 1,
+           lod_triangles, error);
+    mesh->lods.push_back(lod);
+    mesh->lod_errors.push_back(error);
+    triangles = lod_triangles;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  bool optimize = true;
+  int32_t arg = 1;
+  if (arg < argc && strcmp(argv[arg], "--no-optimize") == 0) {
+    optimize = false;
+    ++arg;
+  }
+  if (argc - arg != 2) {
+    fprintf(stderr, "Usage: %s [--no-optimize] input.obj output.mesh\n",
+            argv[0]);
+    return 1;
+  }
+  const char* input = argv[arg];
+  const char* output = argv[arg + 1];
+
+  MESH mesh;
+  if (!ReadOBJ(input, &mesh)) {
+    fprintf(stderr, "Failed to read %s\n", input);
+    return 1;
+  }
+
+  const uint32_t components = mesh.has_texcoords ? 8 : 6;
+  BuildLods(&mesh);
+
+  if (optimize) {
+    std::vector<std::array<float, 24> > before;
+    GetTriangles(mesh, &before);
+    OptimizeTriangles(&mesh.indices, mesh.vertices, components);
+    for (size_t i = 0; i < mesh.lods.size(); ++i)
+      OptimizeTriangles(&mesh.lods[i], mesh.vertices, components);
+
+    // Vertex order follows the full mesh, coarser levels use a subset
+    std::vector<uint32_t> indices(mesh.indices);
+    for (size_t i = 0; i < mesh.lods.size(); ++i)
+      indices.insert(indices.end(), mesh.lods[i].begin(), mesh.lods[i].end());
+    ReorderVertices(&indices, &mesh.vertices, components);
+    std::vector<uint32_t>::const_iterator it = indices.begin();
+    mesh.indices.assign(it, it + mesh.indices.size());
+    it += mesh.indices.size();
+    for (size_t i = 0; i < mesh.lods.size(); ++i) {
+      mesh.lods[i].assign(it, it + mesh.lods[i].size());
+      it += mesh.lods[i].size();
+    }
+
+    std::vector<std::array<float, 24> > after;
+    GetTriangles(mesh, &after);
+    if (before != after) {
+      fprintf(stderr, "Optimization changed the triangles of %s\n", input);
+      return 1;
+    }
+  }
+
+  if (!WriteMesh(output, mesh)) {
+    fprintf(stderr, "Failed to write %s\n", output);
+    return 1;
+  }
+  printf("%s: %zu vertices, %zu triangles\n", output,
+         mesh.vertices.size() / (mesh.has_texcoords ? 8 : 6),
+         mesh.indices.size() / 3);
+  return 0;
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// mesh_optimizer.h
+// Triangle and vertex reordering for the mesh converter
+//
+// OptimizeTriangles() and ReorderVertices() run three passes over an indexed
+// triangle list:
+// - Tipsify (Sander et al., "Fast Triangle Reordering for Vertex Locality and
+//   Reduced Overdraw", 2007) orders triangles for the post-transform cache.
+// - The clusters Tipsify starts at its dead ends are sorted front to back
+//   from the outside, so that the outer surface is drawn first and occludes
+//   the rest. Kept only while the cache miss ratio stays within
+//   OVERDRAW_ACMR_THRESHOLD of the Tipsify order.
+// - Vertices are renumbered in order of first use so that vertex fetch walks
+//   the buffer linearly.
+// The input order is kept when the result would raise its ACMR or ATVR, e.g.
+// for meshes exported in a cache friendly order.
+//--------------------------------------------------------------------------------
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Post-transform cache entries assumed by Tipsify and the simulator
+const int32_t VERTEX_CACHE_SIZE = 16;
+// Allowed ACMR increase of the overdraw order over the Tipsify order
+const float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+
+struct CACHE_STATISTICS {
+  // Average cache miss ratio, transformed vertices per triangle, 0.5 - 3
+  float acmr;
+  // Average transform to vertex ratio, transformed per unique vertex, 1 - 6
+  float atvr;
+};
+
+//--------------------------------------------------------------------------------
+// FIFO post-transform cache simulation
+//--------------------------------------------------------------------------------
+static CACHE_STATISTICS SimulateVertexCache(
+    const std::vector<uint32_t>& indices, const uint32_t vertex_count,
+    const int32_t cache_size = VERTEX_CACHE_SIZE) {
+  std::deque<uint32_t> cache;
+  std::vector<bool> used(vertex_count, false);
+  uint32_t misses = 0;
+  uint32_t unique = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const uint32_t v = indices[i];
+    if (!used[v]) {
+      used[v] = true;
+      unique++;
+    }
+    if (std::find(cache.begin(), cache.end(), v) != cache.end()) continue;
+
+    misses++;
+    cache.push_back(v);
+    if (static_cast<int32_t>(cache.size()) > cache_size) cache.pop_front();
+  }
+
+  CACHE_STATISTICS statistics;
+  statistics.acmr = indices.empty() ? 0.f : misses * 3.f / indices.size();
+  statistics.atvr = unique ? static_cast<float>(misses) / unique : 0.f;
+  return statistics;
+}
+
+//--------------------------------------------------------------------------------
+// Tipsify, returns the reordered indices and the first triangle of each
+// cluster
+//--------------------------------------------------------------------------------
+static int32_t TipsifySkipDeadEnd(const std::vector<int32_t>& live,
+                                  std::vector<uint32_t>* dead_ends,
+                                  uint32_t* cursor) {
+  // Recently used vertices first, then input order
+  while (!dead_ends->empty()) {
+    const uint32_t v = dead_ends->back();
+    dead_ends->pop_back();
+    if (live[v] > 0) return v;
+  }
+  for (; *cursor < live.size(); ++*cursor) {
+    if (live[*cursor] > 0) return *cursor;
+  }
+  return -1;
+}
+
+static void Tipsify(const std::vector<uint32_t>& indices,
+                    const uint32_t vertex_count, const int32_t cache_size,
+                    std::vector<uint32_t>* output,
+                    std::vector<uint32_t>* clusters) {
+  const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+
+  // Triangles using each vertex
+  std::vector<int32_t> live(vertex_count, 0);
+  for (size_t i = 0; i < indices.size(); ++i) live[indices[i]]++;
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (uint32_t v = 0; v < vertex_count; ++v)
+    offsets[v + 1] = offsets[v] + live[v];
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (uint32_t t = 0; t < triangle_count; ++t) {
+    for (int32_t k = 0; k < 3; ++k) adjacency[fill[indices[t * 3 + k]]++] = t;
+  }
+
+  std::vector<int32_t> timestamps(vertex_count, 0);
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<uint32_t> dead_ends;
+  std::vector<uint32_t> candidates;
+  int32_t time = cache_size + 1;
+  uint32_t cursor = 0;
+
+  output->clear();
+  clusters->clear();
+  int32_t fan = TipsifySkipDeadEnd(live, &dead_ends, &cursor);
+  bool restarted = true;
+  while (fan >= 0) {
+    if (restarted) clusters->push_back(static_cast<uint32_t>(output->size() / 3));
+
+    candidates.clear();
+    for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+      const uint32_t t = adjacency[a];
+      if (emitted[t]) continue;
+
+      emitted[t] = true;
+      for (int32_t k = 0; k < 3; ++k) {
+        const uint32_t v = indices[t * 3 + k];
+        output->push_back(v);
+        dead_ends.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - timestamps[v] > cache_size) timestamps[v] = time++;
+      }
+    }
+
+    // Prefer the candidate that stays in the cache for its remaining fan
+    int32_t next = -1;
+    int32_t best = -1;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      const uint32_t v = candidates[i];
+      if (live[v] <= 0) continue;
+
+      int32_t priority = 0;
+      if (time - timestamps[v] + 2 * live[v] <= cache_size)
+        priority = time - timestamps[v];
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+    restarted = next < 0;
+    fan = restarted ? TipsifySkipDeadEnd(live, &dead_ends, &cursor) : next;
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Sort clusters by how far they face away from the mesh center, positions are
+// the first 3 floats of each vertex
+//--------------------------------------------------------------------------------
+static void SortClustersForOverdraw(const std::vector<uint32_t>& indices,
+                                    const std::vector<uint32_t>& clusters,
+                                    const std::vector<float>& vertices,
+                                    const uint32_t components,
+                                    std::vector<uint32_t>* output) {
+  const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+  double center[3] = { 0.0, 0.0, 0.0 };
+  double total_area = 0.0;
+
+  struct CLUSTER {
+    uint32_t begin;
+    uint32_t end;
+    double centroid[3];
+    double normal[3];
+    double sort_key;
+  };
+  std::vector<CLUSTER> sorted(clusters.size());
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    CLUSTER& cluster = sorted[c];
+    cluster.begin = clusters[c];
+    cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+    double area = 0.0;
+    for (int32_t k = 0; k < 3; ++k) {
+      cluster.centroid[k] = 0.0;
+      cluster.normal[k] = 0.0;
+    }
+    for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+      const float* p0 = &vertices[indices[t * 3] * components];
+      const float* p1 = &vertices[indices[t * 3 + 1] * components];
+      const float* p2 = &vertices[indices[t * 3 + 2] * components];
+      const double e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      const double e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      const double n[3] = { e0[1] * e1[2] - e0[2] * e1[1],
+                            e0[2] * e1[0] - e0[0] * e1[2],
+                            e0[0] * e1[1] - e0[1] * e1[0] };
+      const double a =
+          0.5 * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int32_t k = 0; k < 3; ++k) {
+        cluster.normal[k] += n[k];
+        cluster.centroid[k] += a * (p0[k] + p1[k] + p2[k]) / 3.0;
+      }
+      area += a;
+    }
+    for (int32_t k = 0; k < 3; ++k) {
+      center[k] += cluster.centroid[k];
+      if (area > 0.0) cluster.centroid[k] /= area;
+    }
+    total_area += area;
+  }
+  for (int32_t k = 0; k < 3; ++k) {
+    if (total_area > 0.0) center[k] /= total_area;
+  }
+
+  for (size_t c = 0; c < sorted.size(); ++c) {
+    CLUSTER& cluster = sorted[c];
+    const double* n = cluster.normal;
+    const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    cluster.sort_key = 0.0;
+    for (int32_t k = 0; k < 3; ++k) {
+      if (length > 0.0)
+        cluster.sort_key += (cluster.centroid[k] - center[k]) * n[k] / length;
+    }
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const CLUSTER& a, const CLUSTER& b) {
+                     return a.sort_key > b.sort_key;
+                   });
+
+  output->clear();
+  for (size_t c = 0; c < sorted.size(); ++c) {
+    output->insert(output->end(), indices.begin() + sorted[c].begin * 3,
+                   indices.begin() + sorted[c].end * 3);
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Renumber vertices in order of first use, unused vertices are dropped.
+// indices may hold several LODs sharing the vertices, finest first.
+//--------------------------------------------------------------------------------
+static void ReorderVertices(std::vector<uint32_t>* indices,
+                            std::vector<float>* vertices,
+                            const uint32_t components) {
+  const uint32_t vertex_count =
+      static_cast<uint32_t>(vertices->size() / components);
+  std::vector<int32_t> remap(vertex_count, -1);
+  std::vector<float> reordered;
+  reordered.reserve(vertices->size());
+  uint32_t next = 0;
+  for (size_t i = 0; i < indices->size(); ++i) {
+    const uint32_t v = (*indices)[i];
+    if (remap[v] < 0) {
+      remap[v] = next++;
+      reordered.insert(reordered.end(), vertices->begin() + v * components,
+                       vertices->begin() + (v + 1) * components);
+    }
+    (*indices)[i] = remap[v];
+  }
+  vertices->swap(reordered);
+}
+
+//--------------------------------------------------------------------------------
+// Cache and overdraw passes, prints the cache statistics before and after
+//--------------------------------------------------------------------------------
+static void OptimizeTriangles(std::vector<uint32_t>* indices,
+                              const std::vector<float>& vertices,
+                              const uint32_t components) {
+  const uint32_t vertex_count =
+      static_cast<uint32_t>(vertices.size() / components);
+  const CACHE_STATISTICS before =
+      SimulateVertexCache(*indices, vertex_count);
+
+  std::vector<uint32_t> tipsified;
+  std::vector<uint32_t> clusters;
+  Tipsify(*indices, vertex_count, VERTEX_CACHE_SIZE, &tipsified, &clusters);
+  const CACHE_STATISTICS tipsify = SimulateVertexCache(tipsified, vertex_count);
+
+  std::vector<uint32_t> sorted;
+  SortClustersForOverdraw(tipsified, clusters, vertices, components, &sorted);
+  const CACHE_STATISTICS overdraw = SimulateVertexCache(sorted, vertex_count);
+  const bool keep_overdraw =
+      overdraw.acmr <= tipsify.acmr * OVERDRAW_ACMR_THRESHOLD;
+  const CACHE_STATISTICS& optimized = keep_overdraw ? overdraw : tipsify;
+  // An input that is already cache optimized may beat both
+  const bool keep_input =
+      optimized.acmr > before.acmr || optimized.atvr > before.atvr;
+  if (!keep_input) indices->swap(keep_overdraw ? sorted : tipsified);
+
+  printf("Vertex cache (%d entries FIFO), %zu triangles\n", VERTEX_CACHE_SIZE,
+         indices->size() / 3);
+  printf("  input:    ACMR %.3f ATVR %.3f%s\n", before.acmr, before.atvr,
+         keep_input ? ", kept" : "");
+  printf("  tipsify:  ACMR %.3f ATVR %.3f\n", tipsify.acmr, tipsify.atvr);
+  printf("  overdraw: ACMR %.3f ATVR %.3f, %zu clusters, %s\n", overdraw.acmr,
+         overdraw.atvr, clusters.size(), keep_overdraw ? "kept" : "dropped");
+}
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// mesh_optimizer_test.cpp
+// Host test of the mesh_optimizer.h passes
+//
+// Build and run on the host:
+//   g++ -std=c++11 -O2 -o mesh_optimizer_test tools/mesh_optimizer_test.cpp
+//   ./mesh_optimizer_test tools/meshes/teapot.obj
+//
+// Runs Tipsify, the overdraw cluster sort and OptimizeTriangles() over the
+// positions of the mesh, in file order and shuffled. Every order has to draw
+// the same triangles with the same winding. Tipsify and the result of
+// OptimizeTriangles() have to keep the ACMR and ATVR of the input or better
+// under the VERTEX_CACHE_SIZE FIFO simulation, the cluster sort alone may
+// trade some of it for overdraw. ReorderVertices() has to remap every index
+// onto the vertex it referenced before. Exits with 1 when a check failed.
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+#include "mesh_optimizer.h"
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+// Positions only, the passes do not look at other attributes
+const uint32_t COMPONENTS = 3;
+
+static int32_t failures = 0;
+
+static void Check(const bool condition, const char* what) {
+  printf("  %s: %s\n", condition ? "ok" : "FAILED", what);
+  if (!condition) failures++;
+}
+
+//--------------------------------------------------------------------------------
+// v and f records, vertices are the OBJ positions, polygons become fans
+//--------------------------------------------------------------------------------
+static bool ReadPositions(const char* file_name, std::vector<float>* vertices,
+                          std::vector<uint32_t>* indices) {
+  FILE* fp = fopen(file_name, "r");
+  if (fp == NULL) return false;
+
+  char line[1024];
+  while (fgets(line, sizeof(line), fp)) {
+    if (strncmp(line, "v ", 2) == 0) {
+      float x = 0.f, y = 0.f, z = 0.f;
+      sscanf(line + 2, "%f %f %f", &x, &y, &z);
+      vertices->push_back(x);
+      vertices->push_back(y);
+      vertices->push_back(z);
+    } else if (strncmp(line, "f ", 2) == 0) {
+      const int32_t count = static_cast<int32_t>(vertices->size() / COMPONENTS);
+      std::vector<uint32_t> polygon;
+      for (char* token = strtok(line + 2, " \t\r\n"); token;
+           token = strtok(NULL, " \t\r\n")) {
+        // Up to the first '/', negative indices count back
+        int32_t v = strtol(token, NULL, 10);
+        v = v > 0 ? v - 1 : count + v;
+        if (v < 0 || v >= count) {
+          fclose(fp);
+          return false;
+        }
+        polygon.push_back(v);
+      }
+      for (size_t i = 2; i < polygon.size(); ++i) {
+        indices->push_back(polygon[0]);
+        indices->push_back(polygon[i - 1]);
+        indices->push_back(polygon[i]);
+      }
+    }
+  }
+  fclose(fp);
+  return !indices->empty();
+}
+
+//--------------------------------------------------------------------------------
+// Triangles rotated to start at their smallest index and sorted, equal lists
+// draw the same triangles with the same winding
+//--------------------------------------------------------------------------------
+static std::vector<std::array<uint32_t, 3> > GetTriangles(
+    const std::vector<uint32_t>& indices) {
+  std::vector<std::array<uint32_t, 3> > triangles;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const uint32_t* t = &indices[i];
+    const size_t first = std::min_element(t, t + 3) - t;
+    std::array<uint32_t, 3> triangle;
+    for (size_t k = 0; k < 3; ++k) triangle[k] = t[(first + k) % 3];
+    triangles.push_back(triangle);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+static void CheckCache(const char* name, const std::vector<uint32_t>& input,
+                       const std::vector<uint32_t>& output,
+                       const uint32_t vertex_count) {
+  const CACHE_STATISTICS before = SimulateVertexCache(input, vertex_count);
+  const CACHE_STATISTICS after = SimulateVertexCache(output, vertex_count);
+  printf("%s: ACMR %.3f -> %.3f ATVR %.3f -> %.3f\n", name, before.acmr,
+         after.acmr, before.atvr, after.atvr);
+  Check(after.acmr <= before.acmr, "ACMR no worse than the input");
+  Check(after.atvr <= before.atvr, "ATVR no worse than the input");
+}
+
+static void CheckTriangles(const char* name, const std::vector<uint32_t>& input,
+                           const std::vector<uint32_t>& output) {
+  printf("%s: %zu -> %zu triangles\n", name, input.size() / 3,
+         output.size() / 3);
+  Check(GetTriangles(input) == GetTriangles(output),
+        "same triangles and winding");
+}
+
+//--------------------------------------------------------------------------------
+// Every output index has to reference the data of its input vertex, and the
+// vertices have to come in order of first use
+//--------------------------------------------------------------------------------
+static void CheckReorder(const std::vector<uint32_t>& input,
+                         const std::vector<float>& vertices) {
+  std::vector<uint32_t> indices(input);
+  std::vector<float> reordered(vertices);
+  ReorderVertices(&indices, &reordered, COMPONENTS);
+  const uint32_t vertex_count =
+      static_cast<uint32_t>(reordered.size() / COMPONENTS);
+  printf("reorder: %zu -> %u vertices\n", vertices.size() / COMPONENTS,
+         vertex_count);
+
+  bool remapped = indices.size() == input.size();
+  bool first_use = remapped;
+  uint32_t next = 0;
+  for (size_t i = 0; remapped && i < indices.size(); ++i) {
+    const uint32_t v = indices[i];
+    if (v >= vertex_count) {
+      remapped = false;
+      break;
+    }
+    remapped = std::equal(&reordered[v * COMPONENTS],
+                          &reordered[v * COMPONENTS] + COMPONENTS,
+                          &vertices[input[i] * COMPONENTS]);
+    if (v == next)
+      next++;
+    else if (v > next)
+      first_use = false;
+  }
+  Check(remapped, "every index remapped onto its vertex");
+  Check(first_use && next == vertex_count, "vertices in order of first use");
+}
+
+//--------------------------------------------------------------------------------
+// All passes over one triangle order
+//--------------------------------------------------------------------------------
+static void CheckPasses(const std::vector<uint32_t>& indices,
+                        const std::vector<float>& vertices) {
+  const uint32_t vertex_count =
+      static_cast<uint32_t>(vertices.size() / COMPONENTS);
+
+  std::vector<uint32_t> tipsified;
+  std::vector<uint32_t> clusters;
+  Tipsify(indices, vertex_count, VERTEX_CACHE_SIZE, &tipsified, &clusters);
+  CheckCache("tipsify", indices, tipsified, vertex_count);
+  CheckTriangles("tipsify", indices, tipsified);
+
+  // May trade some cache efficiency, OptimizeTriangles() bounds it
+  std::vector<uint32_t> sorted;
+  SortClustersForOverdraw(tipsified, clusters, vertices, COMPONENTS, &sorted);
+  CheckTriangles("overdraw", indices, sorted);
+
+  std::vector<uint32_t> optimized(indices);
+  OptimizeTriangles(&optimized, vertices, COMPONENTS);
+  CheckCache("optimized", indices, optimized, vertex_count);
+  CheckTriangles("optimized", indices, optimized);
+
+  CheckReorder(optimized, vertices);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s input.obj\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  if (!ReadPositions(argv[1], &vertices, &indices)) {
+    fprintf(stderr, "Failed to read %s\n", argv[1]);
+    return 1;
+  }
+  printf("%s: %zu vertices, %zu triangles\n", argv[1],
+         vertices.size() / COMPONENTS, indices.size() / 3);
+
+  printf("\nFile order\n");
+  CheckPasses(indices, vertices);
+
+  // Exported meshes often come cache friendly already, shuffled triangles with
+  // rotated corners leave the passes real work
+  std::vector<std::array<uint32_t, 3> > triangles;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    std::array<uint32_t, 3> triangle = { { indices[i], indices[i + 1],
+                                           indices[i + 2] } };
+    triangles.push_back(triangle);
+  }
+  std::mt19937 random(1);
+  std::shuffle(triangles.begin(), triangles.end(), random);
+  std::vector<uint32_t> shuffled;
+  for (size_t t = 0; t < triangles.size(); ++t) {
+    for (size_t k = 0; k < 3; ++k)
+      shuffled.push_back(triangles[t][(t + k) % 3]);
+  }
+  printf("\nShuffled order\n");
+  CheckPasses(shuffled, vertices);
+
+  if (failures) {
+    printf("\n%d checks failed\n", failures);
+    return 1;
+  }
+  printf("\nAll checks passed\n");
+  return 0;
+}
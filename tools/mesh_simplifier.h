@@ -0,0 +1,336 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// mesh_simplifier.h
+// Quadric error simplification for the LOD chain of the mesh converter
+//
+// SimplifyMesh() follows Garland and Heckbert, "Surface Simplification Using
+// Quadric Error Metrics", 1997, restricted to half edge collapses so that the
+// simplified triangles index the vertices of the full mesh and all LODs share
+// one vertex buffer.
+// - Vertices with identical attributes are welded first, e.g. the duplicated
+//   rims of the teapot patches.
+// - Vertices on open borders and on attribute seams, one position with
+//   several normals, never move, so LODs do not crack.
+// - Collapses that flip a triangle are rejected.
+//--------------------------------------------------------------------------------
+#ifndef _MESH_SIMPLIFIER_H
+#define _MESH_SIMPLIFIER_H
+
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+// Symmetric 4x4 matrix of the summed squared plane distances
+struct QUADRIC {
+  double a[10];
+};
+
+struct COLLAPSE {
+  double cost;
+  uint32_t from;
+  uint32_t to;
+
+  bool operator<(const COLLAPSE& rhs) const { return cost < rhs.cost; }
+};
+
+static void AddPlaneQuadric(const double* n, const double d, QUADRIC* q) {
+  q->a[0] += n[0] * n[0];
+  q->a[1] += n[0] * n[1];
+  q->a[2] += n[0] * n[2];
+  q->a[3] += n[0] * d;
+  q->a[4] += n[1] * n[1];
+  q->a[5] += n[1] * n[2];
+  q->a[6] += n[1] * d;
+  q->a[7] += n[2] * n[2];
+  q->a[8] += n[2] * d;
+  q->a[9] += d * d;
+}
+
+static double QuadricError(const QUADRIC& q, const float* p) {
+  const double x = p[0], y = p[1], z = p[2];
+  const double error = q.a[0] * x * x + 2 * q.a[1] * x * y +
+                       2 * q.a[2] * x * z + 2 * q.a[3] * x + q.a[4] * y * y +
+                       2 * q.a[5] * y * z + 2 * q.a[6] * y + q.a[7] * z * z +
+                       2 * q.a[8] * z + q.a[9];
+  return std::max(error, 0.0);
+}
+
+// Unnormalized, zero for degenerate triangles
+static void TriangleNormal(const float* p0, const float* p1, const float* p2,
+                           double* n) {
+  const double e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  const double e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+  n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+  n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+  n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+//--------------------------------------------------------------------------------
+// Distance from p to the triangle a b c, Ericson, "Real-Time Collision
+// Detection" 5.1.5
+//--------------------------------------------------------------------------------
+static double PointTriangleDistance(const float* p, const float* a,
+                                    const float* b, const float* c) {
+  double ab[3], ac[3], ap[3];
+  for (int32_t k = 0; k < 3; ++k) {
+    ab[k] = b[k] - a[k];
+    ac[k] = c[k] - a[k];
+    ap[k] = p[k] - a[k];
+  }
+  const double d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+  const double d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+  double v = 0.0, w = 0.0;
+  if (d1 <= 0.0 && d2 <= 0.0) {
+    v = w = 0.0;
+  } else {
+    double bp[3], cp[3];
+    for (int32_t k = 0; k < 3; ++k) {
+      bp[k] = p[k] - b[k];
+      cp[k] = p[k] - c[k];
+    }
+    const double d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+    const double d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+    const double d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+    const double d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+    const double vc = d1 * d4 - d3 * d2;
+    const double vb = d5 * d2 - d1 * d6;
+    const double va = d3 * d6 - d5 * d4;
+    if (d3 >= 0.0 && d4 <= d3) {
+      v = 1.0;
+    } else if (d6 >= 0.0 && d5 <= d6) {
+      w = 1.0;
+    } else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+      v = d1 / (d1 - d3);
+    } else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+      w = d2 / (d2 - d6);
+    } else if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+      w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+      v = 1.0 - w;
+    } else {
+      const double denom = 1.0 / (va + vb + vc);
+      v = vb * denom;
+      w = vc * denom;
+    }
+  }
+  double distance = 0.0;
+  for (int32_t k = 0; k < 3; ++k) {
+    const double d = a[k] + ab[k] * v + ac[k] * w - p[k];
+    distance += d * d;
+  }
+  return std::sqrt(distance);
+}
+
+//--------------------------------------------------------------------------------
+// Largest distance of the vertices of the full mesh to the simplified surface
+//--------------------------------------------------------------------------------
+static float MeasureSimplifiedError(const std::vector<uint32_t>& indices,
+                                    const std::vector<uint32_t>& simplified,
+                                    const std::vector<float>& vertices,
+                                    const uint32_t components) {
+  double error = 0.0;
+  std::vector<bool> measured(vertices.size() / components, false);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (measured[indices[i]]) continue;
+    measured[indices[i]] = true;
+
+    const float* p = &vertices[indices[i] * components];
+    double nearest = -1.0;
+    for (size_t t = 0; t < simplified.size() && nearest != 0.0; t += 3) {
+      const double d = PointTriangleDistance(
+          p, &vertices[simplified[t] * components],
+          &vertices[simplified[t + 1] * components],
+          &vertices[simplified[t + 2] * components]);
+      if (nearest < 0.0 || d < nearest) nearest = d;
+    }
+    error = std::max(error, nearest);
+  }
+  return static_cast<float>(error);
+}
+
+//--------------------------------------------------------------------------------
+// Collapse edges in order of quadric error until at most target_triangles
+// remain or nothing can be collapsed. Positions are the first 3 floats of
+// each vertex. Returns the error of MeasureSimplifiedError().
+//--------------------------------------------------------------------------------
+static float SimplifyMesh(const std::vector<uint32_t>& indices,
+                          const std::vector<float>& vertices,
+                          const uint32_t components,
+                          const uint32_t target_triangles,
+                          std::vector<uint32_t>* output) {
+  const uint32_t vertex_count =
+      static_cast<uint32_t>(vertices.size() / components);
+
+  // Weld identical vertices, lock positions shared by different vertices
+  std::vector<uint32_t> canonical(vertex_count);
+  std::map<std::vector<float>, uint32_t> unique;
+  std::map<std::vector<float>, uint32_t> positions;
+  std::vector<bool> locked(vertex_count, false);
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    const std::vector<float> key(vertices.begin() + v * components,
+                                 vertices.begin() + (v + 1) * components);
+    std::map<std::vector<float>, uint32_t>::iterator it = unique.find(key);
+    canonical[v] = it == unique.end() ? (unique[key] = v) : it->second;
+  }
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    if (canonical[v] != v) continue;
+    const std::vector<float> key(vertices.begin() + v * components,
+                                 vertices.begin() + v * components + 3);
+    std::map<std::vector<float>, uint32_t>::iterator it = positions.find(key);
+    if (it == positions.end()) {
+      positions[key] = v;
+    } else {
+      locked[v] = true;
+      locked[it->second] = true;
+    }
+  }
+
+  std::vector<uint32_t> triangles(indices.size());
+  for (size_t i = 0; i < indices.size(); ++i)
+    triangles[i] = canonical[indices[i]];
+
+  std::vector<QUADRIC> quadrics(vertex_count);
+  for (uint32_t v = 0; v < vertex_count; ++v)
+    std::fill(quadrics[v].a, quadrics[v].a + 10, 0.0);
+  for (size_t i = 0; i < triangles.size(); i += 3) {
+    const float* p0 = &vertices[triangles[i] * components];
+    double n[3];
+    TriangleNormal(p0, &vertices[triangles[i + 1] * components],
+                   &vertices[triangles[i + 2] * components], n);
+    const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.0) continue;
+    for (int32_t k = 0; k < 3; ++k) n[k] /= length;
+    const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+    for (int32_t k = 0; k < 3; ++k)
+      AddPlaneQuadric(n, d, &quadrics[triangles[i + k]]);
+  }
+
+  uint32_t triangle_count = static_cast<uint32_t>(triangles.size() / 3);
+  std::vector<std::vector<uint32_t> > adjacency(vertex_count);
+  std::vector<bool> touched(vertex_count);
+  std::vector<bool> border(vertex_count);
+  while (triangle_count > target_triangles) {
+    // Triangles around each vertex and edges used by a single triangle
+    for (uint32_t v = 0; v < vertex_count; ++v) adjacency[v].clear();
+    std::map<std::pair<uint32_t, uint32_t>, int32_t> edges;
+    for (uint32_t t = 0; t < triangles.size() / 3; ++t) {
+      for (int32_t k = 0; k < 3; ++k) {
+        const uint32_t a = triangles[t * 3 + k];
+        const uint32_t b = triangles[t * 3 + (k + 1) % 3];
+        adjacency[a].push_back(t);
+        edges[std::make_pair(std::min(a, b), std::max(a, b))]++;
+      }
+    }
+    std::fill(border.begin(), border.end(), false);
+    std::map<std::pair<uint32_t, uint32_t>, int32_t>::const_iterator e;
+    for (e = edges.begin(); e != edges.end(); ++e) {
+      if (e->second == 1) {
+        border[e->first.first] = true;
+        border[e->first.second] = true;
+      }
+    }
+
+    // Cheapest direction of each edge
+    std::vector<COLLAPSE> collapses;
+    for (e = edges.begin(); e != edges.end(); ++e) {
+      const uint32_t a = e->first.first;
+      const uint32_t b = e->first.second;
+      QUADRIC q;
+      for (int32_t k = 0; k < 10; ++k)
+        q.a[k] = quadrics[a].a[k] + quadrics[b].a[k];
+      COLLAPSE collapse = { -1.0, 0, 0 };
+      if (!locked[a] && !border[a]) {
+        collapse.cost = QuadricError(q, &vertices[b * components]);
+        collapse.from = a;
+        collapse.to = b;
+      }
+      if (!locked[b] && !border[b]) {
+        const double cost = QuadricError(q, &vertices[a * components]);
+        if (collapse.cost < 0.0 || cost < collapse.cost) {
+          collapse.cost = cost;
+          collapse.from = b;
+          collapse.to = a;
+        }
+      }
+      if (collapse.cost >= 0.0) collapses.push_back(collapse);
+    }
+    std::sort(collapses.begin(), collapses.end());
+
+    // Independent collapses, cheapest first
+    std::fill(touched.begin(), touched.end(), false);
+    int32_t collapsed = 0;
+    for (size_t c = 0; c < collapses.size(); ++c) {
+      if (triangle_count <= target_triangles) break;
+      const uint32_t from = collapses[c].from;
+      const uint32_t to = collapses[c].to;
+      if (touched[from] || touched[to]) continue;
+
+      // Reject flips of the triangles that move
+      bool flipped = false;
+      const std::vector<uint32_t>& around = adjacency[from];
+      for (size_t i = 0; i < around.size() && !flipped; ++i) {
+        const uint32_t* t = &triangles[around[i] * 3];
+        if (t[0] == to || t[1] == to || t[2] == to) continue;
+        const float* p[3];
+        const float* q[3];
+        for (int32_t k = 0; k < 3; ++k) {
+          p[k] = &vertices[t[k] * components];
+          q[k] = &vertices[(t[k] == from ? to : t[k]) * components];
+        }
+        double before[3], after[3];
+        TriangleNormal(p[0], p[1], p[2], before);
+        TriangleNormal(q[0], q[1], q[2], after);
+        flipped = before[0] * after[0] + before[1] * after[1] +
+                      before[2] * after[2] <= 0.0;
+      }
+      if (flipped) continue;
+
+      for (size_t i = 0; i < around.size(); ++i) {
+        uint32_t* t = &triangles[around[i] * 3];
+        if (t[0] == to || t[1] == to || t[2] == to) triangle_count--;
+        for (int32_t k = 0; k < 3; ++k) {
+          touched[t[k]] = true;
+          if (t[k] == from) t[k] = to;
+        }
+      }
+      for (int32_t k = 0; k < 10; ++k)
+        quadrics[to].a[k] += quadrics[from].a[k];
+      collapsed++;
+    }
+    if (collapsed == 0) break;
+
+    // Drop the triangles that collapsed
+    size_t write = 0;
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      const uint32_t* t = &triangles[i];
+      if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0]) continue;
+      for (int32_t k = 0; k < 3; ++k) triangles[write++] = t[k];
+    }
+    triangles.resize(write);
+  }
+
+  output->swap(triangles);
+  return MeasureSimplifiedError(indices, *output, vertices, components);
+}
+
+#endif
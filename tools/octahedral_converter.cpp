@@ -0,0 +1,247 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//--------------------------------------------------------------------------------
+// octahedral_converter.cpp
+// Host tool converting prefiltered cubemap face sets into octahedral maps
+//
+// Build and run on the host:
+//   g++ -std=c++11 -O2 -o octahedral_converter tools/octahedral_converter.cpp
+//   ./octahedral_converter assets/cubemaps/stpeters_phong_m%02d_c%02d.bmp
+//                          assets/cubemaps/stpeters_oct_m%02d.bmp
+//
+// Each cubemap level of size N becomes one 2N x 2N octahedral level, so a
+// stage needs 8 files instead of 48. The mapping matches OctahedralUV() in
+// CubemapTexture.cpp: +Y is the center of the map, -Y the folded corners.
+//--------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------
+// Include files
+//--------------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//--------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------
+const int32_t CUBEMAP_FACES = 6;
+const int32_t CUBEMAP_LEVELS = 8;
+
+struct IMAGE {
+  int32_t width;
+  int32_t height;
+  // RGBA8, top row first
+  std::vector<uint8_t> pixels;
+};
+
+//--------------------------------------------------------------------------------
+// 24/32 bit uncompressed BMP
+//--------------------------------------------------------------------------------
+static bool ReadBMP(const char* file_name, IMAGE* image) {
+  FILE* fp = fopen(file_name, "rb");
+  if (fp == NULL) return false;
+
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    data.insert(data.end(), buffer, buffer + read);
+  fclose(fp);
+  if (data.size() < 54 || data[0] != 'B' || data[1] != 'M') return false;
+
+  uint32_t offset;
+  int32_t width, height;
+  uint16_t bpp;
+  memcpy(&offset, &data[10], 4);
+  memcpy(&width, &data[18], 4);
+  memcpy(&height, &data[22], 4);
+  memcpy(&bpp, &data[28], 2);
+  if (bpp != 24 && bpp != 32) return false;
+
+  const bool bottom_up = height > 0;
+  height = std::abs(height);
+  const int32_t bytes = bpp / 8;
+  const int32_t stride = (width * bytes + 3) & ~3;
+  if (data.size() < offset + stride * height) return false;
+
+  image->width = width;
+  image->height = height;
+  image->pixels.resize(width * height * 4);
+  for (int32_t y = 0; y < height; ++y) {
+    const int32_t row = bottom_up ? height - 1 - y : y;
+    const uint8_t* src = &data[offset + row * stride];
+    uint8_t* dst = &image->pixels[y * width * 4];
+    for (int32_t x = 0; x < width; ++x) {
+      dst[x * 4 + 0] = src[x * bytes + 2];
+      dst[x * 4 + 1] = src[x * bytes + 1];
+      dst[x * 4 + 2] = src[x * bytes + 0];
+      dst[x * 4 + 3] = 255;
+    }
+  }
+  return true;
+}
+
+static void Write16(FILE* fp, const uint16_t v) { fwrite(&v, 2, 1, fp); }
+static void Write32(FILE* fp, const uint32_t v) { fwrite(&v, 4, 1, fp); }
+
+static bool WriteBMP(const char* file_name, const IMAGE& image) {
+  FILE* fp = fopen(file_name, "wb");
+  if (fp == NULL) return false;
+
+  const uint32_t size = image.width * image.height * 4;
+  fwrite("BM", 1, 2, fp);
+  Write32(fp, 54 + size);
+  Write32(fp, 0);
+  Write32(fp, 54);
+  Write32(fp, 40);
+  Write32(fp, image.width);
+  Write32(fp, image.height);
+  Write16(fp, 1);
+  Write16(fp, 32);
+  Write32(fp, 0);
+  Write32(fp, size);
+  Write32(fp, 2834);
+  Write32(fp, 2834);
+  Write32(fp, 0);
+  Write32(fp, 0);
+  for (int32_t y = image.height - 1; y >= 0; --y) {
+    const uint8_t* src = &image.pixels[y * image.width * 4];
+    for (int32_t x = 0; x < image.width; ++x) {
+      const uint8_t bgra[4] = { src[x * 4 + 2], src[x * 4 + 1], src[x * 4 + 0],
+                                src[x * 4 + 3] };
+      fwrite(bgra, 1, 4, fp);
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+// Bilinear cubemap lookup following the GL face selection rules
+//--------------------------------------------------------------------------------
+static void SampleCubemap(const IMAGE* faces, const float* dir, float* color) {
+  const float ax = fabsf(dir[0]);
+  const float ay = fabsf(dir[1]);
+  const float az = fabsf(dir[2]);
+  int32_t face;
+  float sc, tc, ma;
+  if (ax >= ay && ax >= az) {
+    face = dir[0] > 0.f ? 0 : 1;
+    sc = dir[0] > 0.f ? -dir[2] : dir[2];
+    tc = -dir[1];
+    ma = ax;
+  } else if (ay >= az) {
+    face = dir[1] > 0.f ? 2 : 3;
+    sc = dir[0];
+    tc = dir[1] > 0.f ? dir[2] : -dir[2];
+    ma = ay;
+  } else {
+    face = dir[2] > 0.f ? 4 : 5;
+    sc = dir[2] > 0.f ? dir[0] : -dir[0];
+    tc = -dir[1];
+    ma = az;
+  }
+
+  const IMAGE& image = faces[face];
+  const int32_t size = image.width;
+  const float fx = std::min(std::max(((sc / ma + 1.f) * 0.5f) * size - 0.5f, 0.f),
+                            size - 1.f);
+  const float fy = std::min(std::max(((tc / ma + 1.f) * 0.5f) * size - 0.5f, 0.f),
+                            size - 1.f);
+  const int32_t x0 = static_cast<int32_t>(fx);
+  const int32_t y0 = static_cast<int32_t>(fy);
+  const int32_t x1 = std::min(x0 + 1, size - 1);
+  const int32_t y1 = std::min(y0 + 1, size - 1);
+  const float wx = fx - x0;
+  const float wy = fy - y0;
+  for (int32_t c = 0; c < 4; ++c) {
+    const uint8_t* p = &image.pixels[0];
+    const float top = p[(y0 * size + x0) * 4 + c] * (1.f - wx) +
+                      p[(y0 * size + x1) * 4 + c] * wx;
+    const float bottom = p[(y1 * size + x0) * 4 + c] * (1.f - wx) +
+                         p[(y1 * size + x1) * 4 + c] * wx;
+    color[c] = top * (1.f - wy) + bottom * wy;
+  }
+}
+
+//--------------------------------------------------------------------------------
+// Inverse of OctahedralUV() in the shaders
+//--------------------------------------------------------------------------------
+static void OctahedralDirection(const float u, const float v, float* dir) {
+  const float px = u * 2.f - 1.f;
+  const float pz = v * 2.f - 1.f;
+  dir[0] = px;
+  dir[1] = 1.f - fabsf(px) - fabsf(pz);
+  dir[2] = pz;
+  if (dir[1] < 0.f) {
+    dir[0] = (1.f - fabsf(pz)) * (px >= 0.f ? 1.f : -1.f);
+    dir[2] = (1.f - fabsf(px)) * (pz >= 0.f ? 1.f : -1.f);
+  }
+  const float length =
+      sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+  for (int32_t i = 0; i < 3; ++i) dir[i] /= length;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <face pattern (level, face)> <output pattern "
+                    "(level)>\n", argv[0]);
+    return 1;
+  }
+
+  for (int32_t level = 0; level < CUBEMAP_LEVELS; ++level) {
+    IMAGE faces[CUBEMAP_FACES];
+    for (int32_t face = 0; face < CUBEMAP_FACES; ++face) {
+      char file_name[1024];
+      snprintf(file_name, sizeof(file_name), argv[1], level, face);
+      if (!ReadBMP(file_name, &faces[face]) ||
+          faces[face].width != faces[face].height) {
+        fprintf(stderr, "Can not read %s\n", file_name);
+        return 1;
+      }
+    }
+
+    // Twice the face size keeps the texel density around the equator
+    IMAGE octahedral;
+    octahedral.width = octahedral.height = faces[0].width * 2;
+    octahedral.pixels.resize(octahedral.width * octahedral.height * 4);
+    for (int32_t y = 0; y < octahedral.height; ++y) {
+      for (int32_t x = 0; x < octahedral.width; ++x) {
+        float dir[3];
+        OctahedralDirection((x + 0.5f) / octahedral.width,
+                            (y + 0.5f) / octahedral.height, dir);
+        float color[4];
+        SampleCubemap(faces, dir, color);
+        for (int32_t c = 0; c < 4; ++c)
+          octahedral.pixels[(y * octahedral.width + x) * 4 + c] =
+              static_cast<uint8_t>(std::min(color[c] + 0.5f, 255.f));
+      }
+    }
+
+    char file_name[1024];
+    snprintf(file_name, sizeof(file_name), argv[2], level);
+    if (!WriteBMP(file_name, octahedral)) {
+      fprintf(stderr, "Can not write %s\n", file_name);
+      return 1;
+    }
+    printf("%s %dx%d\n", file_name, octahedral.width, octahedral.height);
+  }
+  return 0;
+}